@@ -0,0 +1,97 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <new>
+#include <chrono>
+
+#include "kvstore.h"
+#include "utils.h"
+
+/*
+ * Counts heap allocations done by the write path. Every put below builds
+ * its value first (one allocation of value_size bytes that is charged to
+ * the caller), so anything above that is done by the store itself.
+ */
+
+static uint64_t nr_allocs = 0;
+static uint64_t nr_alloc_bytes = 0;
+
+void* operator new(std::size_t size)
+{
+    ++nr_allocs;
+    nr_alloc_bytes += size;
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+struct Result
+{
+    uint64_t allocs_;
+    uint64_t bytes_;
+    double seconds_;
+};
+
+static Result run(KVStore &store, uint64_t nr_ops, uint64_t value_size, bool move_value)
+{
+    uint64_t allocs = nr_allocs;
+    uint64_t bytes = nr_alloc_bytes;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < nr_ops; ++i)
+    {
+        std::string value(value_size, 'a' + i % 26);
+        if (move_value)
+        {
+            store.put(i, std::move(value));
+        }
+        else
+        {
+            store.put(i, value);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    return Result{nr_allocs - allocs, nr_alloc_bytes - bytes, std::chrono::duration<double>(end - start).count()};
+}
+
+static void report(const char *name, const Result &result, uint64_t nr_ops, uint64_t value_size)
+{
+    std::cout << name << ": "
+              << (double)result.allocs_ / nr_ops << " allocs/put, "
+              << (double)result.bytes_ / nr_ops / value_size << "x value bytes allocated/put, "
+              << nr_ops / result.seconds_ << " puts/s" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_ops = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 4096;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 64 * 1024;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [ops] [value_size]" << std::endl;
+    std::cout << "  " << nr_ops << " puts of " << value_size << " bytes under " << dir << std::endl;
+
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        std::string path = dir + (mode? "/move" : "/copy");
+        utils::mkdir(path.c_str());
+        KVStore store(path);
+        store.reset();
+        Result result = run(store, nr_ops, value_size, mode == 1);
+        report(mode? "put(key, std::move(value))" : "put(key, value)", result, nr_ops, value_size);
+    }
+    return 0;
+}
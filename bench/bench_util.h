@@ -0,0 +1,39 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <random>
+#include <chrono>
+
+#include "kvstore.h"
+
+/*
+ * The random overwrite workload several benchmarks load: nr_ops puts of
+ * value_size bytes over key_space keys drawn from rng. Seeded the same,
+ * every store of a comparison gets the same keys in the same order.
+ */
+
+static const uint64_t BENCH_SEED = 2023;
+
+// the seconds the puts took
+static inline double load_random(KVStore &store, std::mt19937_64 &rng, uint64_t nr_ops, uint64_t value_size,
+                                 uint64_t key_space)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < nr_ops; ++i)
+    {
+        store.put(rng() % key_space, std::string(value_size, 'a' + i % 26));
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+static inline void report_load(const std::string &name, uint64_t nr_ops, uint64_t value_size, double seconds)
+{
+    std::cout << name << ": " << nr_ops / seconds << " puts/s, "
+              << (double)nr_ops * value_size / seconds / 1024 / 1024 << " MB/s" << std::endl;
+}
+
+#endif // BENCH_UTIL_H
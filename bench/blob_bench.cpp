@@ -0,0 +1,66 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <random>
+#include <chrono>
+
+#include "kvstore.h"
+#include "utils.h"
+#include "bench_util.h"
+
+/*
+ * Key-value separation. The same random overwrite workload is loaded with
+ * every value in the tables and with the values in value log files, then
+ * the same random gets are run against both; the compaction traffic, the
+ * value log traffic and the garbage collection of each store are printed.
+ */
+
+static uint64_t property(const KVStore &store, const std::string &name)
+{
+    std::string value;
+    store.get_property(name, &value);
+    return std::strtoull(value.c_str(), nullptr, 10);
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_ops = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 100000;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 4096;
+    uint64_t key_space = (argc > 4)? std::strtoull(argv[4], nullptr, 10) : 20000;
+    const double MB = 1024.0 * 1024.0;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [ops] [value_size] [key_space]" << std::endl;
+    std::cout << "  " << nr_ops << " puts of " << value_size << " bytes over " << key_space
+              << " keys, then " << nr_ops << " gets, under " << dir << std::endl;
+
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        std::string path = dir + (mode? "/blob" : "/inline");
+        utils::mkdir(path.c_str());
+        Options options;
+        options.min_blob_size = mode? value_size / 2 : 0;
+        KVStore store(path, options);
+        store.reset();
+        std::mt19937_64 rng(BENCH_SEED);
+        double put_seconds = load_random(store, rng, nr_ops, value_size, key_space);
+        uint64_t found = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < nr_ops; ++i)
+        {
+            found += !store.get(rng() % key_space).empty();
+        }
+        double get_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << (mode? "value log" : "inline") << ": " << nr_ops / put_seconds << " puts/s, "
+                  << nr_ops / get_seconds << " gets/s, " << found << " found" << std::endl;
+        std::cout << "  compaction read " << property(store, "lsmkv.compaction.bytes.read") / MB << " MB, written "
+                  << property(store, "lsmkv.compaction.bytes.written") / MB << " MB; value log written "
+                  << property(store, "lsmkv.blob.bytes.written") / MB << " MB, relocated by gc "
+                  << property(store, "lsmkv.blob.gc.bytes.relocated") / MB << " MB, "
+                  << property(store, "lsmkv.blob.files.deleted") << " files deleted" << std::endl;
+        std::cout << store.compaction_stats() << std::endl;
+    }
+    return 0;
+}
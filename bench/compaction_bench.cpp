@@ -0,0 +1,42 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <random>
+
+#include "kvstore.h"
+#include "utils.h"
+#include "bench_util.h"
+
+/*
+ * Write amplification of the compaction styles. The same random overwrite
+ * workload is loaded with leveled and with tiered compaction, then the
+ * per-level compaction report of each store is printed.
+ */
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_ops = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 100000;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 1024;
+    uint64_t key_space = (argc > 4)? std::strtoull(argv[4], nullptr, 10) : 50000;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [ops] [value_size] [key_space]" << std::endl;
+    std::cout << "  " << nr_ops << " puts of " << value_size << " bytes over " << key_space
+              << " keys under " << dir << std::endl;
+
+    for (int mode = 0; mode < 2; ++mode)
+    {
+        std::string path = dir + (mode? "/tiered" : "/leveled");
+        utils::mkdir(path.c_str());
+        Options options;
+        options.compaction_style = mode? COMPACTION_TIERED : COMPACTION_LEVELED;
+        KVStore store(path, options);
+        store.reset();
+        std::mt19937_64 rng(BENCH_SEED);
+        double seconds = load_random(store, rng, nr_ops, value_size, key_space);
+        report_load(mode? "tiered" : "leveled", nr_ops, value_size, seconds);
+        std::cout << store.compaction_stats() << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,415 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <list>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+
+#include "kvstore.h"
+#include "perf.h"
+#include "utils.h"
+
+/*
+ * db_bench style driver: the benchmarks listed in --benchmarks run one after
+ * another against the same store, each on --threads threads, and report
+ * ops/s and latency percentiles. The store is not thread-safe, so the threads
+ * share it under one lock; more threads measure the engine under contention,
+ * not a parallel speedup. Keys are the engine's 64-bit integers in [0, num).
+ */
+
+struct Flags
+{
+    std::string benchmarks;
+    std::string db;
+    uint64_t num;                   // keys of the fills and the key space of every benchmark
+    uint64_t reads;                 // operations of the read benchmarks, num when 0
+    uint64_t value_size;
+    uint64_t value_size_max;        // values are uniform in [value_size, value_size_max] when it is larger
+    uint64_t scan_length;           // keys of a scanrandom or readseq scan
+    int threads;
+    bool use_existing_db;
+    bool stats;                     // print the engine statistics and compaction report after each benchmark
+    int perf_level;                 // PerfLevel of the measured threads, their perf context is printed when above 0
+    std::string op_trace_file;      // record the operations there for bench/replay
+    uint64_t seed;
+    Options options;
+    Flags():
+        benchmarks("fillseq,fillrandom,overwrite,readrandom,readseq,seekrandom,scanrandom,deleterandom,readwhilewriting"),
+        db("./bench_data/db_bench"), num(100000), reads(0), value_size(100), value_size_max(0), scan_length(100),
+        threads(1), use_existing_db(false), stats(false), perf_level(0), seed(2023)
+    {
+
+    }
+};
+
+// what one thread measured, merged into one when the benchmark ends
+struct Stats
+{
+    uint64_t ops;
+    uint64_t items;                 // keys written, found or returned by scans
+    uint64_t bytes;
+    std::vector<double> latencies;  // microseconds of every operation
+    std::vector<std::string> perf;  // the perf context of each thread
+    Stats(): ops(0), items(0), bytes(0) {}
+    void Merge(const Stats &other)
+    {
+        ops += other.ops;
+        items += other.items;
+        bytes += other.bytes;
+        latencies.insert(latencies.end(), other.latencies.begin(), other.latencies.end());
+        perf.insert(perf.end(), other.perf.begin(), other.perf.end());
+    }
+};
+
+struct Shared
+{
+    const Flags &flags;
+    KVStore &store;
+    std::mutex mutex;               // every store call goes through it
+    std::string value_pool;         // values are slices of it
+    std::atomic<bool> done;         // readers are finished, the writer of readwhilewriting stops
+    Shared(const Flags &flags, KVStore &store): flags(flags), store(store), done(false) {}
+};
+
+typedef void (*method_t)(Shared &shared, std::mt19937_64 &rng, uint64_t i, Stats &stats);
+
+static std::string make_value(Shared &shared, std::mt19937_64 &rng)
+{
+    uint64_t size = shared.flags.value_size;
+    if (shared.flags.value_size_max > size)
+    {
+        size += rng() % (shared.flags.value_size_max - size + 1);
+    }
+    return shared.value_pool.substr(rng() % (shared.value_pool.size() - size + 1), size);
+}
+
+static void put(Shared &shared, std::mt19937_64 &rng, uint64_t key, Stats &stats)
+{
+    std::string value = make_value(shared, rng);
+    stats.bytes += sizeof(key) + value.size();
+    ++stats.items;
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.store.put(key, std::move(value));
+}
+
+static void fill_seq(Shared &shared, std::mt19937_64 &rng, uint64_t i, Stats &stats)
+{
+    put(shared, rng, i, stats);
+}
+
+static void fill_random(Shared &shared, std::mt19937_64 &rng, uint64_t /*i*/, Stats &stats)
+{
+    put(shared, rng, rng() % shared.flags.num, stats);
+}
+
+static void read_random(Shared &shared, std::mt19937_64 &rng, uint64_t /*i*/, Stats &stats)
+{
+    std::string value;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        value = shared.store.get(rng() % shared.flags.num);
+    }
+    stats.items += !value.empty();
+    stats.bytes += value.size();
+}
+
+static void scan(Shared &shared, uint64_t key1, uint64_t key2, bool first_only, Stats &stats)
+{
+    std::list<std::pair<uint64_t, std::string>> list;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.store.scan(key1, key2, list);
+    }
+    for (std::list<std::pair<uint64_t, std::string>>::const_iterator it = list.begin(); it != list.end(); ++it)
+    {
+        ++stats.items;
+        stats.bytes += sizeof(it->first) + it->second.size();
+        if (first_only)
+        {
+            break;
+        }
+    }
+}
+
+// there is no iterator, the key space is read a scan of scan_length keys at a time
+static void read_seq(Shared &shared, std::mt19937_64 &/*rng*/, uint64_t i, Stats &stats)
+{
+    scan(shared, i * shared.flags.scan_length, (i + 1) * shared.flags.scan_length - 1, false, stats);
+}
+
+// a seek is a scan of a small window that keeps its first key
+static void seek_random(Shared &shared, std::mt19937_64 &rng, uint64_t /*i*/, Stats &stats)
+{
+    uint64_t key = rng() % shared.flags.num;
+    scan(shared, key, key + 15, true, stats);
+}
+
+static void scan_random(Shared &shared, std::mt19937_64 &rng, uint64_t /*i*/, Stats &stats)
+{
+    uint64_t key = rng() % shared.flags.num;
+    scan(shared, key, key + shared.flags.scan_length - 1, false, stats);
+}
+
+static void delete_random(Shared &shared, std::mt19937_64 &rng, uint64_t /*i*/, Stats &stats)
+{
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        found = shared.store.del(rng() % shared.flags.num);
+    }
+    stats.items += found;
+}
+
+// operations [begin, end) of one thread, each timed on its own
+static void run_thread(Shared &shared, method_t method, uint64_t begin, uint64_t end, uint64_t seed, Stats &stats)
+{
+    std::mt19937_64 rng(seed);
+    stats.latencies.reserve(end - begin);
+    SetPerfLevel((PerfLevel)shared.flags.perf_level);
+    GetPerfContext()->Reset();
+    for (uint64_t i = begin; i < end; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        method(shared, rng, i, stats);
+        auto finish = std::chrono::steady_clock::now();
+        stats.latencies.push_back(std::chrono::duration<double, std::micro>(finish - start).count());
+        ++stats.ops;
+    }
+    if (shared.flags.perf_level != PERF_DISABLE)
+    {
+        stats.perf.push_back(GetPerfContext()->ToString());
+    }
+}
+
+// puts random keys until the readers are done, it is not measured
+static void run_writer(Shared &shared, uint64_t seed, uint64_t &writes)
+{
+    std::mt19937_64 rng(seed);
+    Stats stats;
+    while (!shared.done.load())
+    {
+        fill_random(shared, rng, 0, stats);
+    }
+    writes = stats.items;
+}
+
+static double percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    return sorted[(size_t)(p * (sorted.size() - 1))];
+}
+
+static void report(const std::string &name, Stats &stats, double seconds, const std::string &extra)
+{
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    std::ostringstream line;
+    line << std::left << std::setw(16) << name << ": " << std::right << std::fixed << std::setprecision(3)
+         << std::setw(10) << seconds * 1e6 / std::max<uint64_t>(stats.ops, 1) << " micros/op "
+         << std::setprecision(0) << std::setw(9) << stats.ops / seconds << " ops/sec; "
+         << std::setprecision(1) << std::setw(7) << stats.bytes / seconds / 1024 / 1024 << " MB/s; "
+         << std::setprecision(2) << "p50 " << percentile(stats.latencies, 0.5)
+         << " p99 " << percentile(stats.latencies, 0.99)
+         << " p999 " << percentile(stats.latencies, 0.999) << " us; " << stats.items << " items" << extra;
+    std::cout << line.str() << std::endl;
+}
+
+static void run_benchmark(Shared &shared, const std::string &name)
+{
+    const Flags &flags = shared.flags;
+    uint64_t reads = flags.reads? flags.reads : flags.num;
+    method_t method = nullptr;
+    uint64_t ops = reads;
+    bool fresh = false;
+    bool writer = false;
+    if (name == "fillseq" || name == "fillrandom")
+    {
+        method = (name == "fillseq")? fill_seq : fill_random;
+        ops = flags.num;
+        fresh = true;
+    }
+    else if (name == "overwrite")
+    {
+        method = fill_random;
+        ops = flags.num;
+    }
+    else if (name == "readrandom" || name == "readwhilewriting")
+    {
+        method = read_random;
+        writer = (name == "readwhilewriting");
+    }
+    else if (name == "readseq")
+    {
+        method = read_seq;
+        ops = (flags.num + flags.scan_length - 1) / flags.scan_length;
+    }
+    else if (name == "seekrandom")
+    {
+        method = seek_random;
+    }
+    else if (name == "scanrandom")
+    {
+        method = scan_random;
+    }
+    else if (name == "deleterandom")
+    {
+        method = delete_random;
+        ops = flags.num;
+    }
+    else
+    {
+        std::cout << "unknown benchmark " << name << std::endl;
+        return;
+    }
+    if (fresh)
+    {
+        shared.store.reset();
+    }
+
+    shared.done = false;
+    std::vector<Stats> stats(flags.threads);
+    std::vector<std::thread> threads;
+    uint64_t writes = 0;
+    std::thread writer_thread;
+    auto start = std::chrono::steady_clock::now();
+    if (writer)
+    {
+        writer_thread = std::thread(run_writer, std::ref(shared), flags.seed + flags.threads, std::ref(writes));
+    }
+    uint64_t per_thread = (ops + flags.threads - 1) / flags.threads;
+    for (int t = 0; t < flags.threads; ++t)
+    {
+        uint64_t begin = std::min(ops, t * per_thread);
+        uint64_t end = std::min(ops, begin + per_thread);
+        threads.emplace_back(run_thread, std::ref(shared), method, begin, end, flags.seed + t, std::ref(stats[t]));
+    }
+    for (std::vector<std::thread>::iterator thread_it = threads.begin(); thread_it != threads.end(); ++thread_it)
+    {
+        thread_it->join();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    shared.done = true;
+    if (writer)
+    {
+        writer_thread.join();
+    }
+
+    Stats total;
+    for (std::vector<Stats>::const_iterator stats_it = stats.begin(); stats_it != stats.end(); ++stats_it)
+    {
+        total.Merge(*stats_it);
+    }
+    double seconds = std::chrono::duration<double>(finish - start).count();
+    std::string extra = writer? "; " + std::to_string(writes) + " writes" : "";
+    report(name, total, seconds, extra);
+    for (size_t t = 0; t < total.perf.size(); ++t)
+    {
+        std::cout << "perf context of thread " << t << ": " << total.perf[t] << std::endl;
+    }
+    if (flags.stats)
+    {
+        std::cout << shared.store.stats() << std::endl;
+    }
+}
+
+static bool parse_flag(const std::string &arg, const std::string &name, std::string &value)
+{
+    std::string prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    Flags flags;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::string value;
+        if (parse_flag(arg, "benchmarks", value)) flags.benchmarks = value;
+        else if (parse_flag(arg, "db", value)) flags.db = value;
+        else if (parse_flag(arg, "num", value)) flags.num = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "reads", value)) flags.reads = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "value_size", value)) flags.value_size = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "value_size_max", value)) flags.value_size_max = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "scan_length", value)) flags.scan_length = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "threads", value)) flags.threads = std::atoi(value.c_str());
+        else if (parse_flag(arg, "use_existing_db", value)) flags.use_existing_db = std::atoi(value.c_str());
+        else if (parse_flag(arg, "stats", value)) flags.stats = std::atoi(value.c_str());
+        else if (parse_flag(arg, "perf_level", value)) flags.perf_level = std::atoi(value.c_str());
+        else if (parse_flag(arg, "stage_timing", value)) flags.options.stage_timing_histograms = std::atoi(value.c_str());
+        else if (parse_flag(arg, "trace_file", value)) flags.options.trace_path = value;
+        else if (parse_flag(arg, "op_trace_file", value)) flags.op_trace_file = value;
+        else if (parse_flag(arg, "seed", value)) flags.seed = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "write_buffer_size", value)) flags.options.write_buffer_size = std::atoi(value.c_str());
+        else if (parse_flag(arg, "max_subcompactions", value)) flags.options.max_subcompactions = std::atoi(value.c_str());
+        else if (parse_flag(arg, "min_blob_size", value)) flags.options.min_blob_size = std::strtoull(value.c_str(), nullptr, 10);
+        else if (parse_flag(arg, "blob_gc_garbage_ratio", value)) flags.options.blob_gc_garbage_ratio = std::atof(value.c_str());
+        else if (parse_flag(arg, "compaction_style", value))
+            flags.options.compaction_style = (value == "tiered")? COMPACTION_TIERED : COMPACTION_LEVELED;
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--benchmarks=fillseq,fillrandom,overwrite,readrandom,readseq,"
+                      << "seekrandom,scanrandom,deleterandom,readwhilewriting] [--db=dir] [--num=n] [--reads=n] "
+                      << "[--value_size=n] [--value_size_max=n] [--scan_length=n] [--threads=n] "
+                      << "[--use_existing_db=0|1] [--stats=0|1] [--perf_level=0|1|2] [--stage_timing=0|1] [--trace_file=path] [--op_trace_file=path] "
+                      << "[--seed=n] [--write_buffer_size=n] "
+                      << "[--max_subcompactions=n] [--compaction_style=leveled|tiered] "
+                      << "[--min_blob_size=n] [--blob_gc_garbage_ratio=x]" << std::endl;
+            return 1;
+        }
+    }
+    flags.threads = std::max(flags.threads, 1);
+    flags.scan_length = std::max<uint64_t>(flags.scan_length, 1);
+    flags.value_size_max = std::max(flags.value_size_max, flags.value_size);
+
+    std::cout << "Keys: 8 bytes, values: " << flags.value_size;
+    if (flags.value_size_max > flags.value_size)
+    {
+        std::cout << "-" << flags.value_size_max;
+    }
+    std::cout << " bytes, entries: " << flags.num << ", threads: " << flags.threads << ", db: " << flags.db << std::endl;
+
+    utils::mkdir(flags.db.c_str());
+    KVStore store(flags.db, flags.options);
+    if (!flags.use_existing_db)
+    {
+        store.reset();
+    }
+    if (!flags.op_trace_file.empty() && !store.start_trace(flags.op_trace_file))
+    {
+        return 1;
+    }
+    Shared shared(flags, store);
+    std::mt19937_64 rng(flags.seed);
+    shared.value_pool.resize(1024 * 1024 + flags.value_size_max);
+    for (std::string::iterator it = shared.value_pool.begin(); it != shared.value_pool.end(); ++it)
+    {
+        *it = 'a' + rng() % 26;
+    }
+
+    std::stringstream benchmarks(flags.benchmarks);
+    std::string name;
+    while (std::getline(benchmarks, name, ','))
+    {
+        if (!name.empty())
+        {
+            run_benchmark(shared, name);
+        }
+    }
+    return 0;
+}
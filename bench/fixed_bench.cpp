@@ -0,0 +1,130 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <random>
+#include <new>
+#include <chrono>
+
+#include "memory.h"
+#include "utils.h"
+
+/*
+ * Fixed-width values. A table of counters, 8 byte keys and 8 byte values,
+ * is loaded and then incremented at random (a get and a put each) once as
+ * Memory<uint64_t, uint64_t> and once as Memory<uint64_t, std::string>
+ * holding the same 8 bytes; the heap allocations and throughput of each,
+ * and the table bytes the load left, are printed.
+ */
+
+static uint64_t nr_allocs = 0;
+
+void* operator new(std::size_t size)
+{
+    ++nr_allocs;
+    void* ptr = std::malloc(size ? size : 1);
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+static uint64_t ToCounter(uint64_t value)
+{
+    return value;
+}
+
+static uint64_t ToCounter(const std::string &value)
+{
+    uint64_t counter = 0;
+    memcpy(&counter, value.data(), (value.size() < sizeof(counter))? value.size() : sizeof(counter));
+    return counter;
+}
+
+static void FromCounter(uint64_t counter, uint64_t &value)
+{
+    value = counter;
+}
+
+static void FromCounter(uint64_t counter, std::string &value)
+{
+    value.assign((const char*)&counter, sizeof(counter));
+}
+
+template <class VALUE>
+static void run(const char *name, const std::string &path, uint64_t nr_ops, uint64_t key_space)
+{
+    utils::mkdir(path.c_str());
+    Memory<uint64_t, VALUE> store(path, Options());
+    store.Reset();
+
+    uint64_t allocs = nr_allocs;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < key_space; ++i)
+    {
+        VALUE value;
+        FromCounter(0, value);
+        store.Put(i, std::move(value));
+    }
+    auto end = std::chrono::steady_clock::now();
+    double load_seconds = std::chrono::duration<double>(end - start).count();
+    double load_allocs = (double)(nr_allocs - allocs) / key_space;
+    // keys are loaded in order, so each counter is in exactly one table here
+    std::string table_bytes;
+    store.GetProperty("lsmkv.total-sst-files-size", &table_bytes);
+
+    std::mt19937_64 rng(1);
+    uint64_t missing = 0;
+    allocs = nr_allocs;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < nr_ops; ++i)
+    {
+        uint64_t key = rng() % key_space;
+        VALUE value;
+        if (!store.Get(key, &value))
+        {
+            ++missing;
+        }
+        FromCounter(ToCounter(value) + 1, value);
+        store.Put(key, std::move(value));
+    }
+    end = std::chrono::steady_clock::now();
+    double update_seconds = std::chrono::duration<double>(end - start).count();
+    double update_allocs = (double)(nr_allocs - allocs) / nr_ops;
+
+    std::cout << name << ": "
+              << key_space / load_seconds << " puts/s, " << load_allocs << " allocs/put, "
+              << table_bytes << " table bytes after the load; "
+              << nr_ops / update_seconds << " increments/s, " << update_allocs << " allocs/increment";
+    if (missing != 0)
+    {
+        std::cout << ", " << missing << " counters missing";
+    }
+    std::cout << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_ops = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 1000000;
+    uint64_t key_space = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 1000000;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [ops] [key_space]" << std::endl;
+    std::cout << "  " << key_space << " counters loaded, then " << nr_ops << " increments, under " << dir << std::endl;
+
+    run<uint64_t>("Memory<uint64_t, uint64_t>", dir + "/fixed", nr_ops, key_space);
+    run<std::string>("Memory<uint64_t, std::string>", dir + "/string", nr_ops, key_space);
+    return 0;
+}
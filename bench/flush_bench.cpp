@@ -0,0 +1,63 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "skiplist.h"
+#include "sstable.h"
+#include "utils.h"
+
+/*
+ * Flush throughput of the table writer: one memtable's worth of entries
+ * is written out again and again, through the page cache and with O_DIRECT
+ * (which falls back to buffered writes where the file system refuses it).
+ */
+
+static double run(const SSTable<uint64_t, std::string> &sstable, const std::string &dir, int tables, bool direct)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < tables; ++i)
+    {
+        sstable.SSTableOut(dir, "." + std::to_string(i), direct);
+    }
+    auto end = std::chrono::steady_clock::now();
+    std::vector<std::string> files;
+    utils::scanDir(dir, files);
+    for (std::vector<std::string>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        utils::rmfile((dir + "/" + *file_it).c_str());
+    }
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    int tables = (argc > 2)? std::atoi(argv[2]) : 100;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 1024;
+    uint64_t table_size = (argc > 4)? std::strtoull(argv[4], nullptr, 10) : 2 * 1024 * 1024;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [tables] [value_size] [table_size]" << std::endl;
+    dir += "/flush";
+    utils::mkdir(dir.c_str());
+
+    SkipList<uint64_t, std::string> list;
+    uint64_t bytes = 0;
+    for (uint64_t key = 0; bytes + value_size < table_size; ++key)
+    {
+        list.Insert(key, std::string(value_size, 'a' + key % 26), TYPE_VALUE, key + 1);
+        bytes += SSTable<uint64_t, std::string>::IndexEntrySize(key) + value_size;
+    }
+    SSTable<uint64_t, std::string> sstable(list, {}, 10240);
+    double file_mb = sstable.FileSize() / 1024.0 / 1024.0;
+    std::cout << "  " << tables << " tables of " << sstable.header().length_ << " entries, "
+              << file_mb << " MB each" << std::endl;
+
+    double buffered = run(sstable, dir, tables, false);
+    std::cout << "buffered: " << tables / buffered << " tables/s, " << tables * file_mb / buffered << " MB/s" << std::endl;
+    double direct = run(sstable, dir, tables, true);
+    std::cout << "direct:   " << tables / direct << " tables/s, " << tables * file_mb / direct << " MB/s" << std::endl;
+    return 0;
+}
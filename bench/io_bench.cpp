@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "iobackend.h"
+#include "utils.h"
+
+/*
+ * Random 4 KB reads of one file at growing queue depths, through io_uring and
+ * the thread pool. The file is opened with O_DIRECT where the file system
+ * allows it, otherwise the page cache serves most reads after the first pass.
+ */
+
+static const size_t BLOCK_SIZE = 4096;
+
+static double run(IOBackendType type, int depth, int fd, uint64_t blocks, uint64_t nr_reads, std::string &name)
+{
+    std::unique_ptr<IOBackend> io = IOBackend::Create(type, depth);
+    name = io->Name();
+    std::vector<IOBackend::Request> requests(depth);
+    char* buffers = nullptr;
+    if (posix_memalign((void**)&buffers, BLOCK_SIZE, BLOCK_SIZE * depth) != 0)
+    {
+        return 0;
+    }
+    std::mt19937_64 rng(depth);
+    auto start = std::chrono::steady_clock::now();
+    uint64_t submitted = 0;
+    for (int i = 0; i < depth && submitted < nr_reads; ++i, ++submitted)
+    {
+        requests[i] = IOBackend::Request{fd, rng() % blocks * BLOCK_SIZE, BLOCK_SIZE, buffers + i * BLOCK_SIZE, 0, false};
+        io->Submit(&requests[i]);
+    }
+    for (uint64_t done = 0; done < nr_reads; ++done)
+    {
+        IOBackend::Request &request = requests[done % depth];
+        io->Wait(&request);
+        if (submitted < nr_reads)
+        {
+            request.offset_ = rng() % blocks * BLOCK_SIZE;
+            io->Submit(&request);
+            ++submitted;
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+    free(buffers);
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t file_mb = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 256;
+    uint64_t nr_reads = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 20000;
+    int max_depth = (argc > 4)? std::atoi(argv[4]) : 64;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [file_mb] [reads] [max_depth]" << std::endl;
+    utils::mkdir(dir.c_str());
+    std::string path = dir + "/io_bench.dat";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    std::vector<char> chunk(1024 * 1024, 'x');
+    for (uint64_t i = 0; i < file_mb; ++i)
+    {
+        if (write(fd, chunk.data(), chunk.size()) != (ssize_t)chunk.size())
+        {
+            std::cerr << "Failed to write " << path << std::endl;
+            return 1;
+        }
+    }
+    fsync(fd);
+    close(fd);
+
+    bool direct = true;
+#ifdef O_DIRECT
+    fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+#else
+    fd = -1;
+#endif
+    if (fd == -1)
+    {
+        direct = false;
+        fd = open(path.c_str(), O_RDONLY);
+    }
+    std::cout << "  " << nr_reads << " random 4 KB reads of a " << file_mb << " MB file"
+              << (direct? " with O_DIRECT" : " through the page cache") << std::endl;
+
+    uint64_t blocks = file_mb * 1024 * 1024 / BLOCK_SIZE;
+    IOBackendType types[] = {IO_URING, IO_THREAD_POOL};
+    for (IOBackendType type : types)
+    {
+        for (int depth = 1; depth <= max_depth; depth *= 2)
+        {
+            std::string name;
+            double seconds = run(type, depth, fd, blocks, nr_reads, name);
+            std::cout << name << " depth " << depth << ": " << nr_reads / seconds << " reads/s, "
+                      << nr_reads * BLOCK_SIZE / seconds / 1024 / 1024 << " MB/s" << std::endl;
+        }
+    }
+    close(fd);
+    utils::rmfile(path.c_str());
+    return 0;
+}
@@ -0,0 +1,286 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <memory>
+#include <benchmark/benchmark.h>
+
+#include "memory.h"
+#include "utils.h"
+
+/*
+ * Google Benchmark microbenchmarks of the engine components: the memtable,
+ * the bloom filter, index lookups, the merge of scans and compactions, and
+ * writing and reading a table. Results go to the console and, unless
+ * --benchmark_out is given, to micro_bench.json, which the compare.py of
+ * Google Benchmark diffs between two commits.
+ */
+
+static const std::string DATA_DIR = "./micro_bench_data";
+
+// reaches the private helpers of Memory, which befriends it
+class MemoryBench
+{
+public:
+    typedef Memory<uint64_t, std::string> memory_t;
+    typedef memory_t::SmallSSTable table_t;
+    typedef memory_t::item_index_t item_t;
+    typedef std::vector<std::pair<uint64_t, item_t>> tape_t;
+    static memory_t& Instance()
+    {
+        static memory_t memory(DATA_DIR + "/memory");
+        return memory;
+    }
+    static bool FindKey(uint64_t key, const table_t* table, uint32_t &offset)
+    {
+        return Instance().FindKey(key, UINT64_MAX, table, offset);
+    }
+    static void MergeSort(const tape_t &tape1, const tape_t &tape2, tape_t &target)
+    {
+        Instance().MergeSort(tape1.begin(), tape1.end(), tape2.begin(), tape2.end(), target);
+    }
+    static void Merge(std::vector<tape_t> &tapes, tape_t &result)
+    {
+        Instance().Merge(tapes, result);
+    }
+};
+
+static std::vector<uint64_t> random_keys(size_t count, uint64_t seed = 2023)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<uint64_t> keys(count);
+    for (std::vector<uint64_t>::iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+    {
+        *key_it = rng();
+    }
+    return keys;
+}
+
+// sorted entries with one version each, the way a flush lays them out
+static std::vector<SSTable<uint64_t, std::string>::entry_t> make_entries(size_t count, size_t value_size)
+{
+    std::vector<uint64_t> keys = random_keys(count);
+    std::sort(keys.begin(), keys.end());
+    std::vector<SSTable<uint64_t, std::string>::entry_t> entries;
+    entries.reserve(count);
+    uint64_t seq = 1;
+    for (std::vector<uint64_t>::const_iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+    {
+        entries.emplace_back(*key_it, std::string(value_size, 'a' + *key_it % 26), TYPE_VALUE, seq++);
+    }
+    return entries;
+}
+
+// a tape of sorted keys as one table contributes it to a scan or a compaction
+static MemoryBench::tape_t make_tape(size_t count, uint64_t seed, int file)
+{
+    std::vector<uint64_t> keys = random_keys(count, seed);
+    std::sort(keys.begin(), keys.end());
+    MemoryBench::tape_t tape;
+    tape.reserve(count);
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        MemoryBench::item_t item{{0, (uint64_t)file, count, keys.back(), keys.front()}, (uint32_t)i, TYPE_VALUE, seed};
+        tape.push_back({keys[i], item});
+    }
+    return tape;
+}
+
+static void BM_SkipListInsert(benchmark::State &state)
+{
+    std::vector<uint64_t> keys = random_keys(state.range(0));
+    for (auto _ : state)
+    {
+        SkipList<uint64_t, std::string> list;
+        for (std::vector<uint64_t>::const_iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+        {
+            list.Insert(*key_it, std::string(16, 'v'));
+        }
+        benchmark::DoNotOptimize(list);
+    }
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_SkipListInsert)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMillisecond);
+
+static void BM_SkipListFind(benchmark::State &state)
+{
+    std::vector<uint64_t> keys = random_keys(state.range(0));
+    SkipList<uint64_t, std::string> list;
+    for (std::vector<uint64_t>::const_iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+    {
+        list.Insert(*key_it, std::string(16, 'v'));
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(7));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        ValueType type;
+        uint64_t seq = 0;
+        benchmark::DoNotOptimize(list.Find(keys[i++ % keys.size()], type, seq));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SkipListFind)->RangeMultiplier(10)->Range(1000, 1000000);
+
+static void BM_BloomFilterInsert(benchmark::State &state)
+{
+    std::unique_ptr<BloomFilter<uint64_t>> filter(new BloomFilter<uint64_t>(state.range(0)));
+    std::vector<uint64_t> keys = random_keys(4096);
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        filter->Insert(keys[i++ % keys.size()]);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BloomFilterInsert)->Arg(1024)->Arg(10240)->Arg(65536);
+
+// as many keys as a default table holds, looked up half present and half absent
+static void BM_BloomFilterExist(benchmark::State &state)
+{
+    std::unique_ptr<BloomFilter<uint64_t>> filter(new BloomFilter<uint64_t>(state.range(0)));
+    std::vector<uint64_t> keys = random_keys(2048);
+    std::vector<uint64_t> absent = random_keys(2048, 7);
+    for (std::vector<uint64_t>::const_iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+    {
+        filter->Insert(*key_it);
+    }
+    size_t i = 0;
+    uint64_t false_positives = 0;
+    for (auto _ : state)
+    {
+        bool present = (i % 2 == 0);
+        const uint64_t &key = present? keys[i / 2 % keys.size()] : absent[i / 2 % absent.size()];
+        bool exist = filter->Exist(key);
+        false_positives += (!present && exist);
+        benchmark::DoNotOptimize(exist);
+        ++i;
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["false_positive_rate"] = (double)false_positives / std::max<uint64_t>(i / 2, 1);
+}
+BENCHMARK(BM_BloomFilterExist)->Arg(1024)->Arg(10240)->Arg(65536);
+
+static void BM_FindKey(benchmark::State &state)
+{
+    SSTable<uint64_t, std::string> sstable(make_entries(state.range(0), 8), {}, 10240);
+    MemoryBench::table_t table(sstable);
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < table.index_.size(); ++i)
+    {
+        keys.push_back(table.index_[i].key_);
+    }
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(7));
+    size_t i = 0;
+    for (auto _ : state)
+    {
+        uint32_t offset = 0;
+        benchmark::DoNotOptimize(MemoryBench::FindKey(keys[i++ % keys.size()], &table, offset));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindKey)->RangeMultiplier(8)->Range(64, 32768);
+
+static void BM_MergeSort(benchmark::State &state)
+{
+    MemoryBench::tape_t tape1 = make_tape(state.range(0), 1, 1);
+    MemoryBench::tape_t tape2 = make_tape(state.range(0), 2, 2);
+    for (auto _ : state)
+    {
+        MemoryBench::tape_t target;
+        target.reserve(tape1.size() + tape2.size());
+        MemoryBench::MergeSort(tape1, tape2, target);
+        benchmark::DoNotOptimize(target.data());
+    }
+    state.SetItemsProcessed(state.iterations() * (tape1.size() + tape2.size()));
+}
+BENCHMARK(BM_MergeSort)->RangeMultiplier(8)->Range(1024, 65536);
+
+// 64k entries in total spread over 2 to 64 tapes
+static void BM_Merge(benchmark::State &state)
+{
+    int ways = state.range(0);
+    std::vector<MemoryBench::tape_t> tapes;
+    for (int way = 0; way < ways; ++way)
+    {
+        tapes.push_back(make_tape(65536 / ways, way + 1, way));
+    }
+    for (auto _ : state)
+    {
+        std::vector<MemoryBench::tape_t> input = tapes;
+        MemoryBench::tape_t result;
+        MemoryBench::Merge(input, result);
+        benchmark::DoNotOptimize(result.data());
+    }
+    state.SetItemsProcessed(state.iterations() * 65536);
+}
+BENCHMARK(BM_Merge)->RangeMultiplier(2)->Range(2, 64)->Unit(benchmark::kMicrosecond);
+
+// a table of the given entries of 1KB values, rewritten under the same name each time
+static void BM_SSTableOut(benchmark::State &state)
+{
+    std::vector<SSTable<uint64_t, std::string>::entry_t> entries = make_entries(state.range(0), 1024);
+    SSTable<uint64_t, std::string> sstable(entries, {}, 10240);
+    std::string dir = DATA_DIR + "/tables";
+    for (auto _ : state)
+    {
+        if (!sstable.SSTableOut(dir))
+        {
+            state.SkipWithError("SSTableOut failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * sstable.FileSize());
+}
+BENCHMARK(BM_SSTableOut)->Arg(256)->Arg(2048)->Arg(16384)->Unit(benchmark::kMicrosecond);
+
+static void BM_SSTableIn(benchmark::State &state)
+{
+    std::vector<SSTable<uint64_t, std::string>::entry_t> entries = make_entries(state.range(0), 1024);
+    SSTable<uint64_t, std::string> sstable(entries, {}, 10240);
+    std::string dir = DATA_DIR + "/tables/";
+    sstable.SSTableOut(dir);
+    const SSTable<uint64_t, std::string>::Head &head = sstable.header();
+    std::string filename = dir + std::to_string(head.timestamp_) + "-" + std::to_string(head.length_) + "-" +
+                           std::to_string(head.max_ele_key_) + "-" + std::to_string(head.min_ele_key_) + ".sst";
+    for (auto _ : state)
+    {
+        std::unique_ptr<SSTable<uint64_t, std::string>> table(new SSTable<uint64_t, std::string>(10240));
+        if (!table->SSTableIn(filename))
+        {
+            state.SkipWithError("SSTableIn failed");
+            break;
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+BENCHMARK(BM_SSTableIn)->Arg(256)->Arg(2048)->Arg(16384)->Unit(benchmark::kMicrosecond);
+
+// JSON is written next to the console report unless the caller chose where
+int main(int argc, char **argv)
+{
+    std::vector<char*> args(argv, argv + argc);
+    std::string out = "--benchmark_out=micro_bench.json";
+    std::string format = "--benchmark_out_format=json";
+    bool has_out = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        has_out = has_out || std::string(argv[i]).compare(0, 15, "--benchmark_out") == 0;
+    }
+    if (!has_out)
+    {
+        args.push_back(&out[0]);
+        args.push_back(&format[0]);
+    }
+    int count = args.size();
+    utils::mkdir((DATA_DIR + "/memory").c_str());
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <list>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <algorithm>
+
+#include "kvstore.h"
+#include "histogram.h"
+#include "trace.h"
+#include "utils.h"
+
+/*
+ * Replays a trace taken with KVStore::start_trace against a store, by
+ * default a fresh one, at the pace it was recorded or --speed times
+ * faster (0 for as fast as the store goes), and reports the throughput
+ * and the latency of each kind of operation. A put writes a value of the
+ * recorded size. When the store falls behind the trace, operations start
+ * late rather than being skipped; how late is reported as the lag.
+ */
+
+struct Flags
+{
+    std::string trace;
+    std::string db;
+    double speed;
+    bool use_existing_db;
+    Flags(): db("./bench_data/replay"), speed(1), use_existing_db(false) {}
+};
+
+static bool parse_flag(const std::string &arg, const std::string &name, std::string &value)
+{
+    std::string prefix = "--" + name + "=";
+    if (arg.compare(0, prefix.size(), prefix) != 0)
+    {
+        return false;
+    }
+    value = arg.substr(prefix.size());
+    return true;
+}
+
+static void report(const std::string &name, const Histogram &latencies)
+{
+    std::cout << std::left << std::setw(13) << name << std::right << ": " << std::setw(9) << latencies.Count()
+              << " ops; " << std::fixed << std::setprecision(2) << "avg " << latencies.Mean() / 1000
+              << " p50 " << latencies.Percentile(50) / 1000.0 << " p99 " << latencies.Percentile(99) / 1000.0
+              << " p999 " << latencies.Percentile(99.9) / 1000.0 << " max " << latencies.Max() / 1000.0
+              << " us" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Flags flags;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        std::string value;
+        if (parse_flag(arg, "trace", value)) flags.trace = value;
+        else if (parse_flag(arg, "db", value)) flags.db = value;
+        else if (parse_flag(arg, "speed", value)) flags.speed = std::atof(value.c_str());
+        else if (parse_flag(arg, "use_existing_db", value)) flags.use_existing_db = std::atoi(value.c_str());
+        else
+        {
+            flags.trace.clear();
+            break;
+        }
+    }
+    if (flags.trace.empty() || flags.speed < 0)
+    {
+        std::cout << "Usage: " << argv[0] << " --trace=file [--db=dir] [--speed=x, 0 for no pacing] "
+                  << "[--use_existing_db=0|1]" << std::endl;
+        return 1;
+    }
+    std::unique_ptr<TraceReader> reader = TraceReader::Open(flags.trace);
+    if (reader == nullptr)
+    {
+        return 1;
+    }
+
+    utils::mkdir(flags.db.c_str());
+    KVStore store(flags.db);
+    if (!flags.use_existing_db)
+    {
+        store.reset();
+    }
+    std::string value_pool;
+    Histogram latencies[TRACE_SCAN + 1];
+    Histogram all;
+    uint64_t late = 0;              // operations started over a millisecond behind the trace
+    uint64_t max_lag_micros = 0;
+    uint64_t found = 0;
+    uint64_t trace_micros = 0;
+    TraceRecord record;
+    auto start = std::chrono::steady_clock::now();
+    while (reader->Next(record))
+    {
+        trace_micros = record.micros_;
+        auto now = std::chrono::steady_clock::now();
+        if (flags.speed > 0)
+        {
+            auto due = start + std::chrono::microseconds((uint64_t)(record.micros_ / flags.speed));
+            if (due > now)
+            {
+                std::this_thread::sleep_until(due);
+                now = std::chrono::steady_clock::now();
+            }
+            uint64_t lag = std::chrono::duration_cast<std::chrono::microseconds>(now - due).count();
+            late += (lag > 1000);
+            max_lag_micros = std::max(max_lag_micros, lag);
+        }
+        if (record.type_ == TRACE_PUT && value_pool.size() < record.arg_)
+        {
+            value_pool.resize(record.arg_, 'v');
+        }
+        std::list<std::pair<uint64_t, std::string>> list;
+        auto op_start = std::chrono::steady_clock::now();
+        if (record.type_ == TRACE_PUT)
+        {
+            store.put(record.key_, value_pool.substr(0, record.arg_));
+        }
+        else if (record.type_ == TRACE_GET)
+        {
+            found += !store.get(record.key_).empty();
+        }
+        else if (record.type_ == TRACE_DELETE)
+        {
+            store.del(record.key_);
+        }
+        else if (record.type_ == TRACE_DELETE_RANGE)
+        {
+            store.delete_range(record.key_, record.arg_);
+        }
+        else
+        {
+            store.scan(record.key_, record.arg_, list);
+        }
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - op_start).count();
+        latencies[record.type_].Record(nanos);
+        all.Record(nanos);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Replayed " << all.Count() << " operations of a " << std::fixed << std::setprecision(2)
+              << trace_micros / 1e6 << "s trace in " << seconds << "s, "
+              << std::setprecision(0) << all.Count() / seconds << " ops/sec" << std::endl;
+    for (int type = TRACE_PUT; type <= TRACE_SCAN; ++type)
+    {
+        if (latencies[type].Count() != 0)
+        {
+            report(TraceReader::Name((TraceType)type), latencies[type]);
+        }
+    }
+    report("ALL", all);
+    std::cout << found << " of " << latencies[TRACE_GET].Count() << " gets found" << std::endl;
+    if (flags.speed > 0)
+    {
+        std::cout << late << " operations started over 1ms late, the largest lag was "
+                  << std::setprecision(2) << max_lag_micros / 1000.0 << "ms" << std::endl;
+    }
+    return 0;
+}
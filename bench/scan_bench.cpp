@@ -0,0 +1,105 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <list>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "kvstore.h"
+#include "utils.h"
+
+/*
+ * Paginated range export: the whole key space is scanned a page at a time,
+ * first without readahead and then with it. The tables are dropped from
+ * the page cache before each pass so that both start cold.
+ */
+
+static std::string make_value(uint64_t key, uint64_t value_size)
+{
+    std::string value = std::to_string(key);
+    value.resize(value_size, 'a' + key % 26);
+    return value;
+}
+
+static void evict(const std::string &dir)
+{
+    std::vector<std::string> entries;
+    utils::scanDir(dir, entries);
+    for (std::vector<std::string>::const_iterator entry_it = entries.begin(); entry_it != entries.end(); ++entry_it)
+    {
+        std::string path = dir + "/" + *entry_it;
+        if (utils::dirExists(path))
+        {
+            evict(path);
+            continue;
+        }
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd != -1)
+        {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+            close(fd);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_keys = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 200000;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 1024;
+    uint64_t page = (argc > 4)? std::strtoull(argv[4], nullptr, 10) : 100;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [keys] [value_size] [page]" << std::endl;
+    std::string path = dir + "/scan";
+    utils::mkdir(path.c_str());
+    {
+        KVStore store(path);
+        store.reset();
+        std::vector<uint64_t> keys(nr_keys);
+        for (uint64_t i = 0; i < nr_keys; ++i)
+        {
+            keys[i] = i;
+        }
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(2023));
+        for (std::vector<uint64_t>::const_iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+        {
+            store.put(*key_it, make_value(*key_it, value_size));
+        }
+    }
+    std::cout << "  " << nr_keys << " keys of " << value_size << " bytes exported " << page << " at a time" << std::endl;
+
+    uint64_t readaheads[] = {0, Options().scan_readahead_size};
+    for (uint64_t readahead : readaheads)
+    {
+        evict(path);
+        Options options;
+        options.scan_readahead_size = readahead;
+        KVStore store(path, options);
+        uint64_t bad = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t key = 0; key < nr_keys; key += page)
+        {
+            std::list<std::pair<uint64_t, std::string>> list;
+            store.scan(key, key + page - 1, list);
+            uint64_t expected = key;
+            for (std::list<std::pair<uint64_t, std::string>>::const_iterator it = list.begin(); it != list.end(); ++it)
+            {
+                bad += (it->first != expected || it->second != make_value(expected, value_size));
+                ++expected;
+            }
+            bad += (expected != std::min(key + page, nr_keys));
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - start).count();
+        std::cout << "readahead " << readahead / 1024 << " KB: " << nr_keys / page / seconds << " pages/s, "
+                  << (double)nr_keys * value_size / seconds / 1024 / 1024 << " MB/s"
+                  << (bad? ", WRONG RESULTS" : "") << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <list>
+#include <random>
+#include <algorithm>
+#include <chrono>
+
+#include "kvstore.h"
+#include "utils.h"
+
+/*
+ * Short range scans over sparse keys: the keys are random 64-bit numbers,
+ * so nearly every table overlaps any range by its bounds while only a few
+ * hold a key inside it. Scans expecting about 0.1, 1 and 10 keys are timed
+ * under leveled and tiered compaction and their latency percentiles reported.
+ */
+
+static std::string make_value(uint64_t key, uint64_t value_size)
+{
+    std::string value = std::to_string(key);
+    value.resize(value_size, 'a' + key % 26);
+    return value;
+}
+
+static double percentile(std::vector<double> &latencies, double p)
+{
+    size_t pos = (size_t)(p * (latencies.size() - 1));
+    std::nth_element(latencies.begin(), latencies.begin() + pos, latencies.end());
+    return latencies[pos];
+}
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_keys = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 200000;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 256;
+    uint64_t nr_scans = (argc > 4)? std::strtoull(argv[4], nullptr, 10) : 20000;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [keys] [value_size] [scans]" << std::endl;
+    std::cout << "  " << nr_keys << " random keys of " << value_size << " bytes, " << nr_scans << " scans per width" << std::endl;
+    std::string path = dir + "/short_scan";
+    utils::mkdir(path.c_str());
+    uint64_t gap = UINT64_MAX / nr_keys;
+
+    CompactionStyle styles[] = {COMPACTION_LEVELED, COMPACTION_TIERED};
+    for (CompactionStyle style : styles)
+    {
+        Options options;
+        options.compaction_style = style;
+        KVStore store(path, options);
+        store.reset();
+        std::vector<uint64_t> keys(nr_keys);
+        std::mt19937_64 rng(2023);
+        for (std::vector<uint64_t>::iterator key_it = keys.begin(); key_it != keys.end(); ++key_it)
+        {
+            *key_it = rng();
+            store.put(*key_it, make_value(*key_it, value_size));
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::cout << ((style == COMPACTION_LEVELED)? "leveled" : "tiered") << std::endl;
+        double widths[] = {0.1, 1, 10};
+        for (double width : widths)
+        {
+            uint64_t span = (uint64_t)(gap * width);
+            std::vector<double> latencies;
+            latencies.reserve(nr_scans);
+            uint64_t rows = 0;
+            uint64_t bad = 0;
+            for (uint64_t i = 0; i < nr_scans; ++i)
+            {
+                uint64_t key1 = rng() % (UINT64_MAX - span);
+                uint64_t key2 = key1 + span;
+                std::list<std::pair<uint64_t, std::string>> list;
+                auto start = std::chrono::steady_clock::now();
+                store.scan(key1, key2, list);
+                auto end = std::chrono::steady_clock::now();
+                latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+                rows += list.size();
+                uint64_t expected = std::upper_bound(keys.begin(), keys.end(), key2) -
+                                    std::lower_bound(keys.begin(), keys.end(), key1);
+                bad += (list.size() != expected);
+            }
+            std::cout << "  ~" << width << " keys: " << (double)rows / nr_scans << " rows, p50 "
+                      << percentile(latencies, 0.5) << " us, p99 " << percentile(latencies, 0.99) << " us"
+                      << (bad? ", WRONG RESULTS" : "") << std::endl;
+        }
+    }
+    return 0;
+}
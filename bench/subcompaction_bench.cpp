@@ -0,0 +1,45 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <random>
+#include <thread>
+
+#include "kvstore.h"
+#include "utils.h"
+#include "bench_util.h"
+
+/*
+ * Compaction throughput against the number of subcompactions. The same
+ * random overwrite workload is loaded once per thread count, the report
+ * of each store shows the time its compactions took.
+ */
+
+int main(int argc, char *argv[])
+{
+    std::string dir = (argc > 1)? argv[1] : "./bench_data";
+    uint64_t nr_ops = (argc > 2)? std::strtoull(argv[2], nullptr, 10) : 200000;
+    uint64_t value_size = (argc > 3)? std::strtoull(argv[3], nullptr, 10) : 1024;
+    int max_threads = (argc > 4)? std::atoi(argv[4]) : 8;
+
+    std::cout << "Usage: " << argv[0] << " [dir] [ops] [value_size] [max_threads]" << std::endl;
+    std::cout << "  " << nr_ops << " puts of " << value_size << " bytes under " << dir << ", "
+              << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+    {
+        std::string path = dir + "/sub" + std::to_string(threads);
+        utils::mkdir(path.c_str());
+        Options options;
+        options.max_subcompactions = threads;
+        // a large level 1 makes every compaction into level 2 worth splitting
+        options.max_bytes_for_level_base = 32 * 1024 * 1024;
+        KVStore store(path, options);
+        store.reset();
+        std::mt19937_64 rng(BENCH_SEED);
+        double seconds = load_random(store, rng, nr_ops, value_size, nr_ops / 2);
+        report_load(std::to_string(threads) + " subcompactions", nr_ops, value_size, seconds);
+        std::cout << store.compaction_stats() << std::endl;
+    }
+    return 0;
+}
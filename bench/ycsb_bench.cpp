@@ -0,0 +1,533 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+#include <set>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+
+#include "kvstore.h"
+#include "histogram.h"
+#include "utils.h"
+
+/*
+ * YCSB core workload driver. The properties are those of YCSB and its
+ * workload files load with -P; -w a..f picks one of the standard workloads.
+ * The load phase inserts recordcount records, the run phase performs
+ * operationcount operations on client threads, and both report in the
+ * format of YCSB with latencies taken from log-linear histograms.
+ *
+ * Keys are the engine's integers and records are inserted in order, so a
+ * scan of n records is the range [key, key + n - 1]. A record is one value
+ * of fieldcount * fieldlength bytes, and an update rewrites it whole. The
+ * store is not thread-safe; the clients share it under one lock.
+ */
+
+typedef std::map<std::string, std::string> properties_t;
+
+static const char* const WORKLOADS[][2] = {
+    {"a", "readproportion=0.5 updateproportion=0.5 requestdistribution=zipfian"},
+    {"b", "readproportion=0.95 updateproportion=0.05 requestdistribution=zipfian"},
+    {"c", "readproportion=1 updateproportion=0 requestdistribution=zipfian"},
+    {"d", "readproportion=0.95 updateproportion=0 insertproportion=0.05 requestdistribution=latest"},
+    {"e", "readproportion=0 updateproportion=0 scanproportion=0.95 insertproportion=0.05 requestdistribution=zipfian "
+          "maxscanlength=100 scanlengthdistribution=uniform"},
+    {"f", "readproportion=0.5 updateproportion=0 readmodifywriteproportion=0.5 requestdistribution=zipfian"},
+};
+
+static uint64_t fnv_hash64(uint64_t value)
+{
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < 8; ++i)
+    {
+        hash ^= value & 0xff;
+        hash *= 1099511628211ULL;
+        value >>= 8;
+    }
+    return hash;
+}
+
+// the generator of Gray et al., "Quickly Generating Billion-Record Synthetic Databases", as YCSB
+// uses it: item 0 is the most popular; the item count may only grow, zeta is extended when it does
+class ZipfianGenerator
+{
+private:
+    uint64_t items_;
+    double theta_;
+    double zeta2_;
+    double zetan_;
+    double alpha_;
+    double eta_;
+    static double Zeta(uint64_t from, uint64_t to, double theta, double initial)
+    {
+        double sum = initial;
+        for (uint64_t i = from; i < to; ++i)
+        {
+            sum += 1 / std::pow(i + 1, theta);
+        }
+        return sum;
+    }
+    void Resize(uint64_t items)
+    {
+        zetan_ = Zeta(items_, items, theta_, zetan_);
+        items_ = items;
+        eta_ = (1 - std::pow(2.0 / items_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+    }
+public:
+    static constexpr double ZIPFIAN_CONSTANT = 0.99;
+    explicit ZipfianGenerator(uint64_t items, double theta = ZIPFIAN_CONSTANT, double zetan = 0):
+        items_(0), theta_(theta), zeta2_(Zeta(0, 2, theta, 0)), zetan_(0), alpha_(1 / (1 - theta)), eta_(0)
+    {
+        if (zetan != 0)
+        {
+            items_ = items;
+            zetan_ = zetan;
+            eta_ = (1 - std::pow(2.0 / items_, 1 - theta_)) / (1 - zeta2_ / zetan_);
+        }
+        else
+        {
+            Resize(items);
+        }
+    }
+    uint64_t Next(std::mt19937_64 &rng, uint64_t items)
+    {
+        if (items > items_)
+        {
+            Resize(items);
+        }
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan_;
+        if (uz < 1)
+        {
+            return 0;
+        }
+        if (uz < 1 + std::pow(0.5, theta_))
+        {
+            return 1;
+        }
+        uint64_t item = items_ * std::pow(eta_ * u - eta_ + 1, alpha_);
+        return (item < items)? item : items - 1;
+    }
+};
+
+// picks the key of a read, update, scan or read-modify-write out of the records inserted so far
+class KeyChooser
+{
+private:
+    enum Distribution
+    {
+        UNIFORM,
+        ZIPFIAN,            // hot keys are the smallest ones, next to each other
+        SCRAMBLED_ZIPFIAN,  // the popularity of zipfian, hot keys hashed all over the key space
+        LATEST              // zipfian by distance from the newest record
+    };
+    Distribution distribution_;
+    uint64_t records_;
+    ZipfianGenerator zipfian_;
+    // YCSB draws scrambled keys from a fixed space of 10^10 items, its zeta is precomputed
+    static constexpr uint64_t SCRAMBLED_ITEMS_ = 10000000000ULL;
+    static constexpr double SCRAMBLED_ZETAN_ = 26.46902820178302;
+    static Distribution Parse(const std::string &name)
+    {
+        if (name == "uniform")
+        {
+            return UNIFORM;
+        }
+        if (name == "plain_zipfian")
+        {
+            return ZIPFIAN;
+        }
+        if (name == "latest")
+        {
+            return LATEST;
+        }
+        return SCRAMBLED_ZIPFIAN;       // YCSB's zipfian is the scrambled one
+    }
+public:
+    KeyChooser(const std::string &distribution, uint64_t records):
+        distribution_(Parse(distribution)), records_(std::max<uint64_t>(records, 1)),
+        zipfian_((distribution_ == SCRAMBLED_ZIPFIAN)? SCRAMBLED_ITEMS_ : std::max<uint64_t>(records, 2),
+                 ZipfianGenerator::ZIPFIAN_CONSTANT, (distribution_ == SCRAMBLED_ZIPFIAN)? SCRAMBLED_ZETAN_ : 0) {}
+    // latest is the newest key, records the loaded ones; zipfian keys stay among those
+    uint64_t Next(std::mt19937_64 &rng, uint64_t latest)
+    {
+        switch (distribution_)
+        {
+        case UNIFORM:
+            return rng() % (latest + 1);
+        case ZIPFIAN:
+            return zipfian_.Next(rng, std::max<uint64_t>(records_, 2)) % records_;
+        case SCRAMBLED_ZIPFIAN:
+            return fnv_hash64(zipfian_.Next(rng, SCRAMBLED_ITEMS_)) % records_;
+        case LATEST:
+        default:
+            return latest - zipfian_.Next(rng, std::max<uint64_t>(latest + 1, 2)) % (latest + 1);
+        }
+    }
+};
+
+enum Operation
+{
+    OP_READ,
+    OP_UPDATE,
+    OP_INSERT,
+    OP_SCAN,
+    OP_READ_MODIFY_WRITE,
+    OP_TOTAL
+};
+
+static const char* const OPERATION_NAMES[OP_TOTAL] = {"READ", "UPDATE", "INSERT", "SCAN", "READ-MODIFY-WRITE"};
+
+struct Measurements
+{
+    Histogram latency[OP_TOTAL];        // microseconds
+    uint64_t not_found[OP_TOTAL];
+    Measurements()
+    {
+        std::fill(not_found, not_found + OP_TOTAL, 0);
+    }
+    void Merge(const Measurements &other)
+    {
+        for (int op = 0; op < OP_TOTAL; ++op)
+        {
+            latency[op].Merge(other.latency[op]);
+            not_found[op] += other.not_found[op];
+        }
+    }
+};
+
+struct Workload
+{
+    uint64_t record_count;
+    uint64_t operation_count;
+    double proportions[OP_TOTAL];
+    std::string request_distribution;
+    uint64_t max_scan_length;
+    std::string scan_length_distribution;
+    uint64_t value_size;
+    explicit Workload(const properties_t &properties)
+    {
+        record_count = std::stoull(properties.at("recordcount"));
+        operation_count = std::stoull(properties.at("operationcount"));
+        proportions[OP_READ] = std::stod(properties.at("readproportion"));
+        proportions[OP_UPDATE] = std::stod(properties.at("updateproportion"));
+        proportions[OP_INSERT] = std::stod(properties.at("insertproportion"));
+        proportions[OP_SCAN] = std::stod(properties.at("scanproportion"));
+        proportions[OP_READ_MODIFY_WRITE] = std::stod(properties.at("readmodifywriteproportion"));
+        request_distribution = properties.at("requestdistribution");
+        max_scan_length = std::max<uint64_t>(std::stoull(properties.at("maxscanlength")), 1);
+        scan_length_distribution = properties.at("scanlengthdistribution");
+        value_size = std::stoull(properties.at("fieldcount")) * std::stoull(properties.at("fieldlength"));
+    }
+};
+
+struct Shared
+{
+    const Workload &workload;
+    KVStore &store;
+    std::mutex mutex;                   // every store call goes through it
+    std::atomic<uint64_t> next_insert;  // key of the next insert
+    uint64_t latest;                    // newest key with every insert up to it done, guarded by mutex
+    std::set<uint64_t> done_inserts;    // inserts done past latest, guarded by mutex
+    Shared(const Workload &workload, KVStore &store):
+        workload(workload), store(store), next_insert(workload.record_count),
+        latest(workload.record_count? workload.record_count - 1 : 0) {}
+};
+
+static std::string make_value(std::mt19937_64 &rng, uint64_t size)
+{
+    std::string value(size, 0);
+    for (std::string::iterator it = value.begin(); it != value.end(); ++it)
+    {
+        *it = 'a' + rng() % 26;
+    }
+    return value;
+}
+
+static void insert(Shared &shared, uint64_t key, std::mt19937_64 &rng)
+{
+    std::string value = make_value(rng, shared.workload.value_size);
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.store.put(key, std::move(value));
+    // like the acknowledged counter of YCSB, a read never picks a key another client is still inserting
+    shared.done_inserts.insert(key);
+    while (!shared.done_inserts.empty() && *shared.done_inserts.begin() <= shared.latest + 1)
+    {
+        shared.latest = std::max(shared.latest, *shared.done_inserts.begin());
+        shared.done_inserts.erase(shared.done_inserts.begin());
+    }
+}
+
+// one operation picked by the proportions, returns false if its record was not found
+static bool do_operation(Shared &shared, Operation op, KeyChooser &chooser, ZipfianGenerator &scan_lengths,
+                         std::mt19937_64 &rng)
+{
+    const Workload &workload = shared.workload;
+    if (op == OP_INSERT)
+    {
+        insert(shared, shared.next_insert++, rng);
+        return true;
+    }
+    uint64_t latest = 0;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        latest = shared.latest;
+    }
+    uint64_t key = chooser.Next(rng, latest);
+    if (op == OP_READ)
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        return !shared.store.get(key).empty();
+    }
+    if (op == OP_UPDATE)
+    {
+        std::string value = make_value(rng, workload.value_size);
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.store.put(key, std::move(value));
+        return true;
+    }
+    if (op == OP_SCAN)
+    {
+        uint64_t length = (workload.scan_length_distribution == "zipfian")?
+                          scan_lengths.Next(rng, workload.max_scan_length) + 1 : rng() % workload.max_scan_length + 1;
+        std::list<std::pair<uint64_t, std::string>> list;
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        shared.store.scan(key, key + length - 1, list);
+        return !list.empty();
+    }
+    std::string value;
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        value = shared.store.get(key);
+    }
+    std::string modified = make_value(rng, workload.value_size);
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.store.put(key, std::move(modified));
+    return !value.empty();
+}
+
+static void run_client(Shared &shared, uint64_t operations, uint64_t seed, Measurements &measurements)
+{
+    const Workload &workload = shared.workload;
+    std::mt19937_64 rng(seed);
+    KeyChooser chooser(workload.request_distribution, workload.record_count);
+    ZipfianGenerator scan_lengths(std::max<uint64_t>(workload.max_scan_length, 2));
+    double total = 0;
+    for (int op = 0; op < OP_TOTAL; ++op)
+    {
+        total += workload.proportions[op];
+    }
+    for (uint64_t i = 0; i < operations; ++i)
+    {
+        double pick = std::uniform_real_distribution<double>(0, total)(rng);
+        int op = 0;
+        while (op < OP_TOTAL - 1 && pick >= workload.proportions[op])
+        {
+            pick -= workload.proportions[op];
+            ++op;
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool found = do_operation(shared, (Operation)op, chooser, scan_lengths, rng);
+        auto end = std::chrono::steady_clock::now();
+        measurements.latency[op].Record(std::chrono::duration_cast<std::chrono::microseconds>(end - start).count());
+        measurements.not_found[op] += !found;
+    }
+}
+
+static void load_client(Shared &shared, uint64_t begin, uint64_t end, uint64_t seed, Measurements &measurements)
+{
+    std::mt19937_64 rng(seed);
+    for (uint64_t key = begin; key < end; ++key)
+    {
+        auto start = std::chrono::steady_clock::now();
+        insert(shared, key, rng);
+        auto finish = std::chrono::steady_clock::now();
+        measurements.latency[OP_INSERT].Record(std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count());
+    }
+}
+
+static void report(const Measurements &measurements, double seconds)
+{
+    uint64_t operations = 0;
+    for (int op = 0; op < OP_TOTAL; ++op)
+    {
+        operations += measurements.latency[op].Count();
+    }
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "[OVERALL], RunTime(ms), " << seconds * 1000 << std::endl;
+    std::cout << "[OVERALL], Throughput(ops/sec), " << operations / seconds << std::endl;
+    for (int op = 0; op < OP_TOTAL; ++op)
+    {
+        const Histogram &latency = measurements.latency[op];
+        if (latency.Count() == 0)
+        {
+            continue;
+        }
+        std::string name = std::string("[") + OPERATION_NAMES[op] + "], ";
+        std::cout << name << "Operations, " << latency.Count() << std::endl;
+        std::cout << name << "AverageLatency(us), " << latency.Mean() << std::endl;
+        std::cout << name << "MinLatency(us), " << latency.Min() << std::endl;
+        std::cout << name << "MaxLatency(us), " << latency.Max() << std::endl;
+        std::cout << name << "50thPercentileLatency(us), " << latency.Percentile(50) << std::endl;
+        std::cout << name << "95thPercentileLatency(us), " << latency.Percentile(95) << std::endl;
+        std::cout << name << "99thPercentileLatency(us), " << latency.Percentile(99) << std::endl;
+        std::cout << name << "99.9thPercentileLatency(us), " << latency.Percentile(99.9) << std::endl;
+        std::cout << name << "Return=OK, " << latency.Count() - measurements.not_found[op] << std::endl;
+        if (measurements.not_found[op])
+        {
+            std::cout << name << "Return=NOT_FOUND, " << measurements.not_found[op] << std::endl;
+        }
+    }
+}
+
+// name=value pairs separated by white space, # starts a comment
+static void parse_properties(std::istream &in, properties_t &properties)
+{
+    std::string line;
+    while (std::getline(in, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string word;
+        while (words >> word)
+        {
+            size_t equal = word.find('=');
+            if (equal != std::string::npos)
+            {
+                properties[word.substr(0, equal)] = word.substr(equal + 1);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    properties_t properties = {
+        {"recordcount", "100000"}, {"operationcount", "100000"}, {"readproportion", "0.95"},
+        {"updateproportion", "0.05"}, {"insertproportion", "0"}, {"scanproportion", "0"},
+        {"readmodifywriteproportion", "0"}, {"requestdistribution", "uniform"}, {"maxscanlength", "1000"},
+        {"scanlengthdistribution", "uniform"}, {"fieldcount", "10"}, {"fieldlength", "100"},
+        {"threadcount", "1"}, {"db", "./bench_data/ycsb"}, {"seed", "2023"}};
+    std::string phase = (argc > 1)? argv[1] : "";
+    bool usage = (phase != "load" && phase != "run" && phase != "loadrun");
+    for (int i = 2; i < argc && !usage; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            usage = true;
+            break;
+        }
+        std::string value = argv[++i];
+        if (arg == "-w")
+        {
+            usage = true;
+            for (size_t w = 0; w < sizeof(WORKLOADS) / sizeof(WORKLOADS[0]); ++w)
+            {
+                if (value == WORKLOADS[w][0])
+                {
+                    std::istringstream in(WORKLOADS[w][1]);
+                    parse_properties(in, properties);
+                    usage = false;
+                }
+            }
+        }
+        else if (arg == "-P")
+        {
+            std::ifstream in(value);
+            usage = !in;
+            parse_properties(in, properties);
+        }
+        else if (arg == "-p")
+        {
+            std::istringstream in(value);
+            parse_properties(in, properties);
+        }
+        else if (arg == "-threads")
+        {
+            properties["threadcount"] = value;
+        }
+        else
+        {
+            usage = true;
+        }
+    }
+    if (usage)
+    {
+        std::cout << "Usage: " << argv[0] << " load|run|loadrun [-w a|b|c|d|e|f] [-P workload_file] "
+                  << "[-p name=value] [-threads n]" << std::endl;
+        std::cout << "  requestdistribution is uniform, zipfian (scrambled, as in YCSB), plain_zipfian or latest; "
+                  << "-p db=dir picks the store" << std::endl;
+        return 1;
+    }
+
+    Workload workload(properties);
+    int threads = std::max(std::stoi(properties["threadcount"]), 1);
+    uint64_t seed = std::stoull(properties["seed"]);
+    std::string dir = properties["db"];
+    utils::mkdir(dir.c_str());
+    KVStore store(dir);
+    Shared shared(workload, store);
+
+    if (phase == "load" || phase == "loadrun")
+    {
+        store.reset();
+        std::cout << "Loading " << workload.record_count << " records of " << workload.value_size << " bytes on "
+                  << threads << " threads" << std::endl;
+        std::vector<Measurements> measurements(threads);
+        std::vector<std::thread> clients;
+        uint64_t per_thread = (workload.record_count + threads - 1) / threads;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            uint64_t begin = std::min(workload.record_count, t * per_thread);
+            uint64_t end = std::min(workload.record_count, begin + per_thread);
+            clients.emplace_back(load_client, std::ref(shared), begin, end, seed + t, std::ref(measurements[t]));
+        }
+        for (std::vector<std::thread>::iterator client_it = clients.begin(); client_it != clients.end(); ++client_it)
+        {
+            client_it->join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        for (int t = 1; t < threads; ++t)
+        {
+            measurements[0].Merge(measurements[t]);
+        }
+        report(measurements[0], std::chrono::duration<double>(end - start).count());
+    }
+    if (phase == "run" || phase == "loadrun")
+    {
+        std::cout << "Running " << workload.operation_count << " operations (" << workload.request_distribution
+                  << ") on " << threads << " threads" << std::endl;
+        std::vector<Measurements> measurements(threads);
+        std::vector<std::thread> clients;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            uint64_t operations = workload.operation_count / threads + ((uint64_t)t < workload.operation_count % threads);
+            clients.emplace_back(run_client, std::ref(shared), operations, seed + threads + t, std::ref(measurements[t]));
+        }
+        for (std::vector<std::thread>::iterator client_it = clients.begin(); client_it != clients.end(); ++client_it)
+        {
+            client_it->join();
+        }
+        auto end = std::chrono::steady_clock::now();
+        for (int t = 1; t < threads; ++t)
+        {
+            measurements[0].Merge(measurements[t]);
+        }
+        report(measurements[0], std::chrono::duration<double>(end - start).count());
+    }
+    return 0;
+}
@@ -1,13 +1,17 @@
 #include <iostream>
 #include <cstdint>
 #include <string>
+#include <fstream>
+#include <map>
 
 #include "test.h"
+#include "memory.h"
 
 class CorrectnessTest : public Test {
 private:
 	const uint64_t SIMPLE_TEST_MAX = 512;
     const uint64_t LARGE_TEST_MAX = 1024 * 64;
+	const std::string dir;
 
 	void regular_test(uint64_t max)
 	{
@@ -86,8 +90,473 @@ private:
 		report();
 	}
 
+	static std::string value(uint64_t key, char c)
+	{
+		return std::string(key % 64 + 1, c);
+	}
+
+	/**
+	 * Write 10MB past max to drain the memtable: the keys below max
+	 * are flushed and compacted into the deeper levels.
+	 */
+	void drain(uint64_t max)
+	{
+		for (uint64_t i = 0; i <= 10240; ++i)
+			store.put(max + i, std::string(1024, 'x'));
+	}
+
+	void check_scan(const std::list<std::pair<uint64_t, std::string> > &list_ans,
+			const std::list<std::pair<uint64_t, std::string> > &list_stu)
+	{
+		EXPECT(list_ans.size(), list_stu.size());
+
+		auto ap = list_ans.begin();
+		auto sp = list_stu.begin();
+		while (ap != list_ans.end() && sp != list_stu.end()) {
+			EXPECT((*ap).first, (*sp).first);
+			EXPECT((*ap).second, (*sp).second);
+			ap++;
+			sp++;
+		}
+	}
+
+	// a third of the keys deleted and a third overwritten after the snapshot
+	static std::string snapshot_latest(uint64_t key)
+	{
+		switch (key % 3) {
+		case 0:
+			return not_found;
+		case 1:
+			return value(key, 'b');
+		default:
+			return value(key, 'a');
+		}
+	}
+
+	void snapshot_check(uint64_t max, const Snapshot *snapshot)
+	{
+		uint64_t i;
+		std::list<std::pair<uint64_t, std::string> > list_ans;
+		std::list<std::pair<uint64_t, std::string> > list_stu;
+
+		for (i = 0; i < max; ++i) {
+			if (snapshot)
+				EXPECT(value(i, 'a'), store.get(i, snapshot));
+			EXPECT(snapshot_latest(i), store.get(i));
+		}
+
+		if (snapshot) {
+			for (i = max / 4; i <= max / 2; ++i)
+				list_ans.emplace_back(i, value(i, 'a'));
+			store.scan(max / 4, max / 2, list_stu, snapshot);
+			check_scan(list_ans, list_stu);
+			list_ans.clear();
+			list_stu.clear();
+		}
+
+		for (i = max / 4; i <= max / 2; ++i)
+			if (i % 3 != 0)
+				list_ans.emplace_back(i, snapshot_latest(i));
+		store.scan(max / 4, max / 2, list_stu);
+		check_scan(list_ans, list_stu);
+	}
+
+	void snapshot_test(uint64_t max)
+	{
+		uint64_t i;
+
+		store.reset();
+		for (i = 0; i < max; ++i)
+			store.put(i, value(i, 'a'));
+		drain(max);
+
+		// Overwrite and delete while a snapshot is held
+		const Snapshot *snapshot = store.get_snapshot();
+		for (i = 0; i < max; ++i) {
+			if (i % 3 == 0)
+				EXPECT(true, store.del(i));
+			else if (i % 3 == 1)
+				store.put(i, value(i, 'b'));
+		}
+		snapshot_check(max, snapshot);
+
+		phase();
+
+		// Flush and compact the newer versions over the older ones
+		drain(max);
+		snapshot_check(max, snapshot);
+		drain(max);
+		snapshot_check(max, snapshot);
+
+		phase();
+
+		// Release the snapshot, compactions may drop what it kept
+		store.release_snapshot(snapshot);
+		snapshot_check(max, nullptr);
+		drain(max);
+		drain(max);
+		snapshot_check(max, nullptr);
+
+		phase();
+
+		store.reset();
+
+		report();
+	}
+
+	/**
+	 * Write 2MB past max, about one memtable: the keys below max
+	 * are flushed to level 0 but not compacted yet.
+	 */
+	void flush(uint64_t max)
+	{
+		for (uint64_t i = 0; i <= 2048; ++i)
+			store.put(max + i, std::string(1024, 'y'));
+	}
+
+	// whether a compaction has logged dropping a range tombstone at the bottommost level
+	bool range_tombstone_dropped()
+	{
+		const std::string field = "\"range_tombstones_dropped\": ";
+		std::ifstream log(dir + "/LOG");
+		std::string line;
+		while (std::getline(log, line)) {
+			size_t pos = line.find(field);
+			if (pos != std::string::npos && line.compare(pos + field.size(), 1, "0") != 0)
+				return true;
+		}
+		return false;
+	}
+
+	// 'a' in level 1, 'b' in level 0, 'c' in the memtable, then [max/8, max/2]
+	// deleted and its two ends put again
+	static std::string range_value(uint64_t key, uint64_t max, bool deleted)
+	{
+		if (deleted && (key == max / 8 || key == max / 4))
+			return value(key, 'd');
+		if (deleted && key >= max / 8 && key <= max / 2)
+			return not_found;
+		switch (key % 4) {
+		case 1:
+			return value(key, 'b');
+		case 2:
+			return value(key, 'c');
+		default:
+			return value(key, 'a');
+		}
+	}
+
+	void range_check(uint64_t max, const Snapshot *snapshot)
+	{
+		uint64_t i;
+		std::list<std::pair<uint64_t, std::string> > list_ans;
+		std::list<std::pair<uint64_t, std::string> > list_stu;
+
+		for (i = 0; i < max; ++i) {
+			if (snapshot)
+				EXPECT(range_value(i, max, false), store.get(i, snapshot));
+			EXPECT(range_value(i, max, true), store.get(i));
+		}
+
+		// Scans reaching into the range from either side
+		for (i = 0; i <= max / 4; ++i)
+			if (range_value(i, max, true) != not_found)
+				list_ans.emplace_back(i, range_value(i, max, true));
+		store.scan(0, max / 4, list_stu);
+		check_scan(list_ans, list_stu);
+		list_ans.clear();
+		list_stu.clear();
+
+		for (i = max * 3 / 8; i <= max * 5 / 8; ++i)
+			if (range_value(i, max, true) != not_found)
+				list_ans.emplace_back(i, range_value(i, max, true));
+		store.scan(max * 3 / 8, max * 5 / 8, list_stu);
+		check_scan(list_ans, list_stu);
+	}
+
+	void range_test(uint64_t max)
+	{
+		uint64_t i;
+
+		store.reset();
+		for (i = 0; i < max; ++i)
+			store.put(i, value(i, 'a'));
+		for (i = 0; i < 4; ++i)
+			flush(max);
+		for (i = 1; i < max; i += 4)
+			store.put(i, value(i, 'b'));
+		flush(max);
+		for (i = 2; i < max; i += 4)
+			store.put(i, value(i, 'c'));
+
+		// One tombstone over the memtable, level 0 and level 1
+		const Snapshot *snapshot = store.get_snapshot();
+		store.delete_range(max / 8, max / 2);
+		store.put(max / 8, value(max / 8, 'd'));
+		store.put(max / 4, value(max / 4, 'd'));
+		range_check(max, snapshot);
+
+		phase();
+
+		// Level 1 is the bottommost level, but the snapshot still reads below the tombstone
+		for (i = 0; i < 4; ++i)
+			flush(max);
+		EXPECT(false, range_tombstone_dropped());
+		range_check(max, snapshot);
+
+		phase();
+
+		// Once it is released the next compaction over the range drops the tombstone
+		store.release_snapshot(snapshot);
+		store.put(max / 4, value(max / 4, 'd'));
+		for (i = 0; i < 4; ++i)
+			flush(max);
+		EXPECT(true, range_tombstone_dropped());
+		range_check(max, nullptr);
+
+		phase();
+
+		store.reset();
+
+		report();
+	}
+
+	/**
+	 * Byte string keys: long shared prefixes, keys telling apart only
+	 * after the 16 bytes a file name spells out, and embedded NULs.
+	 */
+	static BinaryKey binary_key(uint64_t i)
+	{
+		switch (i % 4) {
+		case 0:
+			return BinaryKey(std::string(32, 'p') + std::to_string(i));
+		case 1:
+			return BinaryKey(std::string(16, 's') + std::to_string(i));
+		case 2:
+			return BinaryKey(std::string("n\0", 2) + std::string(i % 7, '\0') + std::to_string(i));
+		default:
+			return BinaryKey(std::to_string(i) + std::string(i % 5, '\0'));
+		}
+	}
+
+	// what the binary store should hold, in the same order
+	void binary_check(Memory<BinaryKey, std::string> &binary,
+			  const std::map<std::string, std::string> &ans)
+	{
+		std::string got;
+
+		for (auto it = ans.begin(); it != ans.end(); ++it) {
+			EXPECT(true, binary.Get(BinaryKey(it->first), &got));
+			EXPECT(it->second, got);
+		}
+		EXPECT(false, binary.Get(BinaryKey(std::string(32, 'p')), &got));
+		EXPECT(false, binary.Get(BinaryKey(std::string(16, 's')), &got));
+		EXPECT(false, binary.Get(BinaryKey(std::string("n\0", 2)), &got));
+		EXPECT(false, binary.Get(BinaryKey(std::string(1, '\0')), &got));
+
+		// All of it, then the keys sharing their first 16 bytes
+		std::list<std::pair<BinaryKey, std::string> > list_stu;
+		binary.Scan(BinaryKey(std::string()), BinaryKey(std::string(64, '\xff')), list_stu);
+		EXPECT(ans.size(), list_stu.size());
+		auto ap = ans.begin();
+		auto sp = list_stu.begin();
+		while (ap != ans.end() && sp != list_stu.end()) {
+			EXPECT(ap->first, sp->first.ToString());
+			EXPECT(ap->second, sp->second);
+			ap++;
+			sp++;
+		}
+
+		list_stu.clear();
+		binary.Scan(BinaryKey(std::string(16, 's')), BinaryKey(std::string(16, 's') + "\xff"), list_stu);
+		ap = ans.lower_bound(std::string(16, 's'));
+		sp = list_stu.begin();
+		while (ap != ans.end() && ap->first.compare(0, 16, std::string(16, 's')) == 0) {
+			EXPECT(true, sp != list_stu.end());
+			if (sp == list_stu.end())
+				break;
+			EXPECT(ap->first, sp->first.ToString());
+			ap++;
+			sp++;
+		}
+		EXPECT(true, sp == list_stu.end());
+	}
+
+	void binary_test(uint64_t max)
+	{
+		uint64_t i;
+		std::map<std::string, std::string> ans;
+		Options options;
+
+		// Small tables, so the keys are flushed and compacted through several levels
+		options.write_buffer_size = 64 * 1024;
+		options.target_file_size = 64 * 1024;
+		options.max_bytes_for_level_base = 256 * 1024;
+
+		{
+			Memory<BinaryKey, std::string> binary(dir + "_binary", options);
+			binary.Reset();
+
+			binary.Put(BinaryKey(std::string()), "empty");
+			ans[std::string()] = "empty";
+			for (i = 0; i < max; ++i) {
+				binary.Put(binary_key(i), value(i, 'a'));
+				ans[binary_key(i).ToString()] = value(i, 'a');
+			}
+			binary_check(binary, ans);
+
+			phase();
+
+			// Overwrite a third of the keys and delete another
+			for (i = 0; i < max; ++i) {
+				if (i % 3 == 0) {
+					binary.Put(binary_key(i), value(i, 'b'));
+					ans[binary_key(i).ToString()] = value(i, 'b');
+				} else if (i % 3 == 1) {
+					EXPECT(true, binary.Del(binary_key(i)));
+					ans.erase(binary_key(i).ToString());
+				}
+			}
+			binary_check(binary, ans);
+
+			phase();
+		}
+
+		// Reopened from its files
+		{
+			Memory<BinaryKey, std::string> binary(dir + "_binary", options);
+			binary_check(binary, ans);
+			EXPECT(true, binary.Del(BinaryKey(std::string())));
+			EXPECT(false, binary.Del(BinaryKey(std::string())));
+
+			phase();
+
+			binary.Reset();
+		}
+
+		report();
+	}
+
+	// a fifth of the counters start at zero, a third are then deleted and another third reset to zero
+	static uint64_t fixed_value(uint64_t key, bool updated)
+	{
+		if (updated && key % 3 == 2)
+			return 0;
+		return (key % 5 == 0) ? 0 : key * 7;
+	}
+
+	void fixed_check(Memory<uint64_t, uint64_t> &fixed, uint64_t max, bool updated)
+	{
+		uint64_t i;
+		uint64_t got;
+		std::list<std::pair<uint64_t, uint64_t> > list_ans;
+		std::list<std::pair<uint64_t, uint64_t> > list_stu;
+
+		// A zero value is found, a deleted or missing key is not
+		for (i = 0; i < max; ++i) {
+			got = UINT64_MAX;
+			if (updated && i % 3 == 1) {
+				EXPECT(false, fixed.Get(i, &got));
+				continue;
+			}
+			EXPECT(true, fixed.Get(i, &got));
+			EXPECT(fixed_value(i, updated), got);
+			list_ans.emplace_back(i, fixed_value(i, updated));
+		}
+		EXPECT(false, fixed.Get(max, &got));
+
+		fixed.Scan(0, max, list_stu);
+		EXPECT(list_ans.size(), list_stu.size());
+		auto ap = list_ans.begin();
+		auto sp = list_stu.begin();
+		while (ap != list_ans.end() && sp != list_stu.end()) {
+			EXPECT((*ap).first, (*sp).first);
+			EXPECT((*ap).second, (*sp).second);
+			ap++;
+			sp++;
+		}
+	}
+
+	void fixed_test(uint64_t max)
+	{
+		uint64_t i;
+		Options options;
+
+		// Small tables, so the tombstones are flushed and compacted into fixed-stride tables
+		options.write_buffer_size = 64 * 1024;
+		options.target_file_size = 64 * 1024;
+		options.max_bytes_for_level_base = 256 * 1024;
+
+		{
+			Memory<uint64_t, uint64_t> fixed(dir + "_fixed", options);
+			fixed.Reset();
+
+			for (i = 0; i < max; ++i)
+				fixed.Put(i, fixed_value(i, false));
+			fixed_check(fixed, max, false);
+
+			phase();
+
+			for (i = 0; i < max; ++i) {
+				if (i % 3 == 1)
+					EXPECT(true, fixed.Del(i));
+				else if (i % 3 == 2)
+					fixed.Put(i, 0);
+			}
+			fixed_check(fixed, max, true);
+
+			phase();
+		}
+
+		// Reopened from its files
+		{
+			Memory<uint64_t, uint64_t> fixed(dir + "_fixed", options);
+			fixed_check(fixed, max, true);
+			EXPECT(true, fixed.Del(0));
+			EXPECT(false, fixed.Del(0));
+
+			phase();
+
+			fixed.Reset();
+		}
+
+		report();
+	}
+
+	/**
+	 * Compaction outputs asked to be smaller than their bloom filter:
+	 * the store raises the size, and an output still gets a key.
+	 */
+	void tiny_file_test(uint64_t max)
+	{
+		uint64_t i;
+		Options options;
+		std::string got;
+
+		options.write_buffer_size = 64 * 1024;
+		options.target_file_size = 8 * 1024;
+		options.max_bytes_for_level_base = 256 * 1024;
+
+		Memory<uint64_t, std::string> tiny(dir + "_tiny", options);
+		tiny.Reset();
+		for (i = 0; i < max; ++i)
+			tiny.Put(i, value(i, 'a'));
+		for (i = 0; i < max; i += 2)
+			tiny.Put(i, value(i, 'b'));
+		for (i = 0; i < max; ++i) {
+			EXPECT(true, tiny.Get(i, &got));
+			EXPECT(value(i, (i & 1) ? 'a' : 'b'), got);
+		}
+
+		phase();
+
+		tiny.Reset();
+
+		report();
+	}
+
 public:
-	CorrectnessTest(const std::string &dir, bool v=true) : Test(dir, v)
+	CorrectnessTest(const std::string &dir, bool v=true) : Test(dir, v), dir(dir)
 	{
 	}
 
@@ -100,6 +569,21 @@ public:
 
 		std::cout << "[Large Test]" << std::endl;
 		regular_test(LARGE_TEST_MAX);
+
+		std::cout << "[Snapshot Test]" << std::endl;
+		snapshot_test(LARGE_TEST_MAX);
+
+		std::cout << "[Delete Range Test]" << std::endl;
+		range_test(LARGE_TEST_MAX);
+
+		std::cout << "[Binary Key Test]" << std::endl;
+		binary_test(LARGE_TEST_MAX);
+
+		std::cout << "[Fixed Value Test]" << std::endl;
+		fixed_test(LARGE_TEST_MAX);
+
+		std::cout << "[Tiny File Test]" << std::endl;
+		tiny_file_test(LARGE_TEST_MAX / 4);
 	}
 };
 
@@ -8,6 +8,7 @@ typedef unsigned __int64 uint64_t;
 #define FORCE_INLINE	__forceinline
 
 #include <stdlib.h>
+#include <string.h>
 
 #define ROTL64(x,y)	_rotl64(x,y)
 
@@ -18,6 +19,7 @@ typedef unsigned __int64 uint64_t;
 #else	// defined(_MSC_VER)
 
 #include <stdint.h>
+#include <string.h>
 
 #define	FORCE_INLINE inline __attribute__((always_inline))
 
@@ -126,6 +128,7 @@ static inline void MurmurHash3_x64_128 ( const void * key, const int len,
   h1 += h2;
   h2 += h1;
 
-  ((uint64_t*)out)[0] = h1;
-  ((uint64_t*)out)[1] = h2;
+  // copied, not stored through a uint64_t*: out is often an array of 4 unsigned ints
+  memcpy(out, &h1, sizeof(h1));
+  memcpy((char*)out + sizeof(h1), &h2, sizeof(h2));
 }
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef BLOBFILE_H
+#define BLOBFILE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <memory>
+#include "mappedfile.h"
+#include "pinnable.h"
+
+// where a value kept out of the tables lives, an entry of TYPE_BLOB_INDEX holds it in place of the value
+struct BlobIndex
+{
+    uint64_t file_number_;
+    uint64_t offset_;               // of the value in the file
+    uint64_t size_;
+    static constexpr size_t ENCODED_SIZE = sizeof(uint64_t) * 3;
+    std::string Encode() const;
+    bool Decode(std::string_view data);     // false if data is no encoded index
+};
+
+// a value log file is written once, by a flush or a compaction, and never changed: per value the key size (u32),
+// the value size (u64), the key and the value, then a footer of the record count, the value bytes and BLOB_MAGIC,
+// which tells recovery how large the file is without reading it
+class BlobFileWriter
+{
+private:
+    std::ofstream out_;
+    uint64_t file_number_;
+    uint64_t offset_;
+    uint64_t records_;
+    uint64_t value_bytes_;
+    explicit BlobFileWriter(uint64_t file_number);
+public:
+    BlobFileWriter(const BlobFileWriter &) = delete;
+    BlobFileWriter& operator = (const BlobFileWriter &) = delete;
+    static std::unique_ptr<BlobFileWriter> Open(const std::string &filename, uint64_t file_number);   // nullptr if failed
+    BlobIndex Add(std::string_view key, std::string_view value);
+    bool Finish();                  // the footer is written and the file closed, the caller syncs it
+    uint64_t file_number() const { return file_number_; }
+    uint64_t file_size() const { return offset_; }
+};
+
+// a finished value log file, mapped; values are pinned into the mapping
+class BlobFileReader
+{
+private:
+    std::shared_ptr<const MappedFile> file_;
+    uint64_t records_;
+    uint64_t value_bytes_;
+    BlobFileReader();
+public:
+    static std::shared_ptr<const BlobFileReader> Open(const std::string &filename);     // nullptr if failed or unfinished
+    bool Read(const BlobIndex &index, PinnableValue *value) const;                      // false if out of the file
+    uint64_t records() const { return records_; }
+    uint64_t value_bytes() const { return value_bytes_; }
+    uint64_t file_size() const { return file_->size(); }
+};
+
+#endif // BLOBFILE_H
@@ -6,6 +6,7 @@
 #include <ctime>
 #include <cstring>
 #include "MurmurHash3.h"
+#include "keytraits.h"
 
 template <class T>
 class BloomFilter
@@ -0,0 +1,66 @@
+#ifndef COMPARATOR_H
+#define COMPARATOR_H
+
+#include <string>
+#include <string_view>
+#include <ostream>
+
+// orders byte strings as memcmp does, a shorter string before any it is a prefix of
+struct BytewiseComparator
+{
+    static const char* Name() { return "lsmkv.BytewiseComparator"; }
+    static int Compare(std::string_view a, std::string_view b) { return a.compare(b); }
+};
+
+// a byte string key in the order of Comparator, which is fixed at compile time: a class with
+// static int Compare(std::string_view, std::string_view) returning <0, 0 or >0 and static const char* Name();
+// the engine only compares keys through the operators below, so a key type of another order only
+// needs the explicit instantiations at the ends of src/*.cpp that BinaryKey has
+template <class Comparator>
+class OrderedKey
+{
+private:
+    std::string data_;
+public:
+    OrderedKey() {}
+    OrderedKey(const std::string &data): data_(data) {}
+    OrderedKey(std::string &&data): data_(std::move(data)) {}
+    OrderedKey(std::string_view data): data_(data) {}
+    OrderedKey(const char* data, size_t size): data_(data, size) {}
+    const char* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+    bool empty() const { return data_.empty(); }
+    std::string_view view() const { return data_; }
+    const std::string& ToString() const { return data_; }
+    int Compare(const OrderedKey &key) const { return Comparator::Compare(data_, key.data_); }
+    bool operator < (const OrderedKey &key) const { return Compare(key) < 0; }
+    bool operator > (const OrderedKey &key) const { return Compare(key) > 0; }
+    bool operator <= (const OrderedKey &key) const { return Compare(key) <= 0; }
+    bool operator >= (const OrderedKey &key) const { return Compare(key) >= 0; }
+    bool operator == (const OrderedKey &key) const { return Compare(key) == 0; }
+    bool operator != (const OrderedKey &key) const { return Compare(key) != 0; }
+};
+
+typedef OrderedKey<BytewiseComparator> BinaryKey;
+
+// printable bytes as they are, the others escaped
+template <class Comparator>
+std::ostream& operator << (std::ostream &out, const OrderedKey<Comparator> &key)
+{
+    static const char HEX[] = "0123456789abcdef";
+    for (size_t i = 0; i < key.size(); ++i)
+    {
+        unsigned char c = key.data()[i];
+        if (c >= 0x20 && c < 0x7f && c != '\\')
+        {
+            out << (char)c;
+        }
+        else
+        {
+            out << "\\x" << HEX[c >> 4] << HEX[c & 0xf];
+        }
+    }
+    return out;
+}
+
+#endif // COMPARATOR_H
@@ -0,0 +1,65 @@
+#ifndef EVENTLOGGER_H
+#define EVENTLOGGER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+
+// the fields of one flat JSON object, in the order they are added
+class JSONWriter
+{
+private:
+    std::string fields_;
+    JSONWriter& Key(const std::string &key);
+public:
+    JSONWriter& Add(const std::string &key, uint64_t value);
+    JSONWriter& Add(const std::string &key, int value);
+    JSONWriter& Add(const std::string &key, bool value);
+    JSONWriter& Add(const std::string &key, const std::string &value);
+    JSONWriter& Add(const std::string &key, const char* value);
+    JSONWriter& Add(const std::string &key, const std::vector<std::string> &values);
+    JSONWriter& Add(const std::string &key, const JSONWriter &object);
+    const std::string& Fields() const { return fields_; }     // without the braces
+    std::string ToString() const { return "{" + fields_ + "}"; }
+    static std::string Quote(const std::string &str);
+};
+
+// the LOG of a store: free text such as the statistics dumps, and events, each a line of
+// "EVENT_LOG_v1 " and a JSON object; past max_log_size it is moved to LOG.old.<micros> and at most
+// keep_log_files of those are kept; with a trace path, flushes and compactions are also written
+// there in the Chrome trace event format, which chrome://tracing and Perfetto open
+class EventLogger
+{
+private:
+    std::string dir_;
+    uint64_t max_log_size_;         // 0 never rotates
+    int keep_log_files_;
+    std::ofstream log_;
+    uint64_t log_size_;
+    std::ofstream trace_;
+    bool trace_empty_;
+    std::chrono::steady_clock::time_point origin_;
+    std::mutex mutex_;
+    void Write(const std::string &text);
+    void Rotate();
+    void Trace(const std::string &event);
+public:
+    EventLogger(const std::string &dir, uint64_t max_log_size, int keep_log_files, const std::string &trace_path);
+    ~EventLogger();
+    EventLogger(const EventLogger &) = delete;
+    EventLogger& operator = (const EventLogger &) = delete;
+    void Log(const std::string &text);
+    void LogEvent(const JSONWriter &event);     // time_micros, microseconds since the epoch, goes first
+    bool Tracing() const { return trace_.is_open(); }
+    uint64_t NowMicros() const;                 // since the logger was made, the clock of the trace
+    // a span on thread tid, and a point in time on the calling thread
+    void TraceComplete(const std::string &name, int tid, uint64_t start_micros, uint64_t end_micros,
+                       const JSONWriter &args);
+    void TraceInstant(const std::string &name, const JSONWriter &args);
+    static int ThreadId();                      // small numbers, in the order threads first ask
+};
+
+#endif // EVENTLOGGER_H
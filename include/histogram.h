@@ -0,0 +1,35 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// log-linear buckets in the manner of HdrHistogram: values below 2^SUB_BITS_ are kept exactly,
+// each power of two above is split into 2^(SUB_BITS_ - 1) buckets, so a value is off by under 1%;
+// not thread-safe, a thread records into its own and they are merged
+class Histogram
+{
+private:
+    static const int SUB_BITS_ = 8;
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t min_;
+    uint64_t max_;
+    double sum_;
+    static int BucketIndex(uint64_t value);
+    static uint64_t BucketValue(int index);     // highest value of the bucket
+public:
+    Histogram();
+    void Record(uint64_t value);
+    void Merge(const Histogram &other);
+    void Clear();
+    uint64_t Count() const { return count_; }
+    uint64_t Min() const { return count_? min_ : 0; }
+    uint64_t Max() const { return max_; }
+    double Mean() const { return count_? sum_ / count_ : 0; }
+    uint64_t Sum() const { return sum_; }
+    uint64_t Percentile(double percent) const;  // percent in [0, 100]
+};
+
+#endif // HISTOGRAM_H
@@ -0,0 +1,32 @@
+#ifndef IOBACKEND_H
+#define IOBACKEND_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <sys/types.h>
+#include "options.h"
+
+// reads that are submitted now and waited on later, so many of them can be in flight at once;
+// a backend may be shared by threads, a request belongs to the thread that submitted it
+class IOBackend
+{
+public:
+    struct Request
+    {
+        int fd_;
+        uint64_t offset_;
+        size_t length_;
+        char* buffer_;
+        ssize_t result_;        // bytes read, or -errno
+        bool done_;
+    };
+    virtual ~IOBackend() {}
+    virtual void Submit(Request* request) = 0;      // may wait for an earlier request if the queue is full
+    virtual void Wait(Request* request) = 0;
+    virtual const char* Name() const = 0;
+    // io_uring falls back to the thread pool where the kernel does not allow it
+    static std::unique_ptr<IOBackend> Create(IOBackendType type, int queue_depth);
+};
+
+#endif // IOBACKEND_H
@@ -0,0 +1,159 @@
+#ifndef KEYTRAITS_H
+#define KEYTRAITS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <type_traits>
+#include "comparator.h"
+#include "MurmurHash3.h"
+
+// how the engine lays out, hashes and names keys. A fixed-width integer is stored as its bytes, exactly as
+// tables have always held uint64_t keys, and every size below is a constant the compiler folds away
+template <class KEY>
+struct KeyTraits
+{
+    static_assert(std::is_integral<KEY>::value, "a key is an integer or an OrderedKey");
+    static constexpr bool FIXED_WIDTH = true;
+    static size_t Size(const KEY &) { return sizeof(KEY); }
+    static std::string_view Bytes(const KEY &key) { return std::string_view((const char*)&key, sizeof(KEY)); }
+    static size_t EncodedSize(const KEY &) { return sizeof(KEY); }
+    static char* Encode(const KEY &key, char* pos)
+    {
+        memcpy(pos, &key, sizeof(KEY));
+        return pos + sizeof(KEY);
+    }
+    // nullptr if the key does not fit before end
+    static const char* Decode(const char* pos, const char* end, KEY &key)
+    {
+        if ((size_t)(end - pos) < sizeof(KEY))
+        {
+            return nullptr;
+        }
+        memcpy(&key, pos, sizeof(KEY));
+        return pos + sizeof(KEY);
+    }
+    // index keys are not prefix compressed, an entry stays at a fixed stride
+    static size_t IndexKeySize(const KEY &, const KEY &) { return sizeof(KEY); }
+    static char* EncodeIndexKey(const KEY &, const KEY &key, char* pos) { return Encode(key, pos); }
+    static const char* DecodeIndexKey(const char* pos, const char* end, const KEY &, KEY &key) { return Decode(pos, end, key); }
+    // the nearest keys around key, which bound the range tombstones of neighbouring files
+    static KEY After(const KEY &key) { return key + 1; }
+    static KEY Before(const KEY &key) { return key - 1; }
+    static std::string FileName(const KEY &key) { return std::to_string(key); }
+    static uint64_t Display(const KEY &key) { return key; }
+};
+
+// a byte string key is stored as its size (u32) and bytes. In the index each key is stored as the size of the
+// prefix it shares with the key before it (u32), the size of the rest (u32) and the rest. Nothing lies next to a
+// byte string in every order, so neighbouring files share their boundary key instead of splitting at a successor
+template <class Comparator>
+struct KeyTraits<OrderedKey<Comparator>>
+{
+    typedef OrderedKey<Comparator> KEY;
+    static constexpr bool FIXED_WIDTH = false;
+    static constexpr size_t MAX_FILE_NAME_BYTES = 16;     // of a key spelt out in a file name, longer keys add a hash
+    static size_t Size(const KEY &key) { return key.size(); }
+    static std::string_view Bytes(const KEY &key) { return key.view(); }
+    static size_t EncodedSize(const KEY &key) { return sizeof(uint32_t) + key.size(); }
+    static char* Encode(const KEY &key, char* pos)
+    {
+        uint32_t size = key.size();
+        memcpy(pos, &size, sizeof(uint32_t));
+        memcpy(pos + sizeof(uint32_t), key.data(), size);
+        return pos + sizeof(uint32_t) + size;
+    }
+    static const char* Decode(const char* pos, const char* end, KEY &key)
+    {
+        uint32_t size = 0;
+        if ((size_t)(end - pos) < sizeof(uint32_t))
+        {
+            return nullptr;
+        }
+        memcpy(&size, pos, sizeof(uint32_t));
+        pos += sizeof(uint32_t);
+        if ((size_t)(end - pos) < size)
+        {
+            return nullptr;
+        }
+        key = KEY(pos, size);
+        return pos + size;
+    }
+    static size_t SharedPrefix(const KEY &last, const KEY &key)
+    {
+        size_t limit = (last.size() < key.size())? last.size() : key.size();
+        size_t shared = 0;
+        while (shared < limit && last.data()[shared] == key.data()[shared])
+        {
+            ++shared;
+        }
+        return shared;
+    }
+    static size_t IndexKeySize(const KEY &last, const KEY &key)
+    {
+        return sizeof(uint32_t) * 2 + key.size() - SharedPrefix(last, key);
+    }
+    static char* EncodeIndexKey(const KEY &last, const KEY &key, char* pos)
+    {
+        uint32_t shared = SharedPrefix(last, key);
+        uint32_t unshared = key.size() - shared;
+        memcpy(pos, &shared, sizeof(uint32_t));
+        memcpy(pos + sizeof(uint32_t), &unshared, sizeof(uint32_t));
+        memcpy(pos + sizeof(uint32_t) * 2, key.data() + shared, unshared);
+        return pos + sizeof(uint32_t) * 2 + unshared;
+    }
+    static const char* DecodeIndexKey(const char* pos, const char* end, const KEY &last, KEY &key)
+    {
+        uint32_t shared = 0;
+        uint32_t unshared = 0;
+        if ((size_t)(end - pos) < sizeof(uint32_t) * 2)
+        {
+            return nullptr;
+        }
+        memcpy(&shared, pos, sizeof(uint32_t));
+        memcpy(&unshared, pos + sizeof(uint32_t), sizeof(uint32_t));
+        pos += sizeof(uint32_t) * 2;
+        if (shared > last.size() || (size_t)(end - pos) < unshared)
+        {
+            return nullptr;
+        }
+        std::string data(last.data(), shared);
+        data.append(pos, unshared);
+        key = KEY(std::move(data));
+        return pos + unshared;
+    }
+    static KEY After(const KEY &key) { return key; }
+    static KEY Before(const KEY &key) { return key; }
+    // the bytes in hex, a long key by its first bytes and a hash of all of them
+    static std::string FileName(const KEY &key)
+    {
+        static const char HEX[] = "0123456789abcdef";
+        std::string name;
+        size_t size = (key.size() > MAX_FILE_NAME_BYTES)? MAX_FILE_NAME_BYTES : key.size();
+        for (size_t i = 0; i < size; ++i)
+        {
+            unsigned char c = key.data()[i];
+            name.push_back(HEX[c >> 4]);
+            name.push_back(HEX[c & 0xf]);
+        }
+        if (key.size() > MAX_FILE_NAME_BYTES)
+        {
+            uint64_t hash[2];
+            MurmurHash3_x64_128(key.data(), key.size(), 0, hash);
+            std::ostringstream out;
+            out << "." << std::hex << hash[0];
+            name.append(out.str());
+        }
+        return name;
+    }
+    static std::string Display(const KEY &key)
+    {
+        std::ostringstream out;
+        out << key;
+        return out.str();
+    }
+};
+
+#endif // KEYTRAITS_H
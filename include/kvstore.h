@@ -2,24 +2,57 @@
 
 #include "kvstore_api.h"
 #include "memory.h"
+#include "trace.h"
 
 class KVStore : public KVStoreAPI {
 	// You can add your implementation here
 private:
     Memory<uint64_t, std::string> memory_;
+    std::unique_ptr<TraceWriter> tracer_;       // null unless start_trace was called
 
 public:
 	KVStore(const std::string &dir);
 
+	KVStore(const std::string &dir, const Options &options);
+
 	~KVStore();
 
 	void put(uint64_t key, const std::string &s) override;
 
+	void put(uint64_t key, std::string &&s);
+
 	std::string get(uint64_t key) override;
 
+	bool get(uint64_t key, PinnableValue *value);
+
+	std::string get(uint64_t key, const Snapshot *snapshot);
+
+	bool get(uint64_t key, PinnableValue *value, const Snapshot *snapshot);
+
+	const Snapshot *get_snapshot();
+
+	void release_snapshot(const Snapshot *snapshot);
+
 	bool del(uint64_t key) override;
 
+	DelResult del(uint64_t key, DelMode mode);
+
+	void delete_range(uint64_t key1, uint64_t key2);
+
 	void reset() override;
 
+	std::string compaction_stats() const;
+
+	std::string stats() const;
+
+	bool get_property(const std::string &name, std::string *value) const;
+
 	void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list) override;
+
+	void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list,
+	          const Snapshot *snapshot);
+
+	bool start_trace(const std::string &filename);
+
+	bool end_trace();
 };
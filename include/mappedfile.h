@@ -0,0 +1,26 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <memory>
+#include <cstddef>
+
+// read-only view of a whole sstable file, unmapped when the last reference goes away
+class MappedFile
+{
+private:
+    const char* data_;
+    size_t size_;
+    std::string buffer_;        // used instead of mmap on platforms without it
+    bool mapped_;
+    MappedFile();
+public:
+    MappedFile(const MappedFile &) = delete;
+    MappedFile& operator = (const MappedFile &) = delete;
+    ~MappedFile();
+    static std::shared_ptr<const MappedFile> Open(const std::string &filename);     // nullptr if failed
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+#endif // MAPPEDFILE_H
@@ -3,29 +3,53 @@
 
 #include <vector>
 #include <map>
+#include <set>
 #include <iostream>
 #include <algorithm>
 #include <tuple>
 #include <list>
 #include <sstream>
+#include <fstream>
+#include <iomanip>
 #if defined(_MSC_VER)
 #include <io.h>
 #include <direct.h>
 #else
 #include <stdio.h>
 #include <unistd.h>
+#include <fcntl.h>
 #endif
 #include <cerrno>
+#include <cstring>
 #include <iterator>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <ctime>
+#include <atomic>
 #include "skiplist.h"
 #include "bloomfilter.h"
 #include "sstable.h"
+#include "mappedfile.h"
+#include "blobfile.h"
+#include "pinnable.h"
+#include "options.h"
+#include "ratelimiter.h"
+#include "iobackend.h"
+#include "statistics.h"
+#include "perf.h"
+#include "eventlogger.h"
+#include "snapshot.h"
 #include "utils.h"
 
 template <class KEY, class VALUE>
 class Memory
 {
 private: 
+    typedef typename SSTable<KEY, VALUE>::IndexEntry index_entry_t;
+    typedef typename SSTable<KEY, VALUE>::RangeTombstone range_tombstone_t;
     struct SmallSSTable
     {
         struct Head
@@ -40,30 +64,198 @@ private:
         };
         Head header_;
         BloomFilter<KEY> filter_;
-        std::vector<std::pair<KEY, uint32_t>> index_;
-        SmallSSTable(const std::vector<std::pair<KEY, VALUE>> &data, int bloom_filter_size);
+        std::vector<range_tombstone_t> range_tombstones_;
+        std::vector<index_entry_t> index_;
+        mutable std::shared_ptr<const MappedFile> file_;        // mapped on first point lookup
+        uint64_t min_seq_;                                      // sequence range of the entries and range tombstones
+        uint64_t max_seq_;
+        uint64_t file_size_;
+        uint64_t data_offset_;                                  // where the values start in the file
+        std::map<uint64_t, uint64_t> blob_bytes_;               // value bytes its entries point to, by value log file
+        explicit SmallSSTable(const SSTable<KEY, VALUE> &sstable);
+        typename std::vector<index_entry_t>::const_iterator Seek(const KEY &key) const;
+        bool HasRange(const KEY &min, const KEY &max) const;
     };
     typedef std::tuple<int, uint64_t, uint64_t, KEY, KEY> file_index_t;
-    typedef std::pair<file_index_t, uint32_t> item_index_t;
+    struct item_index_t
+    {
+        file_index_t file_;
+        uint32_t pos_;          // position of the entry in its file
+        ValueType type_;
+        uint64_t seq_;
+    };
+    typedef std::pair<file_index_t, range_tombstone_t> range_index_t;     // memtable tombstones are at level -1
+    // compaction work that ended in a level, flushes count as writes to level 0
+    struct LevelStats
+    {
+        uint64_t compactions_;
+        uint64_t trivial_moves_;
+        uint64_t bytes_read_;           // from the level above
+        uint64_t bytes_read_next_;      // from this level
+        uint64_t bytes_written_;
+        uint64_t files_written_;
+        uint64_t micros_;               // spent in compactions
+        LevelStats();
+    };
+    // the keys [min_key_, max_key_] of a compaction, merged on a thread of their own
+    struct Subcompaction
+    {
+        typename std::vector<std::pair<KEY, item_index_t>>::const_iterator begin_;
+        typename std::vector<std::pair<KEY, item_index_t>>::const_iterator end_;
+        KEY min_key_;
+        KEY max_key_;
+        std::vector<SmallSSTable> outputs_;
+        uint64_t records_dropped_;      // versions hidden by a newer one or a range tombstone
+        uint64_t tombstones_dropped_;   // deletions nothing below needed any more
+        uint64_t blob_bytes_relocated_; // live values moved out of value log files being collected
+        uint64_t blob_file_;            // the value log file they were moved to, 0 for none
+        uint64_t blob_bytes_written_;
+        int tid_;                       // of the trace
+        uint64_t start_micros_;
+        uint64_t end_micros_;
+        bool failed_;                   // an input could not be read or an output written, the compaction is abandoned
+        Subcompaction(): records_dropped_(0), tombstones_dropped_(0), blob_bytes_relocated_(0), blob_file_(0), blob_bytes_written_(0),
+                         tid_(0), start_micros_(0), end_micros_(0), failed_(false) {}
+    };
+    // the whole of one table read through the io backend, it must stay in place until FinishRead
+    struct FileRead
+    {
+        file_index_t file_;
+        int fd_;
+        std::vector<char> data_;
+        IOBackend::Request request_;
+        FileRead(): fd_(-1) {}
+    };
+    // what scans of one table last read, a scan starting where the last one stopped reads further ahead
+    struct Readahead
+    {
+        uint64_t next_offset_;          // where the last scan stopped
+        uint64_t window_;               // bytes read beyond what a scan needs, 0 while access looks random
+        uint64_t offset_;               // of data_ in the file
+        std::shared_ptr<const std::vector<char>> data_;
+        Readahead(): next_offset_(0), window_(0), offset_(0) {}
+    };
+    struct CompactionJob
+    {
+        std::vector<SmallSSTable*> files_;
+        int level_;
+        int output_level_;              // the level itself when runs inside it are merged
+        bool bottommost_;               // nothing older than the inputs is left outside them
+    };
+    // decides what to compact next, Compaction does the merge
+    class CompactionStrategy
+    {
+    public:
+        virtual ~CompactionStrategy() {}
+        virtual bool Pick(Memory &memory, CompactionJob &job) = 0;         // false if nothing needs a compaction
+    };
+    // a level is compacted into the next one once it outgrows its target
+    class LeveledStrategy : public CompactionStrategy
+    {
+    public:
+        bool Pick(Memory &memory, CompactionJob &job) override;
+    };
+    // level 0 is a stack of sorted runs, the files of one flush or compaction,
+    // and neighbouring runs of similar size are merged into one
+    class TieredStrategy : public CompactionStrategy
+    {
+    public:
+        bool Pick(Memory &memory, CompactionJob &job) override;
+    };
 
     SkipList<KEY, VALUE>* list_;
+    std::vector<range_tombstone_t> range_list_;         // memtable range tombstones
     std::list<std::pair<int, SmallSSTable>> buffer_;
+    uint64_t last_sequence_;
+    std::multiset<uint64_t> snapshots_;                 // sequences of the live snapshots
     int current_size_;
     int element_num_;
 
     std::string output_path_;
 
+    const Options options_;
     const int MAX_SIZE_;
     const int BLOOM_FILTER_SIZE_;
+    std::map<int, KEY> compact_pointer_;                // largest key compacted last at each level
+    std::vector<LevelStats> stats_;
+    std::unique_ptr<CompactionStrategy> strategy_;
+    std::unique_ptr<RateLimiter> limiter_;              // null without a rate limit
+    std::unique_ptr<IOBackend> io_;
+    mutable std::map<file_index_t, Readahead> readahead_;
+    mutable std::mutex readahead_mutex_;
+    std::ofstream manifest_;                            // one line per flush, compaction or move
+    mutable Statistics statistics_;
+    std::thread dump_thread_;                           // appends the statistics to LOG every stats_dump_period_sec
+    std::mutex dump_mutex_;
+    std::condition_variable dump_cv_;
+    bool stop_dump_;
+    std::unique_ptr<EventLogger> event_logger_;         // LOG, the events of flushes and compactions and the trace
+    uint64_t next_job_id_;                              // of the flushes, compactions and moves in the events
+    std::map<uint64_t, std::shared_ptr<const BlobFileReader>> blob_files_;     // the value log, by file number
+    mutable std::atomic<uint64_t> next_blob_file_;      // subcompactions take numbers too, from 1
+    static constexpr const char* TEMP_SUFFIX_ = ".tmp"; // outputs are written under this suffix and renamed once durable
 
-    bool NeedCompaction(int level) const;
+    int FileNum(int level) const;
+    uint64_t LevelBytes(int level) const;
+    uint64_t MaxBytesForLevel(int level) const;
+    double CompactionScore(int level) const;
+    int PickCompactionLevel() const;
+    void MaybeCompact();
+    LevelStats& Stats(int level);
+    bool MakeLevelDir(int level) const;
+    bool MoveFile(int level, SmallSSTable* table);
+    static Options SizeOptions(int max_size, int bloom_filter_size);
+    static Options SanitizeOptions(const Options &options);
     std::vector<std::string> Split(const std::string &str, char delim) const;
     void GetCompactionFiles(int level, std::vector<SmallSSTable*> &files_to_compaction);
-    uint64_t GetCompactionFilesRange(int level, uint64_t min, uint64_t max, std::vector<SmallSSTable*> &files_to_compaction);
-    void WriteToDisk(int level, std::vector<std::pair<KEY, VALUE>> &data);
+    uint64_t GetCompactionFilesRange(int level, const KEY &min, const KEY &max, std::vector<SmallSSTable*> &files_to_compaction);
+    uint64_t OverlappingBytes(int level, const KEY &min, const KEY &max) const;
+    void Throttle(uint64_t bytes, RateLimiter::Priority priority) const;
+    bool SyncPath(const std::string &path, bool is_dir) const;
+    std::string GetManifestName(const file_index_t &file_index) const;
+    bool InstallFiles(const std::vector<file_index_t> &files) const;
+    void RemoveOutputs(const std::vector<file_index_t> &files) const;
+    bool LogEdit(const std::vector<file_index_t> &added, const std::vector<file_index_t> &removed);
+    void AbandonEdit(const std::vector<file_index_t> &added);
+    bool WriteManifest();
+    void Recover();
+    bool WriteToDisk(int level, const SSTable<KEY, VALUE> &sstable);
+    file_index_t GetFileIndex(int level, const SmallSSTable* table) const;
+    std::string GetFilePath(const file_index_t &file_index) const;
+    void RemoveFile(const file_index_t &file_index) const;
+    bool IsBottommostLevel(int level) const;
+    uint64_t ReadSequence(const Snapshot* snapshot) const;
+    bool HasSnapshot(uint64_t begin, uint64_t end) const;
+    bool IsLive(uint64_t seq, uint64_t next_seq) const;
+    static uint64_t CoveringSequence(const std::vector<range_index_t> &range_tombstones, const KEY &key, uint64_t seq);
+    static void ClipRangeTombstones(const std::vector<range_index_t> &range_tombstones, KEY min, KEY max,
+                                    std::vector<range_tombstone_t> &clipped);
+    const SmallSSTable* FindNewestEntry(const KEY &key, uint64_t sequence, int &level, uint32_t &offset) const;
+    void CollectRangeTombstones(const std::vector<SmallSSTable*> &files, int level, std::vector<range_index_t> &range_tombstones,
+                                const std::set<const SmallSSTable*> *skip_files = nullptr) const;
+    void MarkCoveredFiles(const std::vector<SmallSSTable*> &files, int level, const std::vector<range_index_t> &range_tombstones,
+                          std::set<const SmallSSTable*> &covered_files) const;
     std::tuple<uint64_t, uint64_t, KEY, KEY> ReadHead(std::string filename) const;
-    void ReadFile(const file_index_t &file_index, std::vector<VALUE> &values, bool is_delete) const;
-    void Compaction(std::vector<SmallSSTable*> &files_to_compaction, int next_level);
+    bool SubmitRead(FileRead &read, uint64_t offset = 0, uint64_t length = UINT64_MAX) const;
+    void WaitRead(FileRead &read) const;
+    bool FinishRead(FileRead &read, std::vector<VALUE> &values) const;
+    void ReadScanRanges(const std::map<file_index_t, std::pair<uint64_t, uint64_t>> &ranges,
+                        std::map<file_index_t, std::pair<uint64_t, std::shared_ptr<const std::vector<char>>>> &file_bytes) const;
+    std::string BlobFilePath(uint64_t file_number) const;
+    std::unique_ptr<BlobFileWriter> NewBlobFile() const;
+    bool FinishBlobFile(BlobFileWriter &writer, RateLimiter::Priority priority) const;
+    void AddBlobFile(uint64_t file_number);
+    bool ReadBlob(std::string_view blob_index, PinnableValue *value) const;
+    void LoadBlobBytes(int level, SmallSSTable* table) const;
+    std::map<uint64_t, uint64_t> LiveBlobBytes() const;
+    std::set<uint64_t> CollectibleBlobFiles() const;
+    void CollectBlobGarbage();
+    void DeleteObsoleteBlobFiles();
+    bool SeparateValues(std::vector<typename SSTable<KEY, VALUE>::entry_t> &entries, uint64_t &blob_bytes);
+    void RunSubcompaction(Subcompaction &sub, const std::vector<range_index_t> &range_tombstones,
+                          const std::vector<range_index_t> &output_candidates, int output_level, bool bottommost,
+                          const std::set<uint64_t> &blob_victims) const;
+    bool Compaction(std::vector<SmallSSTable*> &files_to_compaction, int level, int output_level, bool bottommost);
     void MergeSort(typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge1_it,
                    const typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge1_end,
                    typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge2_it,
@@ -71,25 +263,55 @@ private:
                    std::vector<std::pair<KEY, item_index_t>> &target) const;
     void PackSmallSSTable(SmallSSTable* table, int level, std::vector<std::pair<KEY, item_index_t>> &table_package) const;
     void DeleteSmallSSTable(int level, SmallSSTable* table);
-    bool FindKey(KEY key, const SmallSSTable* table, uint32_t &offset) const;
+    bool FindKey(KEY key, uint64_t sequence, const SmallSSTable* table, uint32_t &offset) const;
+    bool ProbeTable(KEY key, uint64_t sequence, const SmallSSTable* table, uint32_t &offset) const;
     VALUE FindValue(int level, const SmallSSTable* table, uint32_t offset) const;
-    void PackSmallSSTableRange(std::vector<std::pair<int, const SmallSSTable*>> &tables, uint64_t min,
-                               uint64_t max, std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package) const;
-    void ScanBuffer(uint64_t min, uint64_t max,
+    bool PinValue(int level, const SmallSSTable* table, uint32_t offset, PinnableValue *value) const;
+    void PackSmallSSTableRange(std::vector<std::pair<int, const SmallSSTable*>> &tables, const KEY &min,
+                               const KEY &max, uint64_t sequence, std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package) const;
+    void ScanBuffer(const KEY &min, const KEY &max,
                     std::vector<std::pair<int, const SmallSSTable*>> &files_to_scan) const;
     void Merge(std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package,
                std::vector<std::pair<KEY, item_index_t>> &merge_result) const;
     void ReorganizeScanResult(std::vector<std::pair<KEY, item_index_t>> &files_data,
+                              const std::vector<KEY> &deleted_keys,
+                              const std::vector<range_index_t> &range_tombstones,
+                              const std::map<file_index_t, const SmallSSTable*> &tables,
+                              uint64_t sequence,
                               std::list<std::pair<KEY, VALUE>> &list) const;
     bool Exist(const KEY &key) const;
+    DelResult FindInMemTable(const KEY &key, uint64_t sequence, const VALUE* &value) const;
+    bool TimedLookup(const KEY &key, PinnableValue *value, const VALUE* &mem_value, const Snapshot* snapshot) const;
+    bool Lookup(const KEY &key, PinnableValue *value, const VALUE* &mem_value, const Snapshot* snapshot) const;
+    void Write(KEY key, VALUE &&value, ValueType type);
+    bool Flush();
+    void DumpStats() const;
+    void DumpStatsPeriodically();
+    Statistics* StageStatistics() const;
+    uint64_t* PerfNanos(uint64_t PerfContext::*field) const;
+    void PerfCount(uint64_t PerfContext::*field, uint64_t count = 1) const;
+    friend class MemoryBench;       // the microbenchmarks of bench/micro_bench.cpp time the helpers above
 public:
     Memory(std::string output_path, int max_size = 2 * 1024 * 1024, int bloom_filter_size = 10240);
+    Memory(std::string output_path, const Options &options);
     ~Memory();
-    void Put(KEY key, VALUE value);
-    VALUE Get(const KEY &key) const;
+    void Put(KEY key, const VALUE &value);
+    void Put(KEY key, VALUE &&value);
+    const Snapshot* GetSnapshot();
+    void ReleaseSnapshot(const Snapshot* snapshot);
+    VALUE Get(const KEY &key, const Snapshot* snapshot = nullptr) const;
+    bool Get(const KEY &key, PinnableValue *value, const Snapshot* snapshot = nullptr) const;
+    bool Get(const KEY &key, VALUE *value, const Snapshot* snapshot = nullptr) const;
     bool Del(const KEY &key);
+    DelResult Del(const KEY &key, DelMode mode);
+    void DelRange(const KEY &key1, const KEY &key2);
     void Reset();
-    void Scan(const KEY &key1, const KEY &key2, std::list<std::pair<KEY, VALUE>> &list) const;
+    std::string GetCompactionStats() const;
+    std::string GetStats() const;
+    bool GetProperty(const std::string &name, std::string *value) const;
+    const Statistics& GetStatistics() const { return statistics_; }
+    void Scan(const KEY &key1, const KEY &key2, std::list<std::pair<KEY, VALUE>> &list,
+              const Snapshot* snapshot = nullptr) const;
 };
 
 #endif // MEMORY_H
@@ -0,0 +1,92 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <cstdint>
+#include <string>
+
+// how del treats a key that may not exist
+enum DelMode
+{
+    DEL_EXACT,          // look the key up first (memtable, bloom filters and indexes, never values)
+    DEL_BLIND           // write the tombstone without any lookup on disk
+};
+
+enum DelResult
+{
+    DEL_NOT_FOUND,
+    DEL_FOUND,
+    DEL_UNKNOWN         // blind delete of a key the memtable knows nothing about
+};
+
+// which file of a level a compaction takes
+enum CompactionPick
+{
+    PICK_ROUND_ROBIN,   // the file after the one compacted last, cycling through the key space
+    PICK_MIN_OVERLAP    // the file overlapping the fewest bytes of the next level for its size
+};
+
+enum CompactionStyle
+{
+    COMPACTION_LEVELED,         // every level is kept under a size target, low read and space amplification
+    COMPACTION_TIERED           // sorted runs of similar size are merged together, low write amplification
+};
+
+// how flushes and compactions make their files durable before they are installed
+enum SyncMode
+{
+    SYNC_NONE,          // files are renamed into place and logged, the page cache writes them back
+    SYNC_DATA,          // fdatasync the files and the manifest, fsync the directories
+    SYNC_FULL           // fsync everything
+};
+
+enum IOBackendType
+{
+    IO_URING,           // reads are queued to the kernel through io_uring
+    IO_THREAD_POOL      // reads are done by a pool of threads with pread
+};
+
+struct Options
+{
+    int write_buffer_size;                  // memtable bytes that trigger a flush
+    int target_file_size;                   // bytes of a compaction output file, raised to bloom_filter_size + 4096
+    int bloom_filter_size;
+    int level0_compaction_trigger;          // level 0 files that start a compaction
+    uint64_t max_bytes_for_level_base;      // target size of level 1
+    int max_bytes_for_level_multiplier;     // each level below is this many times larger
+    CompactionPick compaction_pick;
+    CompactionStyle compaction_style;
+    int tiered_size_ratio;                  // percent a run may outgrow the runs newer than it and still be merged with them
+    int tiered_min_merge_width;             // fewest runs merged by size ratio
+    int tiered_max_runs;                    // sorted runs allowed before a tiered compaction
+    int max_subcompactions;                 // threads one compaction is split across by key range
+    int64_t rate_limit_bytes_per_sec;       // flush and compaction writes and compaction reads, 0 for no limit
+    bool rate_limit_auto_tune;              // lower the rate while foreground gets are slower than the target
+    uint64_t rate_limit_latency_target_us;
+    SyncMode sync_mode;
+    bool use_direct_writes;                 // write sstables with O_DIRECT where the file system takes it
+    IOBackendType io_backend;               // for the table reads of scans and compactions
+    int io_queue_depth;                     // reads one backend keeps in flight
+    uint64_t scan_readahead_size;           // largest readahead a sequential scan of a table grows to, 0 turns it off
+    unsigned int stats_dump_period_sec;     // append the statistics to LOG this often, 0 turns it off
+    bool stage_timing_histograms;           // time the stages of every get, write and scan, not only the whole
+    uint64_t max_log_file_size;             // LOG is moved to LOG.old.<micros> past this size, 0 never moves it
+    int keep_log_file_num;                  // old logs kept
+    std::string trace_path;                 // write flushes and compactions here as a Chrome trace, empty for none
+    uint64_t min_blob_size;                 // values at least this large go to value log files, 0 keeps them all in tables
+    double blob_gc_garbage_ratio;           // a value log file this much garbage has its live values moved, above 1 never
+    Options():
+        write_buffer_size(2 * 1024 * 1024), target_file_size(2 * 1024 * 1024), bloom_filter_size(10240),
+        level0_compaction_trigger(4), max_bytes_for_level_base(10 * 1024 * 1024), max_bytes_for_level_multiplier(10),
+        compaction_pick(PICK_MIN_OVERLAP), compaction_style(COMPACTION_LEVELED), tiered_size_ratio(1),
+        tiered_min_merge_width(2), tiered_max_runs(8), max_subcompactions(1),
+        rate_limit_bytes_per_sec(0), rate_limit_auto_tune(false), rate_limit_latency_target_us(1000),
+        sync_mode(SYNC_DATA), use_direct_writes(false),
+        io_backend(IO_URING), io_queue_depth(8), scan_readahead_size(1024 * 1024),
+        stats_dump_period_sec(0), stage_timing_histograms(false), max_log_file_size(16 * 1024 * 1024),
+        keep_log_file_num(10), min_blob_size(0), blob_gc_garbage_ratio(0.5)
+    {
+
+    }
+};
+
+#endif // OPTIONS_H
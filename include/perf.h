@@ -0,0 +1,99 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+#include "statistics.h"
+
+// how much of an operation the calling thread's perf context breaks down
+enum PerfLevel
+{
+    PERF_DISABLE,
+    PERF_ENABLE_COUNT,                  // counts only, no clock is read
+    PERF_ENABLE_TIME                    // counts and the nanoseconds of each stage
+};
+
+// what the operations of one thread cost, stage by stage, since the last Reset;
+// the nanos stay 0 unless the library is built with LSMKV_PERF_TIMING
+struct PerfContext
+{
+    uint64_t get_tables_probed;
+    uint64_t bloom_filter_useful;
+    uint64_t bloom_filter_positive;
+    uint64_t bloom_filter_false_positive;
+    uint64_t get_read_bytes;
+    uint64_t scan_tables_read;
+    uint64_t scan_read_bytes;
+    uint64_t get_memtable_nanos;
+    uint64_t get_bloom_nanos;
+    uint64_t get_find_key_nanos;
+    uint64_t get_read_nanos;            // values are mapped, a cold value faults in when its bytes are first touched
+    uint64_t write_memtable_nanos;
+    uint64_t scan_memtable_nanos;
+    uint64_t scan_index_nanos;
+    uint64_t scan_merge_nanos;
+    uint64_t scan_read_nanos;
+    uint64_t flush_nanos;               // flushes and compactions the writes of this thread set off
+    uint64_t compaction_nanos;
+    PerfContext();
+    void Reset();
+    std::string ToString() const;       // "name = value" of the fields that are not 0, comma separated
+};
+
+void SetPerfLevel(PerfLevel level);
+PerfLevel GetPerfLevel();
+PerfContext* GetPerfContext();          // of the calling thread
+
+// times a stage into a histogram, a perf context field, or both; either may be null, and with
+// both null, or without LSMKV_PERF_TIMING, it reads no clock and compiles down to nothing
+class StageTimer
+{
+#if defined(LSMKV_PERF_TIMING)
+private:
+    Statistics* statistics_;
+    HistogramType type_;
+    uint64_t* perf_nanos_;
+    std::chrono::steady_clock::time_point start_;
+public:
+    StageTimer(Statistics* statistics, HistogramType type, uint64_t* perf_nanos):
+        statistics_(statistics), type_(type), perf_nanos_(perf_nanos)
+    {
+        if (statistics_ != nullptr || perf_nanos_ != nullptr)
+        {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+    ~StageTimer()
+    {
+        Stop();
+    }
+    void Stop()
+    {
+        if (statistics_ == nullptr && perf_nanos_ == nullptr)
+        {
+            return;
+        }
+        uint64_t nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start_).count();
+        if (statistics_ != nullptr)
+        {
+            statistics_->RecordTime(type_, nanos);
+        }
+        if (perf_nanos_ != nullptr)
+        {
+            *perf_nanos_ += nanos;
+        }
+        statistics_ = nullptr;
+        perf_nanos_ = nullptr;
+    }
+#else
+public:
+    StageTimer(Statistics*, HistogramType, uint64_t*) {}
+    void Stop() {}
+#endif
+    StageTimer(const StageTimer &) = delete;
+    StageTimer& operator = (const StageTimer &) = delete;
+};
+
+#endif // PERF_H
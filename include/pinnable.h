@@ -0,0 +1,38 @@
+#ifndef PINNABLE_H
+#define PINNABLE_H
+
+#include <string>
+#include <string_view>
+#include <memory>
+
+/*
+ * Result of a zero-copy lookup. The value either points into a region
+ * owned by somebody else (an mmap-ed sstable) which is kept alive by pin_,
+ * or into the handle's own buffer when the source could not be pinned
+ * (e.g. memtable nodes, which are overwritten in place).
+ */
+class PinnableValue
+{
+private:
+    std::string self_;
+    std::string_view data_;
+    std::shared_ptr<const void> pin_;
+public:
+    PinnableValue();
+    PinnableValue(const PinnableValue &) = delete;
+    PinnableValue& operator = (const PinnableValue &) = delete;
+    PinnableValue(PinnableValue &&other);
+    PinnableValue& operator = (PinnableValue &&other);
+    void Pin(std::string_view data, std::shared_ptr<const void> pin);
+    void PinSelf(const std::string &data);
+    void PinSelf(std::string &&data);
+    void Reset();
+    bool IsPinned() const { return pin_ != nullptr; }
+    std::string_view view() const { return data_; }
+    const char* data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+    bool empty() const { return data_.empty(); }
+    std::string ToString() const { return std::string(data_); }
+};
+
+#endif // PINNABLE_H
@@ -0,0 +1,51 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+
+#include <cstdint>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+// token bucket shared by flushes and compactions, foreground reads never pass through it
+class RateLimiter
+{
+public:
+    enum Priority
+    {
+        IO_LOW,         // compaction
+        IO_HIGH,        // flush, served before any waiting compaction
+        IO_TOTAL
+    };
+private:
+    typedef std::chrono::steady_clock clock_t;
+    const int64_t max_bytes_per_sec_;
+    const int64_t refill_period_us_;
+    const bool auto_tune_;
+    const uint64_t latency_target_us_;
+    int64_t bytes_per_sec_;
+    int64_t available_bytes_;
+    clock_t::time_point next_refill_;
+    int high_waiting_;
+    double latency_us_;                         // moving average of foreground latency
+    uint64_t total_bytes_[IO_TOTAL];
+    uint64_t total_requests_[IO_TOTAL];
+    uint64_t throttled_us_[IO_TOTAL];
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    int64_t RefillBytes() const;
+    void Refill(clock_t::time_point now);
+    void Tune();
+public:
+    RateLimiter(int64_t bytes_per_sec, bool auto_tune = false, uint64_t latency_target_us = 1000,
+                int64_t refill_period_us = 100 * 1000);
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter& operator = (const RateLimiter &) = delete;
+    void Request(int64_t bytes, Priority priority);     // blocks until the bytes may be written
+    void RecordForegroundLatency(uint64_t micros);      // only used when auto-tuned
+    int64_t GetBytesPerSecond() const;
+    uint64_t GetTotalBytes(Priority priority) const;
+    uint64_t GetTotalRequests(Priority priority) const;
+    uint64_t GetThrottledMicros(Priority priority) const;
+};
+
+#endif // RATELIMITER_H
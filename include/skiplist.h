@@ -6,14 +6,28 @@
 #include <string>
 #include <iostream>
 #include <list>
+#include "valuetype.h"
+#include "keytraits.h"
+#include "valuetraits.h"
 
-#define MAX_LEVEL 8
+// a node rises a level with probability 1/BRANCHING, so MAX_LEVEL keeps searches logarithmic up to some
+// BRANCHING^MAX_LEVEL entries, far more than a memtable of the smallest fixed-width entries holds
+#define MAX_LEVEL 12
+#define BRANCHING 4
 
 
 
 template <class KEY, class VALUE>
 class SkipList
 {
+public:
+    // a value replaced while a snapshot can still see it
+    struct Version
+    {
+        VALUE val;
+        ValueType vtype;
+        uint64_t seq;
+    };
 private:
     enum SKNodeType
     {
@@ -26,23 +40,57 @@ private:
     {
         KEY key;
         VALUE val;
+        ValueType vtype;
+        uint64_t seq;
+        std::vector<Version> older;         // ascending sequence, all below seq
         int height;
         SKNodeType type;
-        std::vector<SKNode*> forwards;
-        SKNode(KEY _key, VALUE _val,int level,std::vector<SKNode*> &backward,std::vector<SKNode*> &forward);
+        SKNode* forwards[MAX_LEVEL];
+        SKNode(KEY _key, VALUE &&_val, ValueType _vtype, uint64_t _seq, int level, SKNode** backward, SKNode** forward);
         SKNode(KEY _key, VALUE _val, SKNodeType _type);
     };
+    static constexpr size_t NODES_PER_BLOCK = 1024;
 
     SKNode *head;
     SKNode *nil;
     unsigned long long s = 1;
+    // nodes are carved out of blocks kept from one Reset to the next, so once the first memtable has grown
+    // a put allocates nothing but what its key and value do; a deleted node's room is reused after Reset
+    std::vector<char*> blocks_;
+    size_t next_block_;
+    size_t next_node_;                      // in the block before next_block_
+    void* AllocateNode();
     double MyRand();
     int RandomLevel();
+    static const VALUE* FindVersion(const SKNode* node, uint64_t snapshot, ValueType &type, uint64_t &seq);
+    // nil lies past every key, no key value is reserved for it
+    static bool Precedes(const SKNode* node, const KEY &key) { return node->type != NIL && node->key < key; }
+    static bool Holds(const SKNode* node, const KEY &key) { return node->type == NORMAL && node->key == key; }
 
 public:
+    // walks the bottom level in key order, values are read in place
+    class Iterator
+    {
+    private:
+        const SKNode* node_;
+    public:
+        explicit Iterator(const SKNode* node);
+        bool Valid() const;
+        void Next();
+        const KEY& Key() const;
+        const VALUE& Value() const;
+        ValueType Type() const;
+        uint64_t Sequence() const;
+        const std::vector<Version>& Older() const;
+        const VALUE* Find(uint64_t snapshot, ValueType &type, uint64_t &seq) const;
+    };
+
     SkipList();
-    int Insert(const KEY &key, const VALUE &value);
-    VALUE Search(const KEY &key) const;
+    int Insert(const KEY &key, const VALUE &value, ValueType type = TYPE_VALUE, uint64_t seq = 0, uint64_t snapshot = 0);
+    int Insert(const KEY &key, VALUE &&value, ValueType type = TYPE_VALUE, uint64_t seq = 0, uint64_t snapshot = 0);
+    Iterator Begin() const;
+    Iterator Seek(const KEY &key) const;
+    const VALUE* Find(const KEY &key, ValueType &type, uint64_t &seq, uint64_t snapshot = UINT64_MAX) const;
     bool Exist(const KEY &key) const;
     bool SetDelete(const KEY &key);
     void Delete(const KEY &key);
@@ -0,0 +1,16 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+
+// every write takes the next sequence number, a snapshot sees the writes up to its own
+class Snapshot
+{
+private:
+    uint64_t sequence_;
+public:
+    explicit Snapshot(uint64_t sequence): sequence_(sequence) {}
+    uint64_t sequence() const { return sequence_; }
+};
+
+#endif // SNAPSHOT_H
@@ -12,37 +12,95 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #endif
+#include <tuple>
+#include <string>
 #include "bloomfilter.h"
 #include "skiplist.h"
+#include "valuetype.h"
+#include "keytraits.h"
+#include "valuetraits.h"
 
 template <class KEY, class VALUE>
 class SSTable
 {
-private:
+public:
     struct Head
     {
         uint64_t timestamp_;
         uint64_t length_;
         KEY max_ele_key_;
         KEY min_ele_key_;
+        uint64_t range_length_;         // number of range tombstones
         Head()
         {
             timestamp_ = 0;
             length_ = 0;
-            max_ele_key_ = 0;
-            min_ele_key_ = UINT64_MAX;
+            max_ele_key_ = KEY();           // both are set by the first entry or tombstone
+            min_ele_key_ = KEY();
+            range_length_ = 0;
         }
     };
+    // deletes every entry in [begin_, end_] written before seq_
+    struct RangeTombstone
+    {
+        KEY begin_;
+        KEY end_;
+        uint64_t seq_;
+        bool Covers(const KEY &key) const { return begin_ <= key && key <= end_; }
+    };
+    struct IndexEntry
+    {
+        KEY key_;
+        uint32_t offset_;
+        ValueType type_;
+        uint64_t seq_;
+    };
+    // a fixed-width value is at sizeof(VALUE) times the position of its entry, the index leaves it out
+    static constexpr uint64_t OFFSET_SIZE = ValueTraits<VALUE>::FIXED_WIDTH? 0 : sizeof(uint32_t);
+    // key, offset, type and sequence of one index entry as laid out in the file, versions of a key are
+    // stored newest first; a prefix compressed key takes at most this much
+    static uint64_t IndexEntrySize(const KEY &key)
+    {
+        return KeyTraits<KEY>::IndexKeySize(KEY(), key) + OFFSET_SIZE + sizeof(uint8_t) + sizeof(uint64_t);
+    }
+    static uint64_t RangeTombstoneSize(const RangeTombstone &range)
+    {
+        return KeyTraits<KEY>::EncodedSize(range.begin_) + KeyTraits<KEY>::EncodedSize(range.end_) + sizeof(uint64_t);
+    }
+    typedef std::tuple<KEY, VALUE, ValueType, uint64_t> entry_t;
+private:
     Head header_;
     BloomFilter<KEY> filter_;
-    std::vector<std::pair<KEY, uint32_t>> index_;
-    std::vector<VALUE> data_; 
-    int makedir(std::string dir_name);
+    std::vector<RangeTombstone> range_tombstones_;
+    std::vector<IndexEntry> index_;
+    std::vector<const VALUE*> data_;                    // borrowed from the source, which must outlive SSTableOut,
+                                                        // empty for a table read back by SSTableIn
+    uint64_t data_size_;
+    uint64_t range_size_;                               // bytes of the range tombstones in the file
+    uint64_t index_size_;                               // and of the index
+    int makedir(std::string dir_name) const;
+    char* Serialize(char* pos) const;
+    void Append(const KEY &key, const VALUE &value, ValueType type, uint64_t seq, uint32_t &pos);
+    void AppendRangeTombstones(const std::vector<RangeTombstone> &range_tombstones);
 public:
     static int timestamp_;
-    SSTable(const std::vector<std::pair<KEY, VALUE>> &data, int bloom_filter_size);
+    explicit SSTable(int bloom_filter_size);
+    SSTable(const std::vector<entry_t> &data, const std::vector<RangeTombstone> &range_tombstones,
+            int bloom_filter_size);
+    SSTable(const SkipList<KEY, VALUE> &list, const std::vector<RangeTombstone> &range_tombstones,
+            int bloom_filter_size);
+    static std::string FileName(uint64_t timestamp, uint64_t length, const KEY &max_ele_key, const KEY &min_ele_key);
+    static uint64_t Deserialize(const char* data, uint64_t size, int bloom_filter_size, Head &header, const char* &filter,
+                                std::vector<RangeTombstone> &range_tombstones, std::vector<IndexEntry> &index);
+    uint64_t DataOffset() const;
+    uint64_t FileSize() const;
     ~SSTable();
-    bool SSTableOut(std::string output_path);          // if success, return true
+    const Head& header() const { return header_; }
+    const BloomFilter<KEY>& filter() const { return filter_; }
+    const std::vector<RangeTombstone>& range_tombstones() const { return range_tombstones_; }
+    const std::vector<IndexEntry>& index() const { return index_; }
+    bool SSTableOut(std::string output_path, const std::string &suffix = "", bool direct = false) const;    // if success, return true
+    bool SSTableIn(const std::string &filename);        // everything but the values, if success, return true
 };
 
 template <class KEY, class VALUE>
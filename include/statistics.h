@@ -0,0 +1,99 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <mutex>
+#include "histogram.h"
+
+enum Ticker
+{
+    GET_COUNT,
+    GET_FOUND,
+    GET_MEMTABLE_HIT,                   // answered by the memtable, found or deleted
+    GET_TABLES_PROBED,                  // tables whose bloom filter a lookup consulted
+    GET_BYTES_READ,                     // value bytes returned from tables
+    BLOOM_FILTER_USEFUL,                // the filter ruled the table out
+    BLOOM_FILTER_POSITIVE,
+    BLOOM_FILTER_FALSE_POSITIVE,        // passed the filter, but the index has no visible version
+    SCAN_COUNT,
+    SCAN_TABLES_READ,
+    SCAN_KEYS_RETURNED,
+    SCAN_BYTES_READ,                    // bytes read from table files, readahead included
+    PUT_COUNT,
+    DELETE_COUNT,
+    RANGE_DELETE_COUNT,
+    BYTES_WRITTEN,                      // keys and values handed to the memtable
+    FLUSH_COUNT,
+    FLUSH_BYTES_WRITTEN,
+    COMPACTION_COUNT,
+    COMPACTION_TRIVIAL_MOVES,
+    COMPACTION_BYTES_READ,
+    COMPACTION_BYTES_WRITTEN,
+    BLOB_BYTES_WRITTEN,                 // value log files of flushes and of compactions moving live values
+    BLOB_BYTES_READ,                    // values read from value log files
+    BLOB_GC_BYTES_RELOCATED,            // live values moved out of value log files that were mostly garbage
+    BLOB_FILES_DELETED,
+    BACKGROUND_ERRORS,                  // flushes and compactions abandoned on an I/O error, their inputs kept
+    TICKER_TOTAL
+};
+
+// latencies in nanoseconds; the stage histograms are only kept with Options::stage_timing_histograms
+enum HistogramType
+{
+    DB_GET_NANOS,
+    DB_WRITE_NANOS,                     // puts and deletes, a flush or compaction they set off included
+    DB_SCAN_NANOS,
+    FLUSH_NANOS,                        // building and writing the table of a memtable
+    COMPACTION_NANOS,
+    GET_MEMTABLE_NANOS,
+    GET_BLOOM_NANOS,                    // one table's filter, the perf context sums them per get
+    GET_FIND_KEY_NANOS,                 // one table's index
+    GET_READ_NANOS,                     // opening and mapping the file of the value
+    WRITE_MEMTABLE_NANOS,
+    SCAN_MEMTABLE_NANOS,
+    SCAN_INDEX_NANOS,                   // choosing the tables and cutting their index to the range
+    SCAN_MERGE_NANOS,
+    SCAN_READ_NANOS,                    // reading and decoding the values
+    HISTOGRAM_TOTAL
+};
+
+// counters bumped on the hot paths; a thread adds to one of a few stripes of its own cache lines,
+// so threads do not contend, and reading a ticker sums the stripes;
+// a histogram is too large to stripe, each has a lock of its own
+class Statistics
+{
+private:
+    static const int STRIPES_ = 16;
+    struct alignas(64) Stripe
+    {
+        std::atomic<uint64_t> tickers_[TICKER_TOTAL];
+    };
+    Stripe stripes_[STRIPES_];
+    struct alignas(64) HistogramSlot
+    {
+        mutable std::mutex mutex_;
+        Histogram histogram_;
+    };
+    HistogramSlot histograms_[HISTOGRAM_TOTAL];
+    static int StripeIndex();
+public:
+    Statistics();
+    Statistics(const Statistics &) = delete;
+    Statistics& operator = (const Statistics &) = delete;
+    void Record(Ticker ticker, uint64_t count = 1)
+    {
+        stripes_[StripeIndex()].tickers_[ticker].fetch_add(count, std::memory_order_relaxed);
+    }
+    void RecordTime(HistogramType type, uint64_t nanos);
+    uint64_t Get(Ticker ticker) const;
+    Histogram GetHistogram(HistogramType type) const;
+    void Reset();
+    std::string ToString() const;               // one "name COUNT : n" line per ticker, then one line per histogram
+    std::string ToString(HistogramType type) const;     // "name P50 : .. P95 : .. P99 : .. P100 : .. COUNT : .. SUM : .."
+    static const char* Name(Ticker ticker);     // e.g. "lsmkv.get.count"
+    static const char* Name(HistogramType type);        // e.g. "lsmkv.db.get.nanos"
+};
+
+#endif // STATISTICS_H
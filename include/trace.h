@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <chrono>
+
+enum TraceType
+{
+    TRACE_PUT = 1,
+    TRACE_GET,
+    TRACE_DELETE,
+    TRACE_DELETE_RANGE,
+    TRACE_SCAN
+};
+
+struct TraceRecord
+{
+    TraceType type_;
+    uint64_t micros_;               // since the trace began
+    uint64_t key_;                  // the first key of a range
+    uint64_t arg_;                  // value size of a put, last key of a range, 0 otherwise
+};
+
+// a trace file is TRACE_MAGIC, a version byte and the wall clock micros it began at, then one record per
+// operation: the type byte and varints of the micros since the previous record, the key and the arg;
+// values are not kept, a put records only the size of its value
+class TraceWriter
+{
+private:
+    std::ofstream out_;
+    std::chrono::steady_clock::time_point start_;
+    uint64_t last_micros_;
+    std::mutex mutex_;
+    TraceWriter();
+public:
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter& operator = (const TraceWriter &) = delete;
+    static std::unique_ptr<TraceWriter> Open(const std::string &filename);     // nullptr if failed
+    void Record(TraceType type, uint64_t key, uint64_t arg = 0);
+    bool Close();
+};
+
+class TraceReader
+{
+private:
+    std::ifstream in_;
+    uint64_t start_time_micros_;
+    uint64_t micros_;
+    TraceReader();
+    bool ReadVarint(uint64_t &value);
+public:
+    static std::unique_ptr<TraceReader> Open(const std::string &filename);     // nullptr if failed or not a trace
+    bool Next(TraceRecord &record);                                             // false at the end
+    uint64_t start_time_micros() const { return start_time_micros_; }
+    static const char* Name(TraceType type);
+};
+
+#endif // TRACE_H
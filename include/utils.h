@@ -14,6 +14,7 @@
 #if defined(__linux__) || defined(__MINGW32__) || defined(__APPLE__)
 #include <dirent.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <cstring>
 #endif
 
@@ -104,7 +105,7 @@ namespace utils{
 
         while (std::getline(ss, dirName, '/')){
             currentPath += dirName;
-            if (!dirExists(currentPath) && _mkdir(currentPath.c_str()) != 0){
+            if (!dirName.empty() && !dirExists(currentPath) && _mkdir(currentPath.c_str()) != 0){
                 return -1;
             }
             currentPath += "/";
@@ -138,6 +139,30 @@ namespace utils{
         #endif
     }
 
+    /**
+     * Flush a file or directory to stable storage
+     * @param path file or directory to be synced.
+     * @param data_only skip metadata not needed to read the data back.
+     * @return 0 if synced successfully, -1 otherwise.
+     */
+    static inline int syncPath(const char *path, bool data_only){
+        #ifdef _WIN32
+            return 0;
+        #else
+            int fd = ::open(path, O_RDONLY);
+            if (fd == -1){
+                return -1;
+            }
+            #if defined(__APPLE__)
+                int ret = ::fsync(fd);
+            #else
+                int ret = data_only ? ::fdatasync(fd) : ::fsync(fd);
+            #endif
+            ::close(fd);
+            return ret;
+        #endif
+    }
+
 
     
 }
@@ -0,0 +1,62 @@
+#ifndef VALUETRAITS_H
+#define VALUETRAITS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <sstream>
+#include <iomanip>
+#include <type_traits>
+
+// how the engine stores values. A trivially copyable value is held in the memtable node itself and takes
+// sizeof(VALUE) bytes in a table, a tombstone too, so the data of a table has a fixed stride and the index
+// stores no offsets
+template <class VALUE>
+struct ValueTraits
+{
+    static_assert(std::is_trivially_copyable<VALUE>::value, "a value is a std::string or trivially copyable");
+    static constexpr bool FIXED_WIDTH = true;
+    static size_t Size(const VALUE &) { return sizeof(VALUE); }
+    static const char* Data(const VALUE &value) { return (const char*)&value; }
+    static std::string_view Bytes(const VALUE &value) { return std::string_view((const char*)&value, sizeof(VALUE)); }
+    // the bytes a table holds for the value, zero filled if there are too few
+    static VALUE FromBytes(std::string_view bytes)
+    {
+        VALUE value;
+        memset(&value, 0, sizeof(VALUE));
+        memcpy(&value, bytes.data(), (bytes.size() < sizeof(VALUE))? bytes.size() : sizeof(VALUE));
+        return value;
+    }
+    static std::string Display(const VALUE &value)
+    {
+        std::ostringstream out;
+        if constexpr (std::is_arithmetic<VALUE>::value)
+        {
+            out << value;
+        }
+        else
+        {
+            out << std::hex << std::setfill('0');
+            for (size_t i = 0; i < sizeof(VALUE); ++i)
+            {
+                out << std::setw(2) << (unsigned)((const unsigned char*)&value)[i];
+            }
+        }
+        return out.str();
+    }
+};
+
+// a value of any size, offsets into the data of a table are stored in its index
+template <>
+struct ValueTraits<std::string>
+{
+    static constexpr bool FIXED_WIDTH = false;
+    static size_t Size(const std::string &value) { return value.length(); }
+    static const char* Data(const std::string &value) { return value.data(); }
+    static std::string_view Bytes(const std::string &value) { return value; }
+    static std::string FromBytes(std::string_view bytes) { return std::string(bytes); }
+    static const std::string& Display(const std::string &value) { return value; }
+};
+
+#endif // VALUETRAITS_H
@@ -0,0 +1,15 @@
+#ifndef VALUETYPE_H
+#define VALUETYPE_H
+
+#include <cstdint>
+
+// tag stored with every memtable node and sstable index entry, tombstones carry no value bytes;
+// a blob index is only found in tables, its bytes say where in the value log the value is
+enum ValueType : uint8_t
+{
+    TYPE_DELETION = 0,
+    TYPE_VALUE = 1,
+    TYPE_BLOB_INDEX = 2
+};
+
+#endif // VALUETYPE_H
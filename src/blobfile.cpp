@@ -0,0 +1,107 @@
+#include "blobfile.h"
+#include <cstring>
+#include <iostream>
+
+static const uint64_t BLOB_MAGIC = 0x424f4c42564b534cULL;      // "LSKVBLOB"
+static const uint64_t FOOTER_SIZE = sizeof(uint64_t) * 3;
+
+std::string BlobIndex::Encode() const
+{
+    std::string data(ENCODED_SIZE, '\0');
+    memcpy(&data[0], &file_number_, sizeof(uint64_t));
+    memcpy(&data[sizeof(uint64_t)], &offset_, sizeof(uint64_t));
+    memcpy(&data[sizeof(uint64_t) * 2], &size_, sizeof(uint64_t));
+    return data;
+}
+
+bool BlobIndex::Decode(std::string_view data)
+{
+    if (data.size() != ENCODED_SIZE)
+    {
+        return false;
+    }
+    memcpy(&file_number_, data.data(), sizeof(uint64_t));
+    memcpy(&offset_, data.data() + sizeof(uint64_t), sizeof(uint64_t));
+    memcpy(&size_, data.data() + sizeof(uint64_t) * 2, sizeof(uint64_t));
+    return true;
+}
+
+BlobFileWriter::BlobFileWriter(uint64_t file_number):
+    file_number_(file_number), offset_(0), records_(0), value_bytes_(0)
+{
+
+}
+
+std::unique_ptr<BlobFileWriter> BlobFileWriter::Open(const std::string &filename, uint64_t file_number)
+{
+    std::unique_ptr<BlobFileWriter> writer(new BlobFileWriter(file_number));
+    writer->out_.open(filename, std::ios::binary | std::ios::trunc);
+    if (!writer->out_.is_open())
+    {
+        std::cerr << "Failed to open file " << filename << "\n";
+        return nullptr;
+    }
+    return writer;
+}
+
+BlobIndex BlobFileWriter::Add(std::string_view key, std::string_view value)
+{
+    uint32_t key_size = key.size();
+    uint64_t value_size = value.size();
+    out_.write((const char*)&key_size, sizeof(uint32_t));
+    out_.write((const char*)&value_size, sizeof(uint64_t));
+    out_.write(key.data(), key.size());
+    out_.write(value.data(), value.size());
+    offset_ += sizeof(uint32_t) + sizeof(uint64_t) + key.size();
+    BlobIndex index{file_number_, offset_, value_size};
+    offset_ += value_size;
+    ++records_;
+    value_bytes_ += value_size;
+    return index;
+}
+
+bool BlobFileWriter::Finish()
+{
+    out_.write((const char*)&records_, sizeof(uint64_t));
+    out_.write((const char*)&value_bytes_, sizeof(uint64_t));
+    out_.write((const char*)&BLOB_MAGIC, sizeof(uint64_t));
+    offset_ += FOOTER_SIZE;
+    out_.close();
+    return !out_.fail();
+}
+
+BlobFileReader::BlobFileReader():
+    records_(0), value_bytes_(0)
+{
+
+}
+
+std::shared_ptr<const BlobFileReader> BlobFileReader::Open(const std::string &filename)
+{
+    std::shared_ptr<BlobFileReader> reader(new BlobFileReader());
+    reader->file_ = MappedFile::Open(filename);
+    uint64_t magic = 0;
+    if (reader->file_ != nullptr && reader->file_->size() >= FOOTER_SIZE)
+    {
+        const char* footer = reader->file_->data() + reader->file_->size() - FOOTER_SIZE;
+        memcpy(&reader->records_, footer, sizeof(uint64_t));
+        memcpy(&reader->value_bytes_, footer + sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&magic, footer + sizeof(uint64_t) * 2, sizeof(uint64_t));
+    }
+    if (magic != BLOB_MAGIC)
+    {
+        std::cerr << "Not a value log file " << filename << "\n";
+        return nullptr;
+    }
+    return reader;
+}
+
+bool BlobFileReader::Read(const BlobIndex &index, PinnableValue *value) const
+{
+    if (index.offset_ > file_->size() - FOOTER_SIZE || index.size_ > file_->size() - FOOTER_SIZE - index.offset_)
+    {
+        return false;
+    }
+    value->Pin(std::string_view(file_->data() + index.offset_, index.size_), file_);
+    return true;
+}
@@ -26,7 +26,8 @@ void BloomFilter<T>::Insert(const T &data)
 {
 
     uint32_t pos[4];
-    MurmurHash3_x64_128(&data, sizeof(T), 1, pos);
+    std::string_view bytes = KeyTraits<T>::Bytes(data);
+    MurmurHash3_x64_128(bytes.data(), bytes.size(), 1, pos);
     for (int i = 0; i < 4; ++i)
     {
         table_[pos[i] % m_] = true;
@@ -37,7 +38,8 @@ template <class T>
 bool BloomFilter<T>::Exist(const T &data) const
 {
     uint32_t pos[4];
-    MurmurHash3_x64_128(&data, sizeof(T), 1, pos);
+    std::string_view bytes = KeyTraits<T>::Bytes(data);
+    MurmurHash3_x64_128(bytes.data(), bytes.size(), 1, pos);
     for (int i = 0; i < 4; ++i)
     {
         if (!table_[pos[i] % m_])
@@ -49,3 +51,4 @@ bool BloomFilter<T>::Exist(const T &data) const
 }
 
 template class BloomFilter<uint64_t>;
+template class BloomFilter<BinaryKey>;
@@ -0,0 +1,201 @@
+#include "eventlogger.h"
+#include <cstdio>
+#include <atomic>
+#include <algorithm>
+#include "utils.h"
+
+JSONWriter& JSONWriter::Key(const std::string &key)
+{
+    fields_ += (fields_.empty()? "" : ", ") + Quote(key) + ": ";
+    return *this;
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, uint64_t value)
+{
+    Key(key).fields_ += std::to_string(value);
+    return *this;
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, int value)
+{
+    Key(key).fields_ += std::to_string(value);
+    return *this;
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, bool value)
+{
+    Key(key).fields_ += value? "true" : "false";
+    return *this;
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, const std::string &value)
+{
+    Key(key).fields_ += Quote(value);
+    return *this;
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, const char* value)
+{
+    return Add(key, std::string(value));
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, const std::vector<std::string> &values)
+{
+    Key(key).fields_ += "[";
+    for (std::vector<std::string>::const_iterator value_it = values.begin(); value_it != values.end(); ++value_it)
+    {
+        fields_ += (value_it == values.begin()? "" : ", ") + Quote(*value_it);
+    }
+    fields_ += "]";
+    return *this;
+}
+
+JSONWriter& JSONWriter::Add(const std::string &key, const JSONWriter &object)
+{
+    Key(key).fields_ += object.ToString();
+    return *this;
+}
+
+// names and paths are all this writer is given, control characters other than these do not occur
+std::string JSONWriter::Quote(const std::string &str)
+{
+    std::string quoted = "\"";
+    for (std::string::const_iterator char_it = str.begin(); char_it != str.end(); ++char_it)
+    {
+        if (*char_it == '"' || *char_it == '\\')
+        {
+            quoted += '\\';
+        }
+        if (*char_it == '\n')
+        {
+            quoted += "\\n";
+            continue;
+        }
+        quoted += *char_it;
+    }
+    return quoted + "\"";
+}
+
+EventLogger::EventLogger(const std::string &dir, uint64_t max_log_size, int keep_log_files,
+                         const std::string &trace_path):
+    dir_(dir), max_log_size_(max_log_size), keep_log_files_(keep_log_files), log_size_(0), trace_empty_(true),
+    origin_(std::chrono::steady_clock::now())
+{
+    std::ifstream existing(dir_ + "LOG", std::ios::binary | std::ios::ate);
+    if (existing.is_open())
+    {
+        log_size_ = existing.tellg();
+    }
+    log_.open(dir_ + "LOG", std::ios::app);
+    if (!trace_path.empty())
+    {
+        trace_.open(trace_path, std::ios::trunc);
+        trace_ << "[\n";
+    }
+}
+
+EventLogger::~EventLogger()
+{
+    if (trace_.is_open())
+    {
+        trace_ << "\n]\n";
+    }
+}
+
+int EventLogger::ThreadId()
+{
+    static std::atomic<int> next_id(1);
+    thread_local int id = next_id.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+uint64_t EventLogger::NowMicros() const
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin_).count();
+}
+
+void EventLogger::Write(const std::string &text)
+{
+    if (max_log_size_ != 0 && log_size_ != 0 && log_size_ + text.size() > max_log_size_)
+    {
+        Rotate();
+    }
+    log_ << text;
+    log_.flush();
+    log_size_ += text.size();
+}
+
+// the old logs are named by the time they were moved, so their names sort by age
+void EventLogger::Rotate()
+{
+    log_.close();
+    uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    std::rename((dir_ + "LOG").c_str(), (dir_ + "LOG.old." + std::to_string(now)).c_str());
+    std::vector<std::string> files;
+    utils::scanDir(dir_, files);
+    std::vector<std::string> old_logs;
+    for (std::vector<std::string>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        if (file_it->compare(0, 8, "LOG.old.") == 0)
+        {
+            old_logs.push_back(*file_it);
+        }
+    }
+    std::sort(old_logs.begin(), old_logs.end());
+    for (size_t i = 0; i + keep_log_files_ < old_logs.size(); ++i)
+    {
+        utils::rmfile((dir_ + old_logs[i]).c_str());
+    }
+    log_.open(dir_ + "LOG", std::ios::trunc);
+    log_size_ = 0;
+}
+
+void EventLogger::Log(const std::string &text)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Write(text);
+}
+
+void EventLogger::LogEvent(const JSONWriter &event)
+{
+    uint64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string line = "EVENT_LOG_v1 {\"time_micros\": " + std::to_string(now) +
+                       (event.Fields().empty()? "" : ", ") + event.Fields() + "}\n";
+    std::lock_guard<std::mutex> lock(mutex_);
+    Write(line);
+}
+
+void EventLogger::Trace(const std::string &event)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    trace_ << (trace_empty_? "" : ",\n") << event;
+    trace_.flush();
+    trace_empty_ = false;
+}
+
+void EventLogger::TraceComplete(const std::string &name, int tid, uint64_t start_micros, uint64_t end_micros,
+                                const JSONWriter &args)
+{
+    if (!Tracing())
+    {
+        return;
+    }
+    JSONWriter event;
+    event.Add("name", name).Add("cat", "lsmkv").Add("ph", "X").Add("ts", start_micros)
+         .Add("dur", end_micros - start_micros).Add("pid", 1).Add("tid", tid).Add("args", args);
+    Trace(event.ToString());
+}
+
+void EventLogger::TraceInstant(const std::string &name, const JSONWriter &args)
+{
+    if (!Tracing())
+    {
+        return;
+    }
+    JSONWriter event;
+    event.Add("name", name).Add("cat", "lsmkv").Add("ph", "i").Add("s", "t").Add("ts", NowMicros())
+         .Add("pid", 1).Add("tid", ThreadId()).Add("args", args);
+    Trace(event.ToString());
+}
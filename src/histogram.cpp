@@ -0,0 +1,93 @@
+#include "histogram.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// buckets of the exact values, then 2^(SUB_BITS_ - 1) for each power of two up to 2^63
+Histogram::Histogram(): counts_((1 << SUB_BITS_) + (64 - SUB_BITS_) * (1 << (SUB_BITS_ - 1)), 0),
+    count_(0), min_(UINT64_MAX), max_(0), sum_(0)
+{
+
+}
+
+int Histogram::BucketIndex(uint64_t value)
+{
+    if (value < (1ULL << SUB_BITS_))
+    {
+        return value;
+    }
+#if defined(_MSC_VER)
+    unsigned long exponent = 0;
+    _BitScanReverse64(&exponent, value);
+#else
+    int exponent = 63 - __builtin_clzll(value);
+#endif
+    int shift = exponent - (SUB_BITS_ - 1);
+    int sub = (value >> shift) - (1 << (SUB_BITS_ - 1));
+    return (1 << SUB_BITS_) + (exponent - SUB_BITS_) * (1 << (SUB_BITS_ - 1)) + sub;
+}
+
+uint64_t Histogram::BucketValue(int index)
+{
+    if (index < (1 << SUB_BITS_))
+    {
+        return index;
+    }
+    index -= 1 << SUB_BITS_;
+    int exponent = index / (1 << (SUB_BITS_ - 1)) + SUB_BITS_;
+    int shift = exponent - (SUB_BITS_ - 1);
+    uint64_t sub = index % (1 << (SUB_BITS_ - 1)) + (1 << (SUB_BITS_ - 1));
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::Record(uint64_t value)
+{
+    ++counts_[BucketIndex(value)];
+    ++count_;
+    min_ = (value < min_)? value : min_;
+    max_ = (value > max_)? value : max_;
+    sum_ += value;
+}
+
+void Histogram::Merge(const Histogram &other)
+{
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+        counts_[i] += other.counts_[i];
+    }
+    count_ += other.count_;
+    min_ = (other.min_ < min_)? other.min_ : min_;
+    max_ = (other.max_ > max_)? other.max_ : max_;
+    sum_ += other.sum_;
+}
+
+void Histogram::Clear()
+{
+    counts_.assign(counts_.size(), 0);
+    count_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0;
+}
+
+// the bound of the bucket, but never above the largest value seen
+uint64_t Histogram::Percentile(double percent) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = (uint64_t)(percent / 100 * count_ + 0.5);
+    rank = (rank < 1)? 1 : rank;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < counts_.size(); ++i)
+    {
+        seen += counts_[i];
+        if (seen >= rank)
+        {
+            uint64_t value = BucketValue(i);
+            return (value > max_)? max_ : value;
+        }
+    }
+    return max_;
+}
@@ -0,0 +1,379 @@
+#include "iobackend.h"
+#include <vector>
+#include <deque>
+#include <set>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+// the whole length unless the file ends first
+static ssize_t ReadFully(int fd, char* buffer, size_t length, uint64_t offset)
+{
+    size_t done = 0;
+    while (done < length)
+    {
+#if defined(_WIN32)
+        static std::mutex seek_mutex;
+        std::lock_guard<std::mutex> lock(seek_mutex);
+        _lseeki64(fd, offset + done, SEEK_SET);
+        int n = _read(fd, buffer + done, length - done);
+#else
+        ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+#endif
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return -errno;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+// queue_depth threads each doing one pread at a time
+class ThreadPoolBackend : public IOBackend
+{
+private:
+    std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::condition_variable done_cv_;
+    std::deque<Request*> queue_;
+    std::vector<std::thread> workers_;
+    bool stop_;
+    void Work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            queue_cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty())
+            {
+                return;
+            }
+            Request* request = queue_.front();
+            queue_.pop_front();
+            lock.unlock();
+            ssize_t result = ReadFully(request->fd_, request->buffer_, request->length_, request->offset_);
+            lock.lock();
+            request->result_ = result;
+            request->done_ = true;
+            done_cv_.notify_all();
+        }
+    }
+public:
+    explicit ThreadPoolBackend(int queue_depth): stop_(false)
+    {
+        for (int i = 0; i < queue_depth; ++i)
+        {
+            workers_.emplace_back(&ThreadPoolBackend::Work, this);
+        }
+    }
+    ~ThreadPoolBackend() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        queue_cv_.notify_all();
+        for (std::vector<std::thread>::iterator worker_it = workers_.begin(); worker_it != workers_.end(); ++worker_it)
+        {
+            worker_it->join();
+        }
+    }
+    void Submit(Request* request) override
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        request->done_ = false;
+        queue_.push_back(request);
+        queue_cv_.notify_one();
+    }
+    void Wait(Request* request) override
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [request] { return request->done_; });
+    }
+    const char* Name() const override { return "thread pool"; }
+};
+
+#if defined(__linux__)
+// io_uring through the raw system calls; one thread at a time sleeps in io_uring_enter and
+// reaps every completion, the others wait for it to mark theirs done
+class IoUringBackend : public IOBackend
+{
+private:
+    int ring_fd_;
+    unsigned entries_;
+    void* sq_ring_;
+    void* cq_ring_;
+    size_t sq_ring_size_;
+    size_t cq_ring_size_;
+    struct io_uring_sqe* sqes_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    struct io_uring_cqe* cqes_;
+    std::set<Request*> in_flight_;          // handed to the kernel, not reaped yet
+    int error_;                             // errno that left the ring unusable, reads are then done with pread
+    bool reaping_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+
+    static constexpr int MAX_SUBMIT_ATTEMPTS = 6;
+    static constexpr int BACKOFF_MICROS = 50;
+
+    static int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+    {
+        return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+    }
+    // the kernel is short of room for requests until some of those in flight complete
+    static bool Transient(int error)
+    {
+        return error == EAGAIN || error == EBUSY || error == ENOMEM;
+    }
+    // completions are marked under the mutex, see WaitForCompletion for who may reap
+    void Reap()
+    {
+        unsigned head = *cq_head_;
+        while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe* cqe = &cqes_[head & *cq_mask_];
+            Request* request = reinterpret_cast<Request*>(cqe->user_data);
+            request->result_ = cqe->res;
+            request->done_ = true;
+            in_flight_.erase(request);
+            ++head;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+    // the ring cannot be waited on any more: what it still holds fails, later reads are done with pread
+    void Fail(int error)
+    {
+        for (std::set<Request*>::const_iterator request_it = in_flight_.begin(); request_it != in_flight_.end(); ++request_it)
+        {
+            (*request_it)->result_ = -error;
+            (*request_it)->done_ = true;
+        }
+        in_flight_.clear();
+        error_ = error;
+    }
+    // queue the request and hand it to the kernel, backing off while it is short of room; if it will not
+    // take the request the queue entry is taken back, no other thread submits while the mutex is held
+    bool Push(Request* request)
+    {
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & *sq_mask_;
+        struct io_uring_sqe* sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = request->fd_;
+        sqe->addr = (uint64_t)request->buffer_;
+        sqe->len = request->length_;
+        sqe->off = request->offset_;
+        sqe->user_data = (uint64_t)request;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        int attempt = 0;
+        while (attempt < MAX_SUBMIT_ATTEMPTS)
+        {
+            int submitted = Enter(ring_fd_, 1, 0, 0);
+            if (submitted == 1)
+            {
+                in_flight_.insert(request);
+                return true;
+            }
+            int error = (submitted < 0)? errno : EAGAIN;
+            if (error == EINTR)
+            {
+                continue;
+            }
+            if (!Transient(error))
+            {
+                break;
+            }
+            if (!reaping_)
+            {
+                Reap();
+                cv_.notify_all();
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(BACKOFF_MICROS << attempt));
+            ++attempt;
+        }
+        __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+        return false;
+    }
+    // sleep in the kernel until something completes, unless another thread already does;
+    // completions are only reaped while no thread sleeps there, or it could sleep on one already taken
+    void WaitForCompletion(std::unique_lock<std::mutex> &lock)
+    {
+        if (reaping_)
+        {
+            cv_.wait(lock);
+            return;
+        }
+        size_t in_flight = in_flight_.size();
+        Reap();
+        if (in_flight_.size() != in_flight)
+        {
+            cv_.notify_all();
+            return;
+        }
+        reaping_ = true;
+        lock.unlock();
+        int error = (Enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) < 0)? errno : 0;
+        if (Transient(error))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(BACKOFF_MICROS));
+        }
+        lock.lock();
+        Reap();
+        if (error != 0 && error != EINTR && !Transient(error))
+        {
+            Fail(error);
+        }
+        reaping_ = false;
+        cv_.notify_all();
+    }
+public:
+    IoUringBackend(): ring_fd_(-1), sq_ring_(MAP_FAILED), cq_ring_(MAP_FAILED), sqes_((struct io_uring_sqe*)MAP_FAILED),
+        error_(0), reaping_(false) {}
+    bool Init(int queue_depth)
+    {
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = syscall(__NR_io_uring_setup, queue_depth, &params);
+        if (ring_fd_ < 0)
+        {
+            return false;
+        }
+        entries_ = params.sq_entries;
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sq_ring_size_ = cq_ring_size_ = (sq_ring_size_ > cq_ring_size_)? sq_ring_size_ : cq_ring_size_;
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED)
+        {
+            return false;
+        }
+        cq_ring_ = (params.features & IORING_FEAT_SINGLE_MMAP)? sq_ring_ :
+                mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED)
+        {
+            return false;
+        }
+        sqes_ = (struct io_uring_sqe*)mmap(nullptr, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED)
+        {
+            return false;
+        }
+        char* sq = (char*)sq_ring_;
+        char* cq = (char*)cq_ring_;
+        sq_tail_ = (unsigned*)(sq + params.sq_off.tail);
+        sq_mask_ = (unsigned*)(sq + params.sq_off.ring_mask);
+        sq_array_ = (unsigned*)(sq + params.sq_off.array);
+        cq_head_ = (unsigned*)(cq + params.cq_off.head);
+        cq_tail_ = (unsigned*)(cq + params.cq_off.tail);
+        cq_mask_ = (unsigned*)(cq + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+        return true;
+    }
+    ~IoUringBackend() override
+    {
+        if (sqes_ != MAP_FAILED)
+        {
+            munmap(sqes_, entries_ * sizeof(struct io_uring_sqe));
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_)
+        {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED)
+        {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (ring_fd_ >= 0)
+        {
+            close(ring_fd_);
+        }
+    }
+    // a request the ring does not take is read in place, it is done before Submit returns
+    void Submit(Request* request) override
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        request->done_ = false;
+        while (error_ == 0 && in_flight_.size() >= entries_)
+        {
+            WaitForCompletion(lock);
+        }
+        if (error_ == 0 && Push(request))
+        {
+            return;
+        }
+        lock.unlock();
+        ssize_t result = ReadFully(request->fd_, request->buffer_, request->length_, request->offset_);
+        lock.lock();
+        request->result_ = result;
+        request->done_ = true;
+    }
+    // a short read is finished with pread
+    void Wait(Request* request) override
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!request->done_)
+            {
+                WaitForCompletion(lock);
+            }
+        }
+        if (request->result_ >= 0 && (size_t)request->result_ < request->length_)
+        {
+            ssize_t rest = ReadFully(request->fd_, request->buffer_ + request->result_, request->length_ - request->result_,
+                                     request->offset_ + request->result_);
+            request->result_ = (rest < 0)? rest : request->result_ + rest;
+        }
+    }
+    const char* Name() const override { return "io_uring"; }
+};
+#endif
+
+std::unique_ptr<IOBackend> IOBackend::Create(IOBackendType type, int queue_depth)
+{
+    queue_depth = (queue_depth < 1)? 1 : queue_depth;
+#if defined(__linux__)
+    if (type == IO_URING)
+    {
+        std::unique_ptr<IoUringBackend> backend(new IoUringBackend());
+        if (backend->Init(queue_depth))
+        {
+            return backend;
+        }
+    }
+#endif
+    return std::unique_ptr<IOBackend>(new ThreadPoolBackend(queue_depth));
+}
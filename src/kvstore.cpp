@@ -6,6 +6,11 @@ KVStore::KVStore(const std::string &dir): KVStoreAPI(dir), memory_(dir)
 
 }
 
+KVStore::KVStore(const std::string &dir, const Options &options): KVStoreAPI(dir), memory_(dir, options)
+{
+
+}
+
 KVStore::~KVStore()
 {
 
@@ -17,24 +22,123 @@ KVStore::~KVStore()
  */
 void KVStore::put(uint64_t key, const std::string &s)
 {
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_PUT, key, s.size());
+    }
     memory_.Put(key, s);
 }
+/**
+ * Same as above, but the value is moved into the memtable.
+ */
+void KVStore::put(uint64_t key, std::string &&s)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_PUT, key, s.size());
+    }
+    memory_.Put(key, std::move(s));
+}
 /**
  * Returns the (string) value of the given key.
  * An empty string indicates not found.
  */
 std::string KVStore::get(uint64_t key)
 {
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_GET, key);
+    }
     return memory_.Get(key);
 }
+/**
+ * Zero-copy variant of get. On success the value is viewed through `value`,
+ * which keeps the underlying sstable mapping alive until it is reset.
+ * Returns false iff the key is not found.
+ */
+bool KVStore::get(uint64_t key, PinnableValue *value)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_GET, key);
+    }
+    return memory_.Get(key, value);
+}
+/**
+ * Same as get, but reads the store as it was when the snapshot was taken.
+ */
+std::string KVStore::get(uint64_t key, const Snapshot *snapshot)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_GET, key);
+    }
+    return memory_.Get(key, snapshot);
+}
+/**
+ * Zero-copy get as of the snapshot.
+ */
+bool KVStore::get(uint64_t key, PinnableValue *value, const Snapshot *snapshot)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_GET, key);
+    }
+    return memory_.Get(key, value, snapshot);
+}
+/**
+ * Take a point-in-time view of the store. Every version it can read is
+ * kept by the memtable and by compaction until release_snapshot.
+ */
+const Snapshot *KVStore::get_snapshot()
+{
+    return memory_.GetSnapshot();
+}
+/**
+ * Release a snapshot returned by get_snapshot, it must not be used afterwards.
+ */
+void KVStore::release_snapshot(const Snapshot *snapshot)
+{
+    memory_.ReleaseSnapshot(snapshot);
+}
 /**
  * Delete the given key-value pair if it exists.
  * Returns false iff the key is not found.
  */
 bool KVStore::del(uint64_t key)
 {
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_DELETE, key);
+    }
     return memory_.Del(key);
 }
+/**
+ * Delete with an explicit mode. DEL_EXACT behaves like del(key) and never
+ * reads a value from disk; DEL_BLIND writes the tombstone without looking
+ * at the sstables and returns DEL_UNKNOWN unless the memtable knows the key.
+ */
+DelResult KVStore::del(uint64_t key, DelMode mode)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_DELETE, key);
+    }
+    return memory_.Del(key, mode);
+}
+
+/**
+ * Delete every key-value pair between key1 and key2 (both included)
+ * with a single range tombstone, no key is looked up.
+ */
+void KVStore::delete_range(uint64_t key1, uint64_t key2)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_DELETE_RANGE, key1, key2);
+    }
+    memory_.DelRange(key1, key2);
+}
 
 /**
  * This resets the kvstore. All key-value pairs should be removed,
@@ -45,6 +149,34 @@ void KVStore::reset()
     memory_.Reset();
 }
 
+/**
+ * Per-level compaction report: files, size, score, bytes read and
+ * written by compactions and the resulting write amplification.
+ */
+std::string KVStore::compaction_stats() const
+{
+    return memory_.GetCompactionStats();
+}
+
+/**
+ * Engine counters (lookups, bloom filter hits, scans, writes, flushes
+ * and compactions) followed by the compaction report.
+ */
+std::string KVStore::stats() const
+{
+    return memory_.GetStats();
+}
+
+/**
+ * Value of a named property such as "lsmkv.stats",
+ * "lsmkv.num-files-at-level0" or a counter like "lsmkv.get.count".
+ * Returns false iff the name is unknown.
+ */
+bool KVStore::get_property(const std::string &name, std::string *value) const
+{
+    return memory_.GetProperty(name, value);
+}
+
 /**
  * Return a list including all the key-value pair between key1 and key2.
  * keys in the list should be in an ascending order.
@@ -52,5 +184,49 @@ void KVStore::reset()
  */
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list)
 {	
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_SCAN, key1, key2);
+    }
     memory_.Scan(key1, key2, list);
 }
+/**
+ * Same as scan, but reads the store as it was when the snapshot was taken.
+ */
+void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list,
+                   const Snapshot *snapshot)
+{
+    if (tracer_ != nullptr)
+    {
+        tracer_->Record(TRACE_SCAN, key1, key2);
+    }
+    memory_.Scan(key1, key2, list, snapshot);
+}
+
+/**
+ * Record every following put, get, del, delete_range and scan with its
+ * time to a trace file, which bench/replay runs against another store.
+ * Values are not recorded, only their sizes. A trace already running is
+ * ended first. Returns false iff the file cannot be created.
+ */
+bool KVStore::start_trace(const std::string &filename)
+{
+    end_trace();
+    tracer_ = TraceWriter::Open(filename);
+    return tracer_ != nullptr;
+}
+
+/**
+ * Stop tracing and close the trace file.
+ * Returns false iff no trace was running or the file could not be written.
+ */
+bool KVStore::end_trace()
+{
+    if (tracer_ == nullptr)
+    {
+        return false;
+    }
+    bool closed = tracer_->Close();
+    tracer_.reset();
+    return closed;
+}
@@ -0,0 +1,67 @@
+#include "mappedfile.h"
+#include <fstream>
+#include <iterator>
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile():
+    data_(nullptr), size_(0), mapped_(false)
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+#if !defined(_MSC_VER)
+    if (mapped_)
+    {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+std::shared_ptr<const MappedFile> MappedFile::Open(const std::string &filename)
+{
+    std::shared_ptr<MappedFile> file(new MappedFile());
+#if !defined(_MSC_VER)
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return nullptr;
+    }
+    if (st.st_size > 0)
+    {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED)
+        {
+            close(fd);
+            return nullptr;
+        }
+        file->data_ = static_cast<const char*>(addr);
+        file->size_ = st.st_size;
+        file->mapped_ = true;
+    }
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+#else
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in)
+    {
+        return nullptr;
+    }
+    file->buffer_.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    file->data_ = file->buffer_.data();
+    file->size_ = file->buffer_.size();
+#endif
+    return file;
+}
@@ -5,8 +5,8 @@ Memory<KEY, VALUE>::SmallSSTable::Head::Head()
 {
     timestamp_ = 0;
     length_ = 0;
-    max_ele_key_ = 0;
-    min_ele_key_ = UINT64_MAX;
+    max_ele_key_ = KEY();
+    min_ele_key_ = KEY();
 }
 
 template <class KEY, class VALUE>
@@ -26,49 +26,175 @@ bool Memory<KEY, VALUE>::SmallSSTable::Head::operator == (const SmallSSTable::He
     return false;
 }
 
+// the first entry not smaller than key, the index is sorted by key
 template <class KEY, class VALUE>
-Memory<KEY, VALUE>::SmallSSTable::SmallSSTable(const std::vector<std::pair<KEY, VALUE>> &data,
-                                               int bloom_filter_size):
-    header_(), filter_(bloom_filter_size)
+typename std::vector<typename Memory<KEY, VALUE>::index_entry_t>::const_iterator
+Memory<KEY, VALUE>::SmallSSTable::Seek(const KEY &key) const
 {
-    index_.clear();
-    uint32_t pos = 0;
-    for (typename std::vector<std::pair<KEY, VALUE>>::const_iterator it = data.begin(); it != data.end(); ++it)
+    return std::lower_bound(index_.begin(), index_.end(), key,
+                            [] (const index_entry_t &entry, const KEY &key) { return entry.key_ < key; });
+}
+
+// the whole index is in memory, so it serves as an exact range filter: a table whose bounds
+// overlap [min, max] may still hold nothing there, then it only matters for its range tombstones
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::SmallSSTable::HasRange(const KEY &min, const KEY &max) const
+{
+    if (header_.min_ele_key_ > max || header_.max_ele_key_ < min)
+    {
+        return false;
+    }
+    typename std::vector<index_entry_t>::const_iterator index_it = Seek(min);
+    if (index_it != index_.end() && index_it->key_ <= max)
+    {
+        return true;
+    }
+    for (typename std::vector<range_tombstone_t>::const_iterator range_it = range_tombstones_.begin();
+         range_it != range_tombstones_.end();
+         ++range_it)
+    {
+        if (range_it->begin_ <= max && range_it->end_ >= min)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// the in-memory part of a table is taken from the table being written, not rebuilt from the data
+template <class KEY, class VALUE>
+Memory<KEY, VALUE>::SmallSSTable::SmallSSTable(const SSTable<KEY, VALUE> &sstable):
+    header_(sstable.header().timestamp_, sstable.header().length_,
+            sstable.header().max_ele_key_, sstable.header().min_ele_key_),
+    filter_(sstable.filter()), range_tombstones_(sstable.range_tombstones()), index_(sstable.index()),
+    min_seq_(UINT64_MAX), max_seq_(0), file_size_(sstable.FileSize()), data_offset_(sstable.DataOffset())
+{
+    for (typename std::vector<index_entry_t>::const_iterator index_it = index_.begin(); index_it != index_.end(); ++index_it)
+    {
+        min_seq_ = (index_it->seq_ < min_seq_)? index_it->seq_ : min_seq_;
+        max_seq_ = (index_it->seq_ > max_seq_)? index_it->seq_ : max_seq_;
+    }
+    for (typename std::vector<range_tombstone_t>::const_iterator range_it = range_tombstones_.begin();
+         range_it != range_tombstones_.end();
+         ++range_it)
+    {
+        min_seq_ = (range_it->seq_ < min_seq_)? range_it->seq_ : min_seq_;
+        max_seq_ = (range_it->seq_ > max_seq_)? range_it->seq_ : max_seq_;
+    }
+}
+
+template <class KEY, class VALUE>
+Memory<KEY, VALUE>::LevelStats::LevelStats():
+    compactions_(0), trivial_moves_(0), bytes_read_(0), bytes_read_next_(0), bytes_written_(0), files_written_(0),
+    micros_(0)
+{
+
+}
+
+template <class KEY, class VALUE>
+Options Memory<KEY, VALUE>::SizeOptions(int max_size, int bloom_filter_size)
+{
+    Options options;
+    options.write_buffer_size = max_size;
+    options.target_file_size = max_size;
+    options.bloom_filter_size = bloom_filter_size;
+    return options;
+}
+
+// a fixed-width value is no larger than the blob index that would replace it, so it always stays in the table;
+// a compaction output holds the bloom filter and at least a page of entries
+template <class KEY, class VALUE>
+Options Memory<KEY, VALUE>::SanitizeOptions(const Options &options)
+{
+    const int MIN_DATA_SIZE = 4096;
+    Options sanitized = options;
+    if (ValueTraits<VALUE>::FIXED_WIDTH)
+    {
+        sanitized.min_blob_size = 0;
+    }
+    if (sanitized.target_file_size < sanitized.bloom_filter_size + MIN_DATA_SIZE)
     {
-        ++(header_.length_);
-        VALUE value = it->second;
-        pos += sizeof(char) * value.length();
-        header_.max_ele_key_ = (it->first > header_.max_ele_key_)? it->first : header_.max_ele_key_;
-        header_.min_ele_key_ = (it->first < header_.min_ele_key_)? it->first : header_.min_ele_key_;
-        filter_.Insert(it->first);
-        index_.push_back(std::pair<KEY, uint32_t>(it->first, pos - sizeof(char) * value.length()));
+        sanitized.target_file_size = sanitized.bloom_filter_size + MIN_DATA_SIZE;
     }
+    return sanitized;
 }
 
 template <class KEY, class VALUE>
 Memory<KEY, VALUE>::Memory(std::string output_path, int max_size, int bloom_filter_size):
-    MAX_SIZE_(max_size), BLOOM_FILTER_SIZE_(bloom_filter_size)     // ln(2) = 0.69314718055994530941723212145818
+    Memory(output_path, SizeOptions(max_size, bloom_filter_size))
+{
+
+}
+
+template <class KEY, class VALUE>
+Memory<KEY, VALUE>::Memory(std::string output_path, const Options &options):
+    options_(SanitizeOptions(options)), MAX_SIZE_(options.write_buffer_size),
+    BLOOM_FILTER_SIZE_(options.bloom_filter_size)     // ln(2) = 0.69314718055994530941723212145818
 {
     list_ = new SkipList<KEY, VALUE>();
+    io_ = IOBackend::Create(options_.io_backend, options_.io_queue_depth);
+    if (options_.compaction_style == COMPACTION_TIERED)
+    {
+        strategy_.reset(new TieredStrategy());
+    }
+    else
+    {
+        strategy_.reset(new LeveledStrategy());
+    }
+    if (options_.rate_limit_bytes_per_sec > 0)
+    {
+        limiter_.reset(new RateLimiter(options_.rate_limit_bytes_per_sec, options_.rate_limit_auto_tune,
+                                       options_.rate_limit_latency_target_us));
+    }
     buffer_.clear();
     current_size_ = 0;
     element_num_ = 0;
+    last_sequence_ = 0;
     output_path_ = output_path;
     if (output_path_[output_path_.length() - 1] != '/')
     {
         output_path_.append("/");
     }
+    next_blob_file_ = 1;
+    Recover();
+    event_logger_.reset(new EventLogger(output_path_, options_.max_log_file_size, options_.keep_log_file_num,
+                                        options_.trace_path));
+    next_job_id_ = 0;
+    stop_dump_ = false;
+    if (options_.stats_dump_period_sec > 0)
+    {
+        dump_thread_ = std::thread(&Memory::DumpStatsPeriodically, this);
+    }
 }
 
+// the memtable is flushed on a clean shutdown, there is no log to replay it from
 template <class KEY, class VALUE>
 Memory<KEY, VALUE>::~Memory()
 {
+    if (dump_thread_.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(dump_mutex_);
+            stop_dump_ = true;
+        }
+        dump_cv_.notify_all();
+        dump_thread_.join();
+    }
+    if ((element_num_ > 0 || !range_list_.empty()) && !Flush())
+    {
+        std::cerr << "Failed to flush the memtable of " << output_path_ << ", its writes are lost\n";
+    }
+    if (options_.stats_dump_period_sec > 0)
+    {
+        DumpStats();
+    }
+    manifest_.close();
     delete list_;
     buffer_.clear();
 }
 
 template <class KEY, class VALUE>
-bool Memory<KEY, VALUE>::NeedCompaction(int level) const
+int Memory<KEY, VALUE>::FileNum(int level) const
 {
     int file_num = 0;
     for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
@@ -80,764 +206,2807 @@ bool Memory<KEY, VALUE>::NeedCompaction(int level) const
             ++file_num;
         }
     }
-    int max_file_num = 1 << (level + 1);
-    return (file_num > max_file_num)? true : false;
+    return file_num;
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::GetCompactionFiles(int level, std::vector<SmallSSTable*> &files_to_compaction)
+uint64_t Memory<KEY, VALUE>::LevelBytes(int level) const
 {
-    typedef std::pair<std::pair<uint64_t, KEY>, SmallSSTable*> file_info_t;
-    std::vector<file_info_t> timestamp_to_file;
-    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin(); buffer_it != buffer_.end(); ++buffer_it)
+    uint64_t bytes = 0;
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
     {
         if (buffer_it->first == level)
         {
-            uint64_t timestamp = buffer_it->second.header_.timestamp_;
-            KEY max_ele_key = buffer_it->second.header_.max_ele_key_;
-            timestamp_to_file.push_back(file_info_t({{timestamp, max_ele_key}, &(buffer_it->second)}));
-        }
-    }
-    int max_file_num = 1 << (level + 1);
-    int file_num = timestamp_to_file.size();
-    typename std::vector<file_info_t>::const_iterator file_it = timestamp_to_file.begin();
-    if (level == 0)
-    {
-        while (file_it != timestamp_to_file.end())
-        {
-            files_to_compaction.push_back(file_it->second);
-            ++file_it;
-        }
-    }
-    else
-    {
-        auto cmp_file_less = [] (const file_info_t &file1, const file_info_t &file2)
-        {
-            if (file1.first.first < file2.first.first)
-            {
-                return true;
-            }
-            else if (file1.first.first == file2.first.first)
-            {
-                if (file1.first.second < file2.first.second)
-                {
-                    return true;
-                }
-            }
-            return false;
-        };
-        std::sort(timestamp_to_file.begin(), timestamp_to_file.end(), cmp_file_less);
-        for (int i = 0; i < file_num - max_file_num; ++i)
-        {
-            if (file_it >= timestamp_to_file.end())
-            {
-                break;
-            }
-            files_to_compaction.push_back(file_it->second);
-            ++file_it;
+            bytes += buffer_it->second.file_size_;
         }
     }
+    return bytes;
 }
 
 template <class KEY, class VALUE>
-uint64_t Memory<KEY, VALUE>::GetCompactionFilesRange(int level, uint64_t min, uint64_t max,
-                                                     std::vector<SmallSSTable*> &files_to_compaction)
+uint64_t Memory<KEY, VALUE>::MaxBytesForLevel(int level) const
 {
-    uint64_t merge_length = 0;
-    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin(); buffer_it != buffer_.end(); ++buffer_it)
+    uint64_t max_bytes = options_.max_bytes_for_level_base;
+    for (int i = 1; i < level; ++i)
     {
-        if (buffer_it->first == level && buffer_it->second.header_.max_ele_key_ >= min && buffer_it->second.header_.min_ele_key_ < max)
-        {
-            files_to_compaction.push_back(&(buffer_it->second));
-            merge_length += buffer_it->second.header_.length_;
-        }
+        max_bytes *= options_.max_bytes_for_level_multiplier;
     }
-    return merge_length;
+    return max_bytes;
 }
 
+// level 0 is scored by its file count since every file there may overlap the others,
+// the other levels by their size against the target
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::WriteToDisk(int level, std::vector<std::pair<KEY, VALUE>> &data)
+double Memory<KEY, VALUE>::CompactionScore(int level) const
 {
-    SSTable<KEY, VALUE> sstable(data, BLOOM_FILTER_SIZE_);
-    SmallSSTable small_sstable(data, BLOOM_FILTER_SIZE_);
-    small_sstable.header_.timestamp_ = SSTable<KEY, VALUE>::timestamp_;
-    buffer_.push_back({level, small_sstable});
-    sstable.SSTableOut(output_path_ + "level" + std::to_string(level) + "/");
+    if (level == 0)
+    {
+        return (double)FileNum(0) / options_.level0_compaction_trigger;
+    }
+    return (double)LevelBytes(level) / MaxBytesForLevel(level);
 }
 
+// the level most over its target, -1 if none needs a compaction
 template <class KEY, class VALUE>
-std::tuple<uint64_t, uint64_t, KEY, KEY> Memory<KEY, VALUE>::ReadHead(std::string filename) const
+int Memory<KEY, VALUE>::PickCompactionLevel() const
 {
-    std::ifstream sstable_in(filename, std::ios::in | std::ios::binary);
-    if (!sstable_in)
+    int max_level = 0;
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
     {
-        std::cerr << "Failed to open file " << filename << "\n";
-        return std::tuple<uint64_t, uint64_t, KEY, KEY>{0, 0, 0, 0};
+        max_level = (buffer_it->first > max_level)? buffer_it->first : max_level;
+    }
+    int level = -1;
+    double max_score = 1;
+    for (int i = 0; i <= max_level; ++i)
+    {
+        double score = CompactionScore(i);
+        if (score >= max_score)
+        {
+            level = i;
+            max_score = score;
+        }
     }
-    uint64_t timestamp;
-    uint64_t length;
-    KEY max_ele_key;
-    KEY min_ele_key;
-    sstable_in.read((char*)&timestamp, sizeof(uint64_t));
-    sstable_in.read((char*)&length, sizeof(uint64_t));
-    sstable_in.read((char*)&max_ele_key, sizeof(KEY));
-    sstable_in.read((char*)&min_ele_key, sizeof(KEY));
-    sstable_in.close();
-    return std::tuple<uint64_t, uint64_t, KEY, KEY>{timestamp, length, max_ele_key, min_ele_key};
+    return level;
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::ReadFile(const file_index_t &file_index, std::vector<VALUE> &values, bool is_delete) const
+bool Memory<KEY, VALUE>::LeveledStrategy::Pick(Memory &memory, CompactionJob &job)
 {
-    int level = std::get<0>(file_index);
-    uint64_t timestamp = std::get<1>(file_index);
-    uint64_t length = std::get<2>(file_index);
-    KEY max_ele_key = std::get<3>(file_index);
-    KEY min_ele_key = std::get<4>(file_index);
-    std::string filename = std::to_string(timestamp) + "-" + std::to_string(length) + "-" +
-            std::to_string(max_ele_key) + "-" + std::to_string(min_ele_key) + ".sst";
-    std::ifstream sstable_in(output_path_ + "level" + std::to_string(level) + "/" + filename,
-                             std::ios::in | std::ios::binary);
-    if (!sstable_in)
-    {
-        std::cerr << "Failed to open file " << output_path_ + "level" + std::to_string(level) + "/" + filename << "\n";
-        std::cerr << "Errno: " << errno << "\n";
-        return;
+    int level = memory.PickCompactionLevel();
+    if (level < 0)
+    {
+        return false;
     }
-    uint64_t file_offset = sizeof(uint64_t) * 2 + sizeof(KEY) * 2 + BLOOM_FILTER_SIZE_;
-
-    sstable_in.seekg(file_offset, std::ios::beg);
-    std::list<std::pair<KEY, uint32_t>> index;
+    job.files_.clear();
+    memory.GetCompactionFiles(level, job.files_);
+    job.level_ = level;
+    job.output_level_ = level + 1;
+    job.bottommost_ = memory.IsBottommostLevel(level + 1);
+    return true;
+}
 
-    for (uint64_t i = 0; i < length; ++i)
+// starting from the newest run, take the first window of at least tiered_min_merge_width runs
+// where each run is at most tiered_size_ratio percent larger than all the runs before it together;
+// without one, merge the newest runs until the count is back under tiered_max_runs
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::TieredStrategy::Pick(Memory &memory, CompactionJob &job)
+{
+    std::map<uint64_t, std::pair<uint64_t, std::vector<SmallSSTable*>>, std::greater<uint64_t>> runs;
+    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = memory.buffer_.begin();
+         buffer_it != memory.buffer_.end();
+         ++buffer_it)
     {
-        KEY key;
-        uint32_t offset;
-        sstable_in.read((char*)&key, sizeof(KEY));
-        sstable_in.read((char*)&offset, sizeof(uint32_t));
-        index.push_back({key, offset});
+        if (buffer_it->first == 0)
+        {
+            std::pair<uint64_t, std::vector<SmallSSTable*>> &run = runs[buffer_it->second.header_.timestamp_];
+            run.first += buffer_it->second.file_size_;
+            run.second.push_back(&(buffer_it->second));
+        }
     }
-
-    values.reserve(length);
-    char ch[1024 * 64 + 1];
-    memset(ch, '\0', (1024 * 64 + 1) * sizeof(char));
-    for (typename std::list<std::pair<KEY, uint32_t>>::iterator key_it = index.begin();
-         std::next(key_it, 1) != index.end();
-         ++key_it)
+    int run_num = runs.size();
+    if (run_num <= memory.options_.tiered_max_runs)
     {
-        VALUE value;
-        sstable_in.read(ch, std::next(key_it, 1)->second - key_it->second);
-        ch[std::next(key_it, 1)->second - key_it->second] = '\0';
-        value = ch;
-        values.push_back(value);
+        return false;
     }
-
-    // read the last element
-    VALUE value;
-    int i = 0;
-    while (!sstable_in.eof())
+    std::vector<const std::pair<uint64_t, std::vector<SmallSSTable*>>*> ordered;
+    for (typename std::map<uint64_t, std::pair<uint64_t, std::vector<SmallSSTable*>>>::const_iterator run_it = runs.begin();
+         run_it != runs.end();
+         ++run_it)
     {
-        sstable_in.read(ch + i, sizeof(char));
-        ++i;
+        ordered.push_back(&(run_it->second));
     }
-    ch[i] = '\0';
-    value = ch;
-    values.push_back(value);
-
-    sstable_in.close();
-    if (is_delete)
+    int begin = 0;
+    int end = 0;
+    for (int i = 0; i + 1 < run_num && end == 0; ++i)
     {
-        if (remove((output_path_ + "level" + std::to_string(level) + "/" + filename).c_str()) == -1)
+        uint64_t size = ordered[i]->first;
+        int j = i + 1;
+        while (j < run_num && ordered[j]->first * 100 <= size * (100 + memory.options_.tiered_size_ratio))
         {
-            std::cerr << "Failed to delete file " << output_path_ + "level" + std::to_string(level) + "/" + filename << "\n";
-            std::cerr << "Errno: " << errno << "\n";
+            size += ordered[j]->first;
+            ++j;
+        }
+        if (j - i >= memory.options_.tiered_min_merge_width)
+        {
+            begin = i;
+            end = j;
         }
     }
+    if (end == 0)
+    {
+        end = run_num - memory.options_.tiered_max_runs + 1;
+    }
+    job.files_.clear();
+    for (int i = begin; i < end; ++i)
+    {
+        job.files_.insert(job.files_.end(), ordered[i]->second.begin(), ordered[i]->second.end());
+    }
+    job.level_ = 0;
+    job.output_level_ = 0;
+    job.bottommost_ = (end == run_num) && memory.IsBottommostLevel(0);
+    return true;
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::MergeSort(typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge1_it,
-               const typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge1_end,
-               typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge2_it,
-               const typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge2_end,
-               std::vector<std::pair<KEY, item_index_t>> &target) const
+void Memory<KEY, VALUE>::MaybeCompact()
 {
-    while (merge1_it != merge1_end && merge2_it != merge2_end)
+    CompactionJob job;
+    while (strategy_->Pick(*this, job))
     {
-        if (merge1_it->first < merge2_it->first)
-        {
-            target.push_back(*merge1_it);
-            ++merge1_it;
-        }
-        else if (merge1_it->first > merge2_it->first)
+        SmallSSTable* file = job.files_.front();
+        // a single file with nothing under it only has to change its directory
+        if (job.output_level_ != job.level_ && job.files_.size() == 1 &&
+                OverlappingBytes(job.output_level_, file->header_.min_ele_key_, file->header_.max_ele_key_) == 0 &&
+                MoveFile(job.level_, file))
         {
-            target.push_back(*merge2_it);
-            ++merge2_it;
+            continue;
         }
-        else
+        // a compaction that failed would be picked again, it is retried after the next flush
+        if (!Compaction(job.files_, job.level_, job.output_level_, job.bottommost_))
         {
-            if (std::get<1>(merge1_it->second.first) > std::get<1>(merge2_it->second.first))
-            {
-                target.push_back(*merge1_it);
-            }
-            else
-            {
-                target.push_back(*merge2_it);
-            }
-            ++merge1_it;
-            ++merge2_it;
+            return;
         }
     }
-    while (merge1_it != merge1_end)
-    {
-        target.push_back(*merge1_it);
-        ++merge1_it;
-    }
-    while (merge2_it != merge2_end)
+    if (!blob_files_.empty())
     {
-        target.push_back(*merge2_it);
-        ++merge2_it;
+        CollectBlobGarbage();
     }
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::PackSmallSSTable(SmallSSTable* table, int level, std::vector<std::pair<KEY, item_index_t>> &table_package) const
+typename Memory<KEY, VALUE>::LevelStats& Memory<KEY, VALUE>::Stats(int level)
 {
-    table_package.clear();
-    uint64_t timestamp = table->header_.timestamp_;
-    uint64_t length = table->header_.length_;
-    KEY max_ele_key = table->header_.max_ele_key_;
-    KEY min_ele_key = table->header_.min_ele_key_;
-    uint32_t pos = 0;
-    for (typename std::vector<std::pair<KEY, uint32_t>>::iterator table_it = table->index_.begin();
-         table_it != table->index_.end();
-         ++table_it)
+    if ((int)stats_.size() <= level)
     {
-        item_index_t item_index{{level, timestamp, length, max_ele_key, min_ele_key}, pos};
-        table_package.push_back({table_it->first, item_index});
-        ++pos;
+        stats_.resize(level + 1);
     }
+    return stats_[level];
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::DeleteSmallSSTable(int level, SmallSSTable* table)
+bool Memory<KEY, VALUE>::MakeLevelDir(int level) const
+{
+    std::string dir = output_path_ + "level" + std::to_string(level);
+    return utils::dirExists(dir) || utils::_mkdir(dir.c_str()) == 0;
+}
+
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::MoveFile(int level, SmallSSTable* table)
 {
+    if (!MakeLevelDir(level + 1))
+    {
+        return false;
+    }
+    // the file is linked into the next level before the edit is logged and unlinked after,
+    // a crash in between leaves it under one of its names in the manifest
+    file_index_t from_index = GetFileIndex(level, table);
+    file_index_t to_index = GetFileIndex(level + 1, table);
+    std::string from = GetFilePath(from_index);
+    std::string to = GetFilePath(to_index);
+#if defined(_MSC_VER)
+    if (rename(from.c_str(), to.c_str()) != 0)
+#else
+    if (link(from.c_str(), to.c_str()) != 0)
+#endif
+    {
+        std::cerr << "Failed to move file " << from << "\n";
+        std::cerr << "Errno: " << errno << "\n";
+        return false;
+    }
+    // until the edit is logged the file is put back under its old name
+    if (!SyncPath(output_path_ + "level" + std::to_string(level + 1), true))
+    {
+#if defined(_MSC_VER)
+        rename(to.c_str(), from.c_str());
+#else
+        utils::rmfile(to.c_str());
+#endif
+        return false;
+    }
+    if (!LogEdit({to_index}, {from_index}))
+    {
+#if defined(_MSC_VER)
+        rename(to.c_str(), from.c_str());
+#endif
+        AbandonEdit({to_index});
+        return false;
+    }
+#if !defined(_MSC_VER)
+    utils::rmfile(from.c_str());
+#endif
     for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin();
          buffer_it != buffer_.end();
          ++buffer_it)
     {
-        if (buffer_it->first == level && buffer_it->second.header_ == table->header_)
+        if (&(buffer_it->second) == table)
         {
-            buffer_.erase(buffer_it);
-            return;
+            buffer_it->first = level + 1;
+            break;
         }
     }
+    {
+        std::lock_guard<std::mutex> lock(readahead_mutex_);
+        readahead_.erase(from_index);
+    }
+    compact_pointer_[level] = table->header_.max_ele_key_;
+    ++(Stats(level + 1).trivial_moves_);
+    statistics_.Record(COMPACTION_TRIVIAL_MOVES);
+    JSONWriter event;
+    event.Add("job", ++next_job_id_).Add("event", "trivial_move").Add("from_level", level).Add("to_level", level + 1)
+         .Add("file", GetManifestName(to_index)).Add("bytes", table->file_size_);
+    event_logger_->LogEvent(event);
+    event_logger_->TraceInstant("trivial_move", event);
+    return true;
 }
 
-// if key is not found in this table, it will not change the value of offset
+// level 0 files overlap each other so all of them are taken, other levels give a single file
 template <class KEY, class VALUE>
-bool Memory<KEY, VALUE>::FindKey(KEY key, const SmallSSTable* table, uint32_t &offset) const
+void Memory<KEY, VALUE>::GetCompactionFiles(int level, std::vector<SmallSSTable*> &files_to_compaction)
 {
-    uint64_t index = 0;
-    for (typename std::vector<std::pair<KEY, uint32_t>>::const_iterator index_it = table->index_.begin();
-         index_it != table->index_.end();
-         ++index_it)
+    std::vector<SmallSSTable*> level_files;
+    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin(); buffer_it != buffer_.end(); ++buffer_it)
     {
-        if (key == index_it->first)
+        if (buffer_it->first == level)
         {
-            offset = index;
-            return true;
+            level_files.push_back(&(buffer_it->second));
         }
-        ++index;
     }
-    return false;
-}
-
-template <class KEY, class VALUE>
-VALUE Memory<KEY, VALUE>::FindValue(int level, const SmallSSTable* table, uint32_t offset) const
-{
-    item_index_t item_index{{level,
-                    table->header_.timestamp_,
-                    table->header_.length_,
-                    table->header_.max_ele_key_,
-                    table->header_.min_ele_key_, },
-                           offset};
-    std::vector<VALUE> values;
-    ReadFile(item_index.first, values, false);
-    VALUE value = "";
-    try
+    if (level == 0)
     {
-        value = values.at(offset);
+        files_to_compaction.insert(files_to_compaction.end(), level_files.begin(), level_files.end());
+        return;
     }
-    catch (std::out_of_range e)
+    std::sort(level_files.begin(), level_files.end(), [] (const SmallSSTable* file1, const SmallSSTable* file2)
+    {
+        return file1->header_.min_ele_key_ < file2->header_.min_ele_key_;
+    });
+    SmallSSTable* picked = level_files.front();
+    if (options_.compaction_pick == PICK_ROUND_ROBIN)
     {
-        std::cerr << e.what() << std::endl;
+        typename std::map<int, KEY>::const_iterator pointer_it = compact_pointer_.find(level);
+        if (pointer_it != compact_pointer_.end())
+        {
+            for (typename std::vector<SmallSSTable*>::const_iterator file_it = level_files.begin();
+                 file_it != level_files.end();
+                 ++file_it)
+            {
+                if ((*file_it)->header_.min_ele_key_ > pointer_it->second)
+                {
+                    picked = *file_it;
+                    break;
+                }
+            }
+        }
     }
-    return value;
-}
-
-template <class KEY, class VALUE>
-std::vector<std::string> Memory<KEY, VALUE>::Split(const std::string &str, char delim) const
-{
-    std::istringstream iss(str);
-    std::string item;
-    std::vector<std::string> items;
-    items.clear();
-    while (getline(iss, item, delim))
+    else
     {
-        items.push_back(item);
+        // overlapping bytes below per byte of the file, cross-multiplied to stay in integers
+        uint64_t min_overlap = UINT64_MAX;
+        uint64_t min_size = 1;
+        for (typename std::vector<SmallSSTable*>::const_iterator file_it = level_files.begin();
+             file_it != level_files.end();
+             ++file_it)
+        {
+            uint64_t overlap = OverlappingBytes(level + 1, (*file_it)->header_.min_ele_key_, (*file_it)->header_.max_ele_key_);
+            uint64_t size = ((*file_it)->file_size_ == 0)? 1 : (*file_it)->file_size_;
+            if (min_overlap == UINT64_MAX || overlap * min_size < min_overlap * size)
+            {
+                picked = *file_it;
+                min_overlap = overlap;
+                min_size = size;
+            }
+        }
     }
-    return items;
+    compact_pointer_[level] = picked->header_.max_ele_key_;
+    files_to_compaction.push_back(picked);
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::PackSmallSSTableRange(std::vector<std::pair<int, const SmallSSTable*>> &tables,
-                                               uint64_t min,
-                                               uint64_t max,
-                                               std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package) const
+uint64_t Memory<KEY, VALUE>::GetCompactionFilesRange(int level, const KEY &min, const KEY &max,
+                                                     std::vector<SmallSSTable*> &files_to_compaction)
 {
-    tables_package.reserve(tables.size());
-    for (typename std::vector<std::pair<int, const SmallSSTable*>>::const_iterator table = tables.begin();
-         table != tables.end();
-         ++table)
+    uint64_t merge_length = 0;
+    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin(); buffer_it != buffer_.end(); ++buffer_it)
     {
-        uint64_t timestamp = table->second->header_.timestamp_;
-        uint64_t length = table->second->header_.length_;
-        KEY max_ele_key = table->second->header_.max_ele_key_;
-        KEY min_ele_key = table->second->header_.min_ele_key_;
-        uint32_t pos = 0;
-        std::vector<std::pair<KEY, item_index_t>> table_package;
-        for (typename std::vector<std::pair<KEY, uint32_t>>::const_iterator table_it = table->second->index_.begin();
-             table_it != table->second->index_.end();
-             ++table_it)
+        if (buffer_it->first == level && buffer_it->second.header_.max_ele_key_ >= min && buffer_it->second.header_.min_ele_key_ <= max)
         {
-            if (table_it->first >= min && table_it->first <= max)
-            {
-                item_index_t item_index{{table->first, timestamp, length, max_ele_key, min_ele_key}, pos};
-                table_package.push_back({table_it->first, item_index});
-            }
-            ++pos;
+            files_to_compaction.push_back(&(buffer_it->second));
+            merge_length += buffer_it->second.header_.length_;
         }
-        tables_package.push_back(table_package);
     }
+    return merge_length;
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::ScanBuffer(uint64_t min, uint64_t max,
-                                    std::vector<std::pair<int, const SmallSSTable*>> &files_to_scan) const
+uint64_t Memory<KEY, VALUE>::OverlappingBytes(int level, const KEY &min, const KEY &max) const
 {
+    uint64_t bytes = 0;
     for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
          buffer_it != buffer_.end();
          ++buffer_it)
     {
-        if (buffer_it->second.header_.min_ele_key_ < max && buffer_it->second.header_.max_ele_key_ > min)
+        if (buffer_it->first == level && buffer_it->second.header_.max_ele_key_ >= min && buffer_it->second.header_.min_ele_key_ <= max)
         {
-            files_to_scan.push_back({buffer_it->first, &(buffer_it->second)});
+            bytes += buffer_it->second.file_size_;
         }
     }
+    return bytes;
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::Merge(std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package,
-                               std::vector<std::pair<KEY, item_index_t>> &merge_result) const
+void Memory<KEY, VALUE>::Throttle(uint64_t bytes, RateLimiter::Priority priority) const
 {
+    if (limiter_ != nullptr)
+    {
+        limiter_->Request(bytes, priority);
+    }
+}
+
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::SyncPath(const std::string &path, bool is_dir) const
+{
+    if (options_.sync_mode == SYNC_NONE)
+    {
+        return true;
+    }
+    if (utils::syncPath(path.c_str(), !is_dir && options_.sync_mode == SYNC_DATA) != 0)
+    {
+        std::cerr << "Failed to sync " << path << "\n";
+        std::cerr << "Errno: " << errno << "\n";
+        return false;
+    }
+    return true;
+}
+
+// path of the file relative to the store, as the manifest names it
+template <class KEY, class VALUE>
+std::string Memory<KEY, VALUE>::GetManifestName(const file_index_t &file_index) const
+{
+    return GetFilePath(file_index).substr(output_path_.length());
+}
+
+// every output is synced before any is renamed, so their write-back overlaps,
+// then each directory is synced once for all the renames in it
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::InstallFiles(const std::vector<file_index_t> &files) const
+{
+    for (typename std::vector<file_index_t>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        if (!SyncPath(GetFilePath(*file_it) + TEMP_SUFFIX_, false))
+        {
+            return false;
+        }
+    }
+    std::set<int> levels;
+    for (typename std::vector<file_index_t>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        std::string file_path = GetFilePath(*file_it);
+        if (rename((file_path + TEMP_SUFFIX_).c_str(), file_path.c_str()) != 0)
+        {
+            std::cerr << "Failed to install file " << file_path << "\n";
+            std::cerr << "Errno: " << errno << "\n";
+            return false;
+        }
+        levels.insert(std::get<0>(*file_it));
+    }
+    for (std::set<int>::const_iterator level_it = levels.begin(); level_it != levels.end(); ++level_it)
+    {
+        if (!SyncPath(output_path_ + "level" + std::to_string(*level_it), true))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// what a failed flush or compaction wrote, whether it was installed yet or not
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::RemoveOutputs(const std::vector<file_index_t> &files) const
+{
+    for (typename std::vector<file_index_t>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        std::string file_path = GetFilePath(*file_it);
+        utils::rmfile((file_path + TEMP_SUFFIX_).c_str());
+        utils::rmfile(file_path.c_str());
+    }
+}
+
+// an edit is one line, "<last sequence> <timestamp> +<file> ... -<file> ...",
+// a line a crash cut short is ignored on recovery
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::LogEdit(const std::vector<file_index_t> &added, const std::vector<file_index_t> &removed)
+{
+    manifest_ << last_sequence_ << " " << SSTable<KEY, VALUE>::timestamp_;
+    for (typename std::vector<file_index_t>::const_iterator file_it = added.begin(); file_it != added.end(); ++file_it)
+    {
+        manifest_ << " +" << GetManifestName(*file_it);
+    }
+    for (typename std::vector<file_index_t>::const_iterator file_it = removed.begin(); file_it != removed.end(); ++file_it)
+    {
+        manifest_ << " -" << GetManifestName(*file_it);
+    }
+    manifest_ << "\n";
+    manifest_.flush();
+    if (!manifest_.good())
+    {
+        std::cerr << "Failed to write file " << output_path_ << "MANIFEST\n";
+        return false;
+    }
+    return SyncPath(output_path_ + "MANIFEST", false);
+}
+
+// an edit that failed to be logged may be in the manifest in part or in whole, so the manifest is
+// rewritten from the buffer, where the edit never happened; the files it added only go once that worked,
+// until then a crash may still recover them
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::AbandonEdit(const std::vector<file_index_t> &added)
+{
+    if (WriteManifest())
+    {
+        RemoveOutputs(added);
+    }
+}
+
+// the live files as a single edit, replacing the whole log through a rename
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::WriteManifest()
+{
+    std::string manifest_path = output_path_ + "MANIFEST";
+    manifest_.close();
+    std::ofstream out(manifest_path + TEMP_SUFFIX_, std::ios::out | std::ios::trunc);
+    out << last_sequence_ << " " << SSTable<KEY, VALUE>::timestamp_;
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        out << " +" << GetManifestName(GetFileIndex(buffer_it->first, &(buffer_it->second)));
+    }
+    out << "\n";
+    out.close();
+    bool success = !out.fail() && SyncPath(manifest_path + TEMP_SUFFIX_, false);
+    if (success && rename((manifest_path + TEMP_SUFFIX_).c_str(), manifest_path.c_str()) != 0)
+    {
+        std::cerr << "Failed to install file " << manifest_path << "\n";
+        std::cerr << "Errno: " << errno << "\n";
+        success = false;
+    }
+    success = success && SyncPath(output_path_, true);
+    manifest_.open(manifest_path, std::ios::out | std::ios::app);
+    return success;
+}
+
+// the manifest names the live files, anything else under the level directories is an output
+// or input a crash left behind; a store without a manifest keeps every table it has
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::Recover()
+{
+    if (!utils::dirExists(output_path_))
+    {
+        utils::mkdir(output_path_.c_str());
+    }
+    std::set<std::string> live_files;
+    uint64_t sequence = 0;
+    int timestamp = 0;
+    std::ifstream manifest_in(output_path_ + "MANIFEST", std::ios::in);
+    bool has_manifest = manifest_in.is_open();
+    std::string line;
+    while (std::getline(manifest_in, line) && !manifest_in.eof())
+    {
+        std::istringstream line_in(line);
+        uint64_t edit_sequence = 0;
+        int edit_timestamp = 0;
+        std::string name;
+        line_in >> edit_sequence >> edit_timestamp;
+        sequence = std::max(sequence, edit_sequence);
+        timestamp = std::max(timestamp, edit_timestamp);
+        while (line_in >> name)
+        {
+            if (name[0] == '+')
+            {
+                live_files.insert(name.substr(1));
+            }
+            else
+            {
+                live_files.erase(name.substr(1));
+            }
+        }
+    }
+    manifest_in.close();
+
+    std::vector<std::string> dirs;
+    if (utils::dirExists(output_path_))
+    {
+        utils::scanDir(output_path_, dirs);
+    }
+    for (std::vector<std::string>::const_iterator dir_it = dirs.begin(); dir_it != dirs.end(); ++dir_it)
+    {
+        if (dir_it->compare(0, 5, "level") != 0 || !utils::dirExists(output_path_ + *dir_it))
+        {
+            continue;
+        }
+        std::vector<std::string> files;
+        utils::scanDir(output_path_ + *dir_it, files);
+        for (std::vector<std::string>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+        {
+            std::string name = *dir_it + "/" + *file_it;
+            bool is_table = file_it->size() > 4 && file_it->compare(file_it->size() - 4, 4, ".sst") == 0;
+            if (!has_manifest && is_table)
+            {
+                live_files.insert(name);
+            }
+            else if (live_files.count(name) == 0)
+            {
+                utils::rmfile((output_path_ + name).c_str());
+            }
+        }
+    }
+
+    for (std::set<std::string>::const_iterator file_it = live_files.begin(); file_it != live_files.end(); ++file_it)
+    {
+        int level = std::atoi(file_it->c_str() + 5);
+        SSTable<KEY, VALUE> sstable(BLOOM_FILTER_SIZE_);
+        if (!sstable.SSTableIn(output_path_ + *file_it))
+        {
+            std::cerr << "Failed to open file " << output_path_ + *file_it << "\n";
+            continue;
+        }
+        buffer_.emplace_back(std::piecewise_construct, std::forward_as_tuple(level), std::forward_as_tuple(sstable));
+        LoadBlobBytes(level, &(buffer_.back().second));
+        sequence = std::max(sequence, buffer_.back().second.max_seq_);
+        timestamp = std::max(timestamp, (int)sstable.header().timestamp_);
+    }
+
+    // a value log file no table points into was written for a table a crash kept from being installed,
+    // or outlived the edit dropping its last table
+    std::string blob_dir = output_path_ + "blob";
+    if (options_.min_blob_size > 0 && !utils::dirExists(blob_dir))
+    {
+        utils::_mkdir(blob_dir.c_str());
+    }
+    std::vector<std::string> blob_names;
+    if (utils::dirExists(blob_dir))
+    {
+        utils::scanDir(blob_dir, blob_names);
+    }
+    std::map<uint64_t, uint64_t> live_blob_bytes = LiveBlobBytes();
+    for (std::vector<std::string>::const_iterator name_it = blob_names.begin(); name_it != blob_names.end(); ++name_it)
+    {
+        uint64_t file_number = std::strtoull(name_it->c_str(), nullptr, 10);
+        next_blob_file_ = std::max<uint64_t>(next_blob_file_, file_number + 1);
+        if (live_blob_bytes.count(file_number) != 0)
+        {
+            AddBlobFile(file_number);
+        }
+        else
+        {
+            utils::rmfile((blob_dir + "/" + *name_it).c_str());
+        }
+    }
+    last_sequence_ = std::max(last_sequence_, sequence);
+    SSTable<KEY, VALUE>::timestamp_ = std::max(SSTable<KEY, VALUE>::timestamp_, timestamp);
+    WriteManifest();
+}
+
+// only flushes write here, they go ahead of compactions waiting on the rate limiter; a table that
+// could not be made durable and logged is taken out of the buffer again
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::WriteToDisk(int level, const SSTable<KEY, VALUE> &sstable)
+{
+    Throttle(sstable.FileSize(), RateLimiter::IO_HIGH);
+    buffer_.emplace_back(std::piecewise_construct, std::forward_as_tuple(level), std::forward_as_tuple(sstable));
+    file_index_t file_index = GetFileIndex(level, &(buffer_.back().second));
+    std::string level_path = output_path_ + "level" + std::to_string(level) + "/";
+    if (!MakeLevelDir(level) || !sstable.SSTableOut(level_path, TEMP_SUFFIX_, options_.use_direct_writes))
+    {
+        std::cerr << "Failed to write file " << GetFilePath(file_index) << TEMP_SUFFIX_ << "\n";
+        buffer_.pop_back();
+        RemoveOutputs({file_index});
+        return false;
+    }
+    if (!InstallFiles({file_index}))
+    {
+        buffer_.pop_back();
+        RemoveOutputs({file_index});
+        return false;
+    }
+    if (!LogEdit({file_index}, {}))
+    {
+        buffer_.pop_back();
+        AbandonEdit({file_index});
+        return false;
+    }
+    LoadBlobBytes(level, &(buffer_.back().second));
+    LevelStats &stats = Stats(level);
+    stats.bytes_written_ += buffer_.back().second.file_size_;
+    ++(stats.files_written_);
+    statistics_.Record(FLUSH_COUNT);
+    statistics_.Record(FLUSH_BYTES_WRITTEN, buffer_.back().second.file_size_);
+    return true;
+}
+
+template <class KEY, class VALUE>
+typename Memory<KEY, VALUE>::file_index_t Memory<KEY, VALUE>::GetFileIndex(int level, const SmallSSTable* table) const
+{
+    return file_index_t{level,
+                table->header_.timestamp_,
+                table->header_.length_,
+                table->header_.max_ele_key_,
+                table->header_.min_ele_key_};
+}
+
+template <class KEY, class VALUE>
+std::string Memory<KEY, VALUE>::GetFilePath(const file_index_t &file_index) const
+{
+    int level = std::get<0>(file_index);
+    std::string filename = SSTable<KEY, VALUE>::FileName(std::get<1>(file_index), std::get<2>(file_index),
+                                                         std::get<3>(file_index), std::get<4>(file_index));
+    return output_path_ + "level" + std::to_string(level) + "/" + filename;
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::RemoveFile(const file_index_t &file_index) const
+{
+    std::string file_path = GetFilePath(file_index);
+    if (remove(file_path.c_str()) == -1)
+    {
+        std::cerr << "Failed to delete file " << file_path << "\n";
+        std::cerr << "Errno: " << errno << "\n";
+    }
+}
+
+template <class KEY, class VALUE>
+std::string Memory<KEY, VALUE>::BlobFilePath(uint64_t file_number) const
+{
+    return output_path_ + "blob/" + std::to_string(file_number) + ".blob";
+}
+
+// the blob directory is made on recovery whenever values may be separated
+template <class KEY, class VALUE>
+std::unique_ptr<BlobFileWriter> Memory<KEY, VALUE>::NewBlobFile() const
+{
+    uint64_t file_number = next_blob_file_++;
+    return BlobFileWriter::Open(BlobFilePath(file_number), file_number);
+}
+
+// the file is durable before any table pointing into it is installed
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::FinishBlobFile(BlobFileWriter &writer, RateLimiter::Priority priority) const
+{
+    std::string file_path = BlobFilePath(writer.file_number());
+    if (!writer.Finish())
+    {
+        std::cerr << "Failed to write file " << file_path << "\n";
+        return false;
+    }
+    Throttle(writer.file_size(), priority);
+    statistics_.Record(BLOB_BYTES_WRITTEN, writer.file_size());
+    return SyncPath(file_path, false) && SyncPath(output_path_ + "blob", true);
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::AddBlobFile(uint64_t file_number)
+{
+    std::shared_ptr<const BlobFileReader> reader = BlobFileReader::Open(BlobFilePath(file_number));
+    if (reader != nullptr)
+    {
+        blob_files_[file_number] = reader;
+    }
+}
+
+// the value a blob index points to, pinned into the mapped value log file
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::ReadBlob(std::string_view blob_index, PinnableValue *value) const
+{
+    BlobIndex index;
+    if (!index.Decode(blob_index))
+    {
+        std::cerr << "Corrupted blob index\n";
+        return false;
+    }
+    typename std::map<uint64_t, std::shared_ptr<const BlobFileReader>>::const_iterator file_it =
+            blob_files_.find(index.file_number_);
+    if (file_it == blob_files_.end() || !file_it->second->Read(index, value))
+    {
+        std::cerr << "Failed to read file " << BlobFilePath(index.file_number_) << "\n";
+        return false;
+    }
+    statistics_.Record(BLOB_BYTES_READ, index.size_);
+    return true;
+}
+
+// what the entries of a table point to in the value log, decoded from the table file
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::LoadBlobBytes(int level, SmallSSTable* table) const
+{
+    table->blob_bytes_.clear();
+    for (uint32_t offset = 0; offset < table->index_.size(); ++offset)
+    {
+        PinnableValue value;
+        BlobIndex index;
+        if (table->index_[offset].type_ == TYPE_BLOB_INDEX && PinValue(level, table, offset, &value) &&
+                index.Decode(value.view()))
+        {
+            table->blob_bytes_[index.file_number_] += index.size_;
+        }
+    }
+}
+
+// value bytes of each value log file that some table still points to, versions kept for snapshots included
+template <class KEY, class VALUE>
+std::map<uint64_t, uint64_t> Memory<KEY, VALUE>::LiveBlobBytes() const
+{
+    std::map<uint64_t, uint64_t> live_bytes;
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        for (std::map<uint64_t, uint64_t>::const_iterator blob_it = buffer_it->second.blob_bytes_.begin();
+             blob_it != buffer_it->second.blob_bytes_.end();
+             ++blob_it)
+        {
+            live_bytes[blob_it->first] += blob_it->second;
+        }
+    }
+    return live_bytes;
+}
+
+// the value log files at least blob_gc_garbage_ratio garbage, compactions move what is left of them
+template <class KEY, class VALUE>
+std::set<uint64_t> Memory<KEY, VALUE>::CollectibleBlobFiles() const
+{
+    std::set<uint64_t> files;
+    std::map<uint64_t, uint64_t> live_bytes = LiveBlobBytes();
+    for (typename std::map<uint64_t, std::shared_ptr<const BlobFileReader>>::const_iterator file_it = blob_files_.begin();
+         file_it != blob_files_.end();
+         ++file_it)
+    {
+        std::map<uint64_t, uint64_t>::const_iterator live_it = live_bytes.find(file_it->first);
+        uint64_t live = (live_it == live_bytes.end())? 0 : live_it->second;
+        uint64_t total = file_it->second->value_bytes();
+        if (live < total && total - live >= options_.blob_gc_garbage_ratio * total)
+        {
+            files.insert(file_it->first);
+        }
+    }
+    return files;
+}
+
+// a table pointing into a value log file that is mostly garbage is compacted on its own and in its level,
+// which moves its live values to a new file; its tombstones are kept, the level may hold older versions
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::CollectBlobGarbage()
+{
+    std::set<uint64_t> victims = CollectibleBlobFiles();
+    std::vector<std::pair<int, SmallSSTable*>> tables;
+    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        for (std::map<uint64_t, uint64_t>::const_iterator blob_it = buffer_it->second.blob_bytes_.begin();
+             blob_it != buffer_it->second.blob_bytes_.end();
+             ++blob_it)
+        {
+            if (victims.count(blob_it->first) != 0)
+            {
+                tables.push_back({buffer_it->first, &(buffer_it->second)});
+                break;
+            }
+        }
+    }
+    for (typename std::vector<std::pair<int, SmallSSTable*>>::const_iterator table_it = tables.begin();
+         table_it != tables.end();
+         ++table_it)
+    {
+        std::vector<SmallSSTable*> files{table_it->second};
+        if (!Compaction(files, table_it->first, table_it->first, false))
+        {
+            return;
+        }
+    }
+}
+
+// a value log file goes once the edit dropping the last table pointing into it is logged,
+// values already handed out keep their mapping
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::DeleteObsoleteBlobFiles()
+{
+    std::map<uint64_t, uint64_t> live_bytes = LiveBlobBytes();
+    typename std::map<uint64_t, std::shared_ptr<const BlobFileReader>>::iterator file_it = blob_files_.begin();
+    while (file_it != blob_files_.end())
+    {
+        if (live_bytes.count(file_it->first) != 0)
+        {
+            ++file_it;
+            continue;
+        }
+        utils::rmfile(BlobFilePath(file_it->first).c_str());
+        statistics_.Record(BLOB_FILES_DELETED);
+        file_it = blob_files_.erase(file_it);
+    }
+}
+
+// the memtable as the entries of a table, values of at least min_blob_size moved to a new value log file;
+// blob_bytes is the size of that file, 0 if no value was that large, and false is returned if it could not be made durable
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::SeparateValues(std::vector<typename SSTable<KEY, VALUE>::entry_t> &entries, uint64_t &blob_bytes)
+{
+    std::unique_ptr<BlobFileWriter> writer;
+    auto add = [&] (const KEY &key, const VALUE &value, ValueType type, uint64_t seq)
+    {
+        if (type == TYPE_VALUE && ValueTraits<VALUE>::Size(value) >= options_.min_blob_size)
+        {
+            if (writer == nullptr)
+            {
+                writer = NewBlobFile();
+            }
+            if (writer != nullptr)
+            {
+                entries.emplace_back(key, ValueTraits<VALUE>::FromBytes(writer->Add(KeyTraits<KEY>::Bytes(key),
+                                     ValueTraits<VALUE>::Bytes(value)).Encode()), TYPE_BLOB_INDEX, seq);
+                return;
+            }
+        }
+        entries.emplace_back(key, value, type, seq);
+    };
+    entries.reserve(element_num_);
+    for (typename SkipList<KEY, VALUE>::Iterator it = list_->Begin(); it.Valid(); it.Next())
+    {
+        add(it.Key(), it.Value(), it.Type(), it.Sequence());
+        const std::vector<typename SkipList<KEY, VALUE>::Version> &older = it.Older();
+        for (typename std::vector<typename SkipList<KEY, VALUE>::Version>::const_reverse_iterator version_it = older.rbegin();
+             version_it != older.rend();
+             ++version_it)
+        {
+            add(it.Key(), version_it->val, version_it->vtype, version_it->seq);
+        }
+    }
+    blob_bytes = 0;
+    if (writer == nullptr)
+    {
+        return true;
+    }
+    if (!FinishBlobFile(*writer, RateLimiter::IO_HIGH))
+    {
+        utils::rmfile(BlobFilePath(writer->file_number()).c_str());
+        return false;
+    }
+    AddBlobFile(writer->file_number());
+    blob_bytes = writer->file_size();
+    return true;
+}
+
+// tombstones may only be dropped when nothing older can be hidden below the level
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::IsBottommostLevel(int level) const
+{
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        if (buffer_it->first > level)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// reads without a snapshot see every write
+template <class KEY, class VALUE>
+uint64_t Memory<KEY, VALUE>::ReadSequence(const Snapshot* snapshot) const
+{
+    return (snapshot == nullptr)? last_sequence_ : snapshot->sequence();
+}
+
+// whether a live snapshot lies in [begin, end)
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::HasSnapshot(uint64_t begin, uint64_t end) const
+{
+    typename std::multiset<uint64_t>::const_iterator snapshot_it = snapshots_.lower_bound(begin);
+    return snapshot_it != snapshots_.end() && *snapshot_it < end;
+}
+
+// a version hidden from next_seq on is still read by the latest view if nothing hides it,
+// otherwise only by a snapshot taken before next_seq
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::IsLive(uint64_t seq, uint64_t next_seq) const
+{
+    return next_seq == UINT64_MAX || HasSnapshot(seq, next_seq);
+}
+
+// the oldest range tombstone over key written after seq, UINT64_MAX if there is none
+template <class KEY, class VALUE>
+uint64_t Memory<KEY, VALUE>::CoveringSequence(const std::vector<range_index_t> &range_tombstones, const KEY &key, uint64_t seq)
+{
+    uint64_t covering_seq = UINT64_MAX;
+    for (typename std::vector<range_index_t>::const_iterator range_it = range_tombstones.begin();
+         range_it != range_tombstones.end();
+         ++range_it)
+    {
+        if (range_it->second.Covers(key) && range_it->second.seq_ > seq && range_it->second.seq_ < covering_seq)
+        {
+            covering_seq = range_it->second.seq_;
+        }
+    }
+    return covering_seq;
+}
+
+// the part of every tombstone that falls into [min, max], so output files of a level never overlap
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::ClipRangeTombstones(const std::vector<range_index_t> &range_tombstones, KEY min, KEY max,
+                                             std::vector<range_tombstone_t> &clipped)
+{
+    clipped.clear();
+    for (typename std::vector<range_index_t>::const_iterator range_it = range_tombstones.begin();
+         range_it != range_tombstones.end();
+         ++range_it)
+    {
+        if (range_it->second.end_ < min || range_it->second.begin_ > max)
+        {
+            continue;
+        }
+        KEY begin = (range_it->second.begin_ > min)? range_it->second.begin_ : min;
+        KEY end = (range_it->second.end_ < max)? range_it->second.end_ : max;
+        clipped.push_back(range_tombstone_t{begin, end, range_it->second.seq_});
+    }
+}
+
+// return the table holding the newest entry of key visible at sequence,
+// nullptr if there is none or it is covered by a range tombstone
+template <class KEY, class VALUE>
+const typename Memory<KEY, VALUE>::SmallSSTable* Memory<KEY, VALUE>::FindNewestEntry(const KEY &key, uint64_t sequence,
+                                                                                     int &level, uint32_t &offset) const
+{
+    const SmallSSTable* entry_table = nullptr;
+    int entry_level = 0;
+    uint32_t entry_offset = 0;
+    uint64_t entry_seq = 0;
+    uint64_t range_seq = 0;
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        const SmallSSTable* table = &(buffer_it->second);
+        if (key < table->header_.min_ele_key_ || key > table->header_.max_ele_key_)
+        {
+            continue;
+        }
+        uint32_t table_offset = 0;
+        if ((entry_table == nullptr || table->max_seq_ > entry_seq) && ProbeTable(key, sequence, table, table_offset) &&
+                (entry_table == nullptr || table->index_[table_offset].seq_ > entry_seq))
+        {
+            entry_table = table;
+            entry_level = buffer_it->first;
+            entry_offset = table_offset;
+            entry_seq = table->index_[table_offset].seq_;
+        }
+        for (typename std::vector<range_tombstone_t>::const_iterator range_it = table->range_tombstones_.begin();
+             range_it != table->range_tombstones_.end();
+             ++range_it)
+        {
+            if (range_it->Covers(key) && range_it->seq_ <= sequence && range_it->seq_ > range_seq)
+            {
+                range_seq = range_it->seq_;
+            }
+        }
+    }
+    if (entry_table == nullptr || range_seq > entry_seq)
+    {
+        return nullptr;
+    }
+    level = entry_level;
+    offset = entry_offset;
+    return entry_table;
+}
+
+// answer from the memtable alone, DEL_UNKNOWN if it has to go to the tables;
+// value is set when the key is found
+template <class KEY, class VALUE>
+DelResult Memory<KEY, VALUE>::FindInMemTable(const KEY &key, uint64_t sequence, const VALUE* &value) const
+{
+    ValueType type;
+    uint64_t seq = 0;
+    const VALUE* mem_value = list_->Find(key, type, seq, sequence);
+    uint64_t range_seq = 0;
+    for (typename std::vector<range_tombstone_t>::const_iterator range_it = range_list_.begin();
+         range_it != range_list_.end();
+         ++range_it)
+    {
+        if (range_it->Covers(key) && range_it->seq_ <= sequence && range_it->seq_ > range_seq)
+        {
+            range_seq = range_it->seq_;
+        }
+    }
+    // a memtable range tombstone is newer than everything in the tables
+    if (mem_value == nullptr)
+    {
+        return (range_seq != 0)? DEL_NOT_FOUND : DEL_UNKNOWN;
+    }
+    if (type == TYPE_DELETION || range_seq > seq)
+    {
+        return DEL_NOT_FOUND;
+    }
+    value = mem_value;
+    return DEL_FOUND;
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::CollectRangeTombstones(const std::vector<SmallSSTable*> &files, int level,
+                                                std::vector<range_index_t> &range_tombstones,
+                                                const std::set<const SmallSSTable*> *skip_files) const
+{
+    for (typename std::vector<SmallSSTable*>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        if (skip_files != nullptr && skip_files->count(*file_it) != 0)
+        {
+            continue;
+        }
+        file_index_t file_index = GetFileIndex(level, *file_it);
+        for (typename std::vector<range_tombstone_t>::const_iterator range_it = (*file_it)->range_tombstones_.begin();
+             range_it != (*file_it)->range_tombstones_.end();
+             ++range_it)
+        {
+            range_tombstones.push_back({file_index, *range_it});
+        }
+    }
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::MarkCoveredFiles(const std::vector<SmallSSTable*> &files, int level,
+                                          const std::vector<range_index_t> &range_tombstones,
+                                          std::set<const SmallSSTable*> &covered_files) const
+{
+    for (typename std::vector<SmallSSTable*>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
+    {
+        for (typename std::vector<range_index_t>::const_iterator range_it = range_tombstones.begin();
+             range_it != range_tombstones.end();
+             ++range_it)
+        {
+            // no snapshot may see an entry or a tombstone of the file before the covering tombstone
+            if (range_it->second.begin_ <= (*file_it)->header_.min_ele_key_ &&
+                    (*file_it)->header_.max_ele_key_ <= range_it->second.end_ &&
+                    range_it->second.seq_ > (*file_it)->max_seq_ &&
+                    !HasSnapshot((*file_it)->min_seq_, range_it->second.seq_) &&
+                    range_it->first != GetFileIndex(level, *file_it))
+            {
+                covered_files.insert(*file_it);
+                break;
+            }
+        }
+    }
+}
+
+template <class KEY, class VALUE>
+std::tuple<uint64_t, uint64_t, KEY, KEY> Memory<KEY, VALUE>::ReadHead(std::string filename) const
+{
+    SSTable<KEY, VALUE> sstable(BLOOM_FILTER_SIZE_);
+    if (!sstable.SSTableIn(filename))
+    {
+        std::cerr << "Failed to open file " << filename << "\n";
+        return std::tuple<uint64_t, uint64_t, KEY, KEY>{0, 0, KEY(), KEY()};
+    }
+    const typename SSTable<KEY, VALUE>::Head &head = sstable.header();
+    return std::tuple<uint64_t, uint64_t, KEY, KEY>{head.timestamp_, head.length_, head.max_ele_key_, head.min_ele_key_};
+}
+
+// the bytes [offset, offset + length) of the file, as far as it goes
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::SubmitRead(FileRead &read, uint64_t offset, uint64_t length) const
+{
+    std::string file_path = GetFilePath(read.file_);
+    read.fd_ = open(file_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (read.fd_ == -1 || fstat(read.fd_, &st) == -1)
+    {
+        std::cerr << "Failed to open file " << file_path << "\n";
+        std::cerr << "Errno: " << errno << "\n";
+        if (read.fd_ != -1)
+        {
+            close(read.fd_);
+            read.fd_ = -1;
+        }
+        return false;
+    }
+    uint64_t file_size = st.st_size;
+    offset = (offset > file_size)? file_size : offset;
+    length = (length > file_size - offset)? file_size - offset : length;
+    read.data_.resize(length);
+    read.request_ = IOBackend::Request{read.fd_, offset, read.data_.size(), read.data_.data(), 0, false};
+    io_->Submit(&(read.request_));
+    return true;
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::WaitRead(FileRead &read) const
+{
+    if (read.fd_ == -1)
+    {
+        return;
+    }
+    io_->Wait(&(read.request_));
+    close(read.fd_);
+    read.fd_ = -1;
+    if (read.request_.result_ < 0)
+    {
+        std::cerr << "Failed to read file " << GetFilePath(read.file_) << "\n";
+        std::cerr << "Errno: " << -read.request_.result_ << "\n";
+    }
+    read.data_.resize((read.request_.result_ < 0)? 0 : read.request_.result_);
+}
+
+// a whole file was read, a tombstone's value comes out empty (or zero, its bytes in a fixed-width table);
+// false if the file could not be opened, was read short or does not parse
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::FinishRead(FileRead &read, std::vector<VALUE> &values) const
+{
+    if (read.fd_ == -1)
+    {
+        return false;
+    }
+    WaitRead(read);
+    if (read.data_.size() != read.request_.length_)
+    {
+        std::cerr << "Failed to read file " << GetFilePath(read.file_) << ", " << read.data_.size() << " of "
+                  << read.request_.length_ << " bytes\n";
+        std::vector<char>().swap(read.data_);
+        return false;
+    }
+    uint64_t size = read.data_.size();
+    const char* data = read.data_.data();
+    typename SSTable<KEY, VALUE>::Head header;
+    const char* filter = nullptr;
+    std::vector<range_tombstone_t> range_tombstones;
+    std::vector<index_entry_t> index;
+    uint64_t data_offset = SSTable<KEY, VALUE>::Deserialize(data, size, BLOOM_FILTER_SIZE_, header, filter,
+                                                            range_tombstones, index);
+    if (data_offset == 0)
+    {
+        std::cerr << "Failed to read file " << GetFilePath(read.file_) << "\n";
+        std::vector<char>().swap(read.data_);
+        return false;
+    }
+    values.reserve(index.size());
+    for (typename std::vector<index_entry_t>::const_iterator index_it = index.begin(); index_it != index.end(); ++index_it)
+    {
+        uint32_t offset = index_it->offset_;
+        uint32_t next_offset = (std::next(index_it) != index.end())? std::next(index_it)->offset_ : size - data_offset;
+        values.push_back(ValueTraits<VALUE>::FromBytes(std::string_view(data + data_offset + offset, next_offset - offset)));
+    }
+    std::vector<char>().swap(read.data_);
+    return true;
+}
+
+// one byte range of each table, all read at once; a range starting at or a little after where the
+// last scan of the table stopped doubles the table's readahead, which is read with it and kept
+// for the next scan, and the kernel is asked to fetch the window after that
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::ReadScanRanges(const std::map<file_index_t, std::pair<uint64_t, uint64_t>> &ranges,
+        std::map<file_index_t, std::pair<uint64_t, std::shared_ptr<const std::vector<char>>>> &file_bytes) const
+{
+    const uint64_t MIN_READAHEAD = 16 * 1024;
+    std::lock_guard<std::mutex> lock(readahead_mutex_);
+    std::vector<FileRead> reads(ranges.size());
+    std::vector<uint64_t> windows(ranges.size(), 0);
+    size_t i = 0;
+    for (typename std::map<file_index_t, std::pair<uint64_t, uint64_t>>::const_iterator range_it = ranges.begin();
+         range_it != ranges.end();
+         ++range_it, ++i)
+    {
+        uint64_t begin = range_it->second.first;
+        uint64_t end = range_it->second.second;
+        Readahead &readahead = readahead_[range_it->first];
+        bool sequential = readahead.next_offset_ != 0 && begin >= readahead.next_offset_ &&
+                begin - readahead.next_offset_ <= std::max(readahead.window_, MIN_READAHEAD);
+        readahead.window_ = !sequential? 0 : std::min<uint64_t>(std::max(readahead.window_ * 2, MIN_READAHEAD),
+                                                               options_.scan_readahead_size);
+        readahead.next_offset_ = end;
+        if (readahead.data_ != nullptr && begin >= readahead.offset_ && end <= readahead.offset_ + readahead.data_->size())
+        {
+            file_bytes[range_it->first] = {readahead.offset_, readahead.data_};
+            continue;
+        }
+        reads[i].file_ = range_it->first;
+        windows[i] = readahead.window_;
+        if (SubmitRead(reads[i], begin, end - begin + readahead.window_) && readahead.window_ != 0)
+        {
+#if defined(POSIX_FADV_WILLNEED)
+            posix_fadvise(reads[i].fd_, begin + reads[i].data_.size(), readahead.window_ * 2, POSIX_FADV_WILLNEED);
+#endif
+        }
+    }
+    i = 0;
+    for (typename std::map<file_index_t, std::pair<uint64_t, uint64_t>>::const_iterator range_it = ranges.begin();
+         range_it != ranges.end();
+         ++range_it, ++i)
+    {
+        if (reads[i].fd_ == -1)
+        {
+            continue;
+        }
+        WaitRead(reads[i]);
+        statistics_.Record(SCAN_BYTES_READ, reads[i].data_.size());
+        PerfCount(&PerfContext::scan_read_bytes, reads[i].data_.size());
+        std::shared_ptr<const std::vector<char>> data(new std::vector<char>(std::move(reads[i].data_)));
+        file_bytes[range_it->first] = {range_it->second.first, data};
+        Readahead &readahead = readahead_[range_it->first];
+        readahead.offset_ = range_it->second.first;
+        readahead.data_ = (windows[i] == 0)? nullptr : data;
+    }
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::MergeSort(typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge1_it,
+               const typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge1_end,
+               typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge2_it,
+               const typename std::vector<std::pair<KEY, item_index_t>>::const_iterator merge2_end,
+               std::vector<std::pair<KEY, item_index_t>> &target) const
+{
+    while (merge1_it != merge1_end && merge2_it != merge2_end)
+    {
+        if (merge1_it->first < merge2_it->first)
+        {
+            target.push_back(*merge1_it);
+            ++merge1_it;
+        }
+        else if (merge1_it->first > merge2_it->first)
+        {
+            target.push_back(*merge2_it);
+            ++merge2_it;
+        }
+        else if (merge1_it->second.seq_ > merge2_it->second.seq_)    // versions of a key go newest first
+        {
+            target.push_back(*merge1_it);
+            ++merge1_it;
+        }
+        else
+        {
+            target.push_back(*merge2_it);
+            ++merge2_it;
+        }
+    }
+    while (merge1_it != merge1_end)
+    {
+        target.push_back(*merge1_it);
+        ++merge1_it;
+    }
+    while (merge2_it != merge2_end)
+    {
+        target.push_back(*merge2_it);
+        ++merge2_it;
+    }
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::PackSmallSSTable(SmallSSTable* table, int level, std::vector<std::pair<KEY, item_index_t>> &table_package) const
+{
+    table_package.clear();
+    uint64_t timestamp = table->header_.timestamp_;
+    uint64_t length = table->header_.length_;
+    KEY max_ele_key = table->header_.max_ele_key_;
+    KEY min_ele_key = table->header_.min_ele_key_;
+    uint32_t pos = 0;
+    for (typename std::vector<index_entry_t>::iterator table_it = table->index_.begin();
+         table_it != table->index_.end();
+         ++table_it)
+    {
+        item_index_t item_index{{level, timestamp, length, max_ele_key, min_ele_key}, pos, table_it->type_, table_it->seq_};
+        table_package.push_back({table_it->key_, item_index});
+        ++pos;
+    }
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::DeleteSmallSSTable(int level, SmallSSTable* table)
+{
+    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        if (buffer_it->first == level && buffer_it->second.header_ == table->header_)
+        {
+            std::lock_guard<std::mutex> lock(readahead_mutex_);
+            readahead_.erase(GetFileIndex(level, table));
+            buffer_.erase(buffer_it);
+            return;
+        }
+    }
+}
+
+// FindKey behind the bloom filter, counting what the filter saved and what it let through
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::ProbeTable(KEY key, uint64_t sequence, const SmallSSTable* table, uint32_t &offset) const
+{
+    statistics_.Record(GET_TABLES_PROBED);
+    PerfCount(&PerfContext::get_tables_probed);
+    StageTimer bloom_timer(StageStatistics(), GET_BLOOM_NANOS, PerfNanos(&PerfContext::get_bloom_nanos));
+    bool may_exist = table->filter_.Exist(key);
+    bloom_timer.Stop();
+    if (!may_exist)
+    {
+        statistics_.Record(BLOOM_FILTER_USEFUL);
+        PerfCount(&PerfContext::bloom_filter_useful);
+        return false;
+    }
+    statistics_.Record(BLOOM_FILTER_POSITIVE);
+    PerfCount(&PerfContext::bloom_filter_positive);
+    StageTimer find_key_timer(StageStatistics(), GET_FIND_KEY_NANOS, PerfNanos(&PerfContext::get_find_key_nanos));
+    bool found = FindKey(key, sequence, table, offset);
+    find_key_timer.Stop();
+    if (!found)
+    {
+        statistics_.Record(BLOOM_FILTER_FALSE_POSITIVE);
+        PerfCount(&PerfContext::bloom_filter_false_positive);
+        return false;
+    }
+    return true;
+}
+
+// find the newest version of key visible at sequence,
+// if there is none in this table, it will not change the value of offset
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::FindKey(KEY key, uint64_t sequence, const SmallSSTable* table, uint32_t &offset) const
+{
+    // the index is sorted by key, then by sequence from new to old
+    typename std::vector<index_entry_t>::const_iterator index_it = table->Seek(key);
+    while (index_it != table->index_.end() && index_it->key_ == key && index_it->seq_ > sequence)
+    {
+        ++index_it;
+    }
+    if (index_it != table->index_.end() && index_it->key_ == key)
+    {
+        offset = index_it - table->index_.begin();
+        return true;
+    }
+    return false;
+}
+
+template <class KEY, class VALUE>
+VALUE Memory<KEY, VALUE>::FindValue(int level, const SmallSSTable* table, uint32_t offset) const
+{
+    PinnableValue value;
+    if (!PinValue(level, table, offset, &value))
+    {
+        return VALUE();
+    }
+    return ValueTraits<VALUE>::FromBytes(value.view());
+}
+
+// point the handle at the value inside the mapped file, the mapping is shared with the table
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::PinValue(int level, const SmallSSTable* table, uint32_t offset, PinnableValue *value) const
+{
+    if (offset >= table->index_.size())
+    {
+        std::cerr << "Offset " << offset << " out of range\n";
+        return false;
+    }
+    if (table->file_ == nullptr)
+    {
+        file_index_t file_index = GetFileIndex(level, table);
+        table->file_ = MappedFile::Open(GetFilePath(file_index));
+        if (table->file_ == nullptr)
+        {
+            std::cerr << "Failed to open file " << GetFilePath(file_index) << "\n";
+            std::cerr << "Errno: " << errno << "\n";
+            return false;
+        }
+    }
+    const MappedFile* file = table->file_.get();
+    uint64_t data_offset = table->data_offset_;
+    uint64_t begin = data_offset + table->index_[offset].offset_;
+    uint64_t end = (offset + 1 < table->index_.size())? data_offset + table->index_[offset + 1].offset_ : file->size();
+    if (begin > end || end > file->size())
+    {
+        std::cerr << "Corrupted file " << table->header_.timestamp_ << "\n";
+        return false;
+    }
+    value->Pin(std::string_view(file->data() + begin, end - begin), table->file_);
+    return true;
+}
+
+template <class KEY, class VALUE>
+std::vector<std::string> Memory<KEY, VALUE>::Split(const std::string &str, char delim) const
+{
+    std::istringstream iss(str);
+    std::string item;
+    std::vector<std::string> items;
+    items.clear();
+    while (getline(iss, item, delim))
+    {
+        items.push_back(item);
+    }
+    return items;
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::PackSmallSSTableRange(std::vector<std::pair<int, const SmallSSTable*>> &tables,
+                                               const KEY &min,
+                                               const KEY &max,
+                                               uint64_t sequence,
+                                               std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package) const
+{
+    tables_package.reserve(tables.size());
+    for (typename std::vector<std::pair<int, const SmallSSTable*>>::const_iterator table = tables.begin();
+         table != tables.end();
+         ++table)
+    {
+        uint64_t timestamp = table->second->header_.timestamp_;
+        uint64_t length = table->second->header_.length_;
+        KEY max_ele_key = table->second->header_.max_ele_key_;
+        KEY min_ele_key = table->second->header_.min_ele_key_;
+        std::vector<std::pair<KEY, item_index_t>> table_package;
+        // only the part of the index inside [min, max] is walked
+        for (typename std::vector<index_entry_t>::const_iterator table_it = table->second->Seek(min);
+             table_it != table->second->index_.end() && table_it->key_ <= max;
+             ++table_it)
+        {
+            // only the newest version visible at sequence is taken from each table
+            if (table_it->seq_ <= sequence && (table_package.empty() || table_package.back().first != table_it->key_))
+            {
+                uint32_t pos = table_it - table->second->index_.begin();
+                item_index_t item_index{{table->first, timestamp, length, max_ele_key, min_ele_key}, pos, table_it->type_,
+                                        table_it->seq_};
+                table_package.push_back({table_it->key_, item_index});
+            }
+        }
+        tables_package.push_back(table_package);
+    }
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::ScanBuffer(const KEY &min, const KEY &max,
+                                    std::vector<std::pair<int, const SmallSSTable*>> &files_to_scan) const
+{
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        if (buffer_it->second.HasRange(min, max))
+        {
+            files_to_scan.push_back({buffer_it->first, &(buffer_it->second)});
+        }
+    }
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::Merge(std::vector<std::vector<std::pair<KEY, item_index_t>>> &tables_package,
+                               std::vector<std::pair<KEY, item_index_t>> &merge_result) const
+{
+    uint64_t merge_length = 0;
+    for (typename std::vector<std::vector<std::pair<KEY, item_index_t>>>::const_iterator table_package = tables_package.begin();
+         table_package != tables_package.end();
+         ++table_package)
+    {
+        merge_length += table_package->size();
+    }
+
+    std::vector<std::pair<KEY, item_index_t>> merge_tapes[2];
+    merge_tapes[0].reserve(merge_length);
+    merge_tapes[1].reserve(merge_length);
+
+    int circle_index = 0;
+
+    for (typename std::vector<std::vector<std::pair<KEY, item_index_t>>>::const_iterator table_package = tables_package.begin();
+         table_package != tables_package.end();
+         ++table_package)
+    {
+        MergeSort(table_package->begin(), table_package->end(),
+                  merge_tapes[circle_index % 2].begin(), merge_tapes[circle_index % 2].end(),
+                merge_tapes[(circle_index + 1) % 2]);
+        merge_tapes[circle_index % 2].clear();
+        circle_index = (circle_index + 1) % 2;
+    }
+
+    merge_result.reserve(merge_tapes[circle_index].size());
+
+    for (typename std::vector<std::pair<KEY, item_index_t>>::const_iterator result = merge_tapes[circle_index].begin();
+         result != merge_tapes[circle_index].end();
+         ++result)
+    {
+        merge_result.push_back(*result);
+    }
+}
+
+// list holds the live memtable entries, deleted_keys the memtable tombstones, both hide older table entries;
+// files_data has the versions of a key newest first, only the first one counts
+// the visible versions are picked first, then the part of every table holding one is read at once
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::ReorganizeScanResult(std::vector<std::pair<KEY, item_index_t>> &files_data,
+                          const std::vector<KEY> &deleted_keys,
+                          const std::vector<range_index_t> &range_tombstones,
+                          const std::map<file_index_t, const SmallSSTable*> &tables,
+                          uint64_t sequence,
+                          std::list<std::pair<KEY, VALUE>> &list) const
+{
+    typename std::vector<std::pair<KEY, item_index_t>>::const_iterator data_it = files_data.begin();
+    typename std::list<std::pair<KEY, VALUE>>::iterator list_it = list.begin();
+    typename std::vector<KEY>::const_iterator deleted_it = deleted_keys.begin();
+    std::vector<std::pair<typename std::vector<std::pair<KEY, item_index_t>>::const_iterator,
+                          typename std::list<std::pair<KEY, VALUE>>::iterator>> visible;
+    while (data_it != files_data.end())
+    {
+        while (list_it != list.end() && list_it->first < data_it->first)
+        {
+            ++list_it;
+        }
+        while (deleted_it != deleted_keys.end() && *deleted_it < data_it->first)
+        {
+            ++deleted_it;
+        }
+        if ((data_it != files_data.begin() && std::prev(data_it)->first == data_it->first) ||
+                (list_it != list.end() && list_it->first == data_it->first) ||
+                (deleted_it != deleted_keys.end() && *deleted_it == data_it->first) ||
+                data_it->second.type_ == TYPE_DELETION ||
+                CoveringSequence(range_tombstones, data_it->first, data_it->second.seq_) <= sequence)
+        {
+            ++data_it;
+            continue;
+        }
+        visible.push_back({data_it, list_it});
+        ++data_it;
+    }
+    // the values a table contributes lie between the first and the last of them in its data
+    std::map<file_index_t, std::pair<uint64_t, uint64_t>> ranges;
+    std::vector<std::pair<uint64_t, uint64_t>> value_ranges;
+    value_ranges.reserve(visible.size());
+    for (typename std::vector<std::pair<typename std::vector<std::pair<KEY, item_index_t>>::const_iterator,
+                                        typename std::list<std::pair<KEY, VALUE>>::iterator>>::const_iterator visible_it = visible.begin();
+         visible_it != visible.end();
+         ++visible_it)
+    {
+        const item_index_t &item = visible_it->first->second;
+        const SmallSSTable* table = tables.at(item.file_);
+        uint64_t data_offset = table->data_offset_;
+        uint64_t begin = data_offset + table->index_[item.pos_].offset_;
+        uint64_t end = (item.pos_ + 1 < table->index_.size())? data_offset + table->index_[item.pos_ + 1].offset_ :
+                                                               table->file_size_;
+        value_ranges.push_back({begin, end});
+        typename std::map<file_index_t, std::pair<uint64_t, uint64_t>>::iterator range_it = ranges.find(item.file_);
+        if (range_it == ranges.end())
+        {
+            ranges.emplace(item.file_, std::make_pair(begin, end));
+        }
+        else
+        {
+            range_it->second.first = std::min(range_it->second.first, begin);
+            range_it->second.second = std::max(range_it->second.second, end);
+        }
+    }
+    std::map<file_index_t, std::pair<uint64_t, std::shared_ptr<const std::vector<char>>>> file_bytes;
+    ReadScanRanges(ranges, file_bytes);
+    for (size_t i = 0; i < visible.size(); ++i)
+    {
+        const std::pair<KEY, item_index_t> &item = *(visible[i].first);
+        const std::pair<uint64_t, std::shared_ptr<const std::vector<char>>> &bytes = file_bytes[item.second.file_];
+        uint64_t begin = value_ranges[i].first - bytes.first;
+        uint64_t end = value_ranges[i].second - bytes.first;
+        end = (end > bytes.second->size())? bytes.second->size() : end;
+        begin = (begin > end)? end : begin;
+        VALUE value = ValueTraits<VALUE>::FromBytes(std::string_view(bytes.second->data() + begin, end - begin));
+        PinnableValue blob;
+        if (item.second.type_ == TYPE_BLOB_INDEX)
+        {
+            value = ReadBlob(ValueTraits<VALUE>::Bytes(value), &blob)? ValueTraits<VALUE>::FromBytes(blob.view()) : VALUE();
+        }
+        list.insert(visible[i].second, {item.first, std::move(value)});
+    }
+}
+
+// only the memtable and the in-memory indexes are consulted, no value is read
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::Exist(const KEY &key) const
+{
+    const VALUE* value = nullptr;
+    DelResult result = FindInMemTable(key, UINT64_MAX, value);
+    if (result != DEL_UNKNOWN)
+    {
+        return result == DEL_FOUND;
+    }
+    int level = 0;
+    uint32_t offset = 0;
+    const SmallSSTable* table = FindNewestEntry(key, UINT64_MAX, level, offset);
+    return table != nullptr && table->index_[offset].type_ != TYPE_DELETION;
+}
+
+// merge the part of the tape a subcompaction owns into files of its own, the tables are
+// only read and written here, Compaction installs the outputs; the versions that survive are
+// picked first, so only the inputs holding one are read, each a few files ahead of the merge,
+// and an output is written on a thread of its own while the next one is merged
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::RunSubcompaction(Subcompaction &sub, const std::vector<range_index_t> &range_tombstones,
+                                          const std::vector<range_index_t> &output_candidates,
+                                          int output_level, bool bottommost,
+                                          const std::set<uint64_t> &blob_victims) const
+{
+    typedef typename std::vector<std::pair<KEY, item_index_t>>::const_iterator tape_iterator;
+    sub.tid_ = EventLogger::ThreadId();
+    sub.start_micros_ = event_logger_->NowMicros();
+    std::vector<tape_iterator> kept;
+    uint64_t next_seq = UINT64_MAX;         // sequence of the version of the same key just before this one
+    for (tape_iterator item_it = sub.begin_; item_it != sub.end_; ++item_it)
+    {
+        if (item_it == sub.begin_ || std::prev(item_it)->first != item_it->first)
+        {
+            next_seq = UINT64_MAX;
+        }
+        uint64_t seq = item_it->second.seq_;
+        uint64_t hidden_seq = std::min(next_seq, CoveringSequence(range_tombstones, item_it->first, seq));
+        next_seq = seq;
+        if (!IsLive(seq, hidden_seq))
+        {
+            ++sub.records_dropped_;
+            continue;
+        }
+        // at the bottom a deletion only matters to snapshots that can still read older versions
+        if (item_it->second.type_ == TYPE_DELETION && bottommost && !HasSnapshot(0, seq))
+        {
+            ++sub.tombstones_dropped_;
+            continue;
+        }
+        kept.push_back(item_it);
+    }
+
+    // the inputs in the order the merge first needs them
+    std::vector<FileRead> reads;
+    std::map<file_index_t, size_t> read_index;
+    for (typename std::vector<tape_iterator>::const_iterator kept_it = kept.begin(); kept_it != kept.end(); ++kept_it)
+    {
+        if ((*kept_it)->second.type_ != TYPE_DELETION && read_index.count((*kept_it)->second.file_) == 0)
+        {
+            read_index.emplace((*kept_it)->second.file_, read_index.size());
+        }
+    }
+    reads.resize(read_index.size());
+    for (typename std::map<file_index_t, size_t>::const_iterator index_it = read_index.begin();
+         index_it != read_index.end();
+         ++index_it)
+    {
+        reads[index_it->second].file_ = index_it->first;
+    }
+    size_t next_submit = 0;
+
+    std::string output_path = output_path_ + "level" + std::to_string(output_level) + "/";
+    std::map<file_index_t, std::vector<VALUE>> file_to_value;
+    std::vector<typename SSTable<KEY, VALUE>::entry_t> data;
+    std::vector<typename SSTable<KEY, VALUE>::entry_t> writing;         // the entries of the output being written
+    std::thread writer;
+    bool write_failed = false;              // set by the writer, read once it is joined
+    std::vector<range_tombstone_t> output_range_tombstones;
+    KEY output_min_key = sub.min_key_;      // each output file takes the tombstones from here up to its last key
+    std::unique_ptr<BlobFileWriter> blob_writer;
+    int curr_size = 0;
+    auto write_out = [&] ()
+    {
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+        writing.swap(data);
+        data.clear();
+        std::shared_ptr<SSTable<KEY, VALUE>> sstable(
+                new SSTable<KEY, VALUE>(writing, output_range_tombstones, BLOOM_FILTER_SIZE_));
+        sub.outputs_.emplace_back(*sstable);
+        writer = std::thread([this, sstable, &output_path, &write_failed] ()
+        {
+            Throttle(sstable->FileSize(), RateLimiter::IO_LOW);
+            write_failed = !sstable->SSTableOut(output_path, TEMP_SUFFIX_, options_.use_direct_writes) || write_failed;
+        });
+    };
+    for (typename std::vector<tape_iterator>::const_iterator kept_it = kept.begin(); kept_it != kept.end(); ++kept_it)
+    {
+        tape_iterator item_it = *kept_it;
+        // the versions of a key never span two files
+        if (curr_size >= options_.target_file_size - BLOOM_FILTER_SIZE_ && !data.empty() &&
+            std::get<0>(data.back()) != item_it->first)
+        {
+            KEY last_key = std::get<0>(data.back());
+            ClipRangeTombstones(output_candidates, output_min_key, last_key, output_range_tombstones);
+            write_out();
+            output_min_key = KeyTraits<KEY>::After(last_key);
+            curr_size = 0;
+        }
+        if (item_it->second.type_ == TYPE_DELETION)
+        {
+            curr_size += SSTable<KEY, VALUE>::IndexEntrySize(item_it->first) +
+                         (ValueTraits<VALUE>::FIXED_WIDTH? ValueTraits<VALUE>::Size(VALUE()) : 0);
+            data.emplace_back(item_it->first, VALUE(), TYPE_DELETION, item_it->second.seq_);
+        }
+        else
+        {
+            typename std::map<file_index_t, std::vector<VALUE>>::iterator file_it = file_to_value.find(item_it->second.file_);
+            if (file_it == file_to_value.end())
+            {
+                size_t index = read_index[item_it->second.file_];
+                while (next_submit < reads.size() && next_submit <= index + options_.io_queue_depth)
+                {
+                    if (SubmitRead(reads[next_submit]))
+                    {
+                        Throttle(reads[next_submit].data_.size(), RateLimiter::IO_LOW);
+                    }
+                    ++next_submit;
+                }
+                file_it = file_to_value.emplace(item_it->second.file_, std::vector<VALUE>()).first;
+                if (!FinishRead(reads[index], file_it->second))
+                {
+                    sub.failed_ = true;
+                }
+            }
+            // an input that could not be read abandons the compaction, nothing more is written
+            if (sub.failed_ || item_it->second.pos_ >= file_it->second.size())
+            {
+                sub.failed_ = true;
+                break;
+            }
+            // every item of an input file is visited once, so its value can be moved out
+            VALUE value = std::move(file_it->second[item_it->second.pos_]);
+            // a value still in a value log file being collected moves to the file of this subcompaction
+            BlobIndex index;
+            PinnableValue blob;
+            if (item_it->second.type_ == TYPE_BLOB_INDEX && index.Decode(ValueTraits<VALUE>::Bytes(value)) &&
+                    blob_victims.count(index.file_number_) != 0 && ReadBlob(ValueTraits<VALUE>::Bytes(value), &blob))
+            {
+                if (blob_writer == nullptr)
+                {
+                    blob_writer = NewBlobFile();
+                }
+                if (blob_writer != nullptr)
+                {
+                    value = ValueTraits<VALUE>::FromBytes(
+                        blob_writer->Add(KeyTraits<KEY>::Bytes(item_it->first), blob.view()).Encode());
+                    sub.blob_bytes_relocated_ += blob.size();
+                }
+            }
+            curr_size += SSTable<KEY, VALUE>::IndexEntrySize(item_it->first) + ValueTraits<VALUE>::Size(value);
+            data.emplace_back(item_it->first, std::move(value), item_it->second.type_, item_it->second.seq_);
+        }
+    }
+
+    ClipRangeTombstones(output_candidates, output_min_key, sub.max_key_, output_range_tombstones);
+    if (!sub.failed_ && (!data.empty() || !output_range_tombstones.empty()))
+    {
+        write_out();
+    }
+    if (writer.joinable())
+    {
+        writer.join();
+    }
+    sub.failed_ = sub.failed_ || write_failed;
+    if (blob_writer != nullptr)
+    {
+        sub.failed_ = !FinishBlobFile(*blob_writer, RateLimiter::IO_LOW) || sub.failed_;
+        sub.blob_file_ = blob_writer->file_number();
+        sub.blob_bytes_written_ = blob_writer->file_size();
+    }
+    // reads ahead of an input no surviving version needed any more
+    for (typename std::vector<FileRead>::iterator read_it = reads.begin(); read_it != reads.begin() + next_submit; ++read_it)
+    {
+        std::vector<VALUE> values;
+        FinishRead(*read_it, values);
+    }
+    sub.end_micros_ = event_logger_->NowMicros();
+}
+
+// the inputs stay in the buffer and on disk until the outputs replacing them are durable and logged,
+// a compaction that fails on the way leaves them as they were and removes what it wrote
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::Compaction(std::vector<SmallSSTable*> &files_to_compaction, int level, int output_level,
+                                    bool bottommost)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    StageTimer timer(&statistics_, COMPACTION_NANOS, PerfNanos(&PerfContext::compaction_nanos));
+    uint64_t job = ++next_job_id_;
+    uint64_t start_micros = event_logger_->NowMicros();
+    KEY min_ele_key = files_to_compaction.front()->header_.min_ele_key_;
+    KEY max_ele_key = files_to_compaction.front()->header_.max_ele_key_;
     uint64_t merge_length = 0;
-    for (typename std::vector<std::vector<std::pair<KEY, item_index_t>>>::const_iterator table_package = tables_package.begin();
-         table_package != tables_package.end();
-         ++table_package)
+    std::set<uint64_t> blob_victims = CollectibleBlobFiles();     // before the inputs leave the buffer
+
+    for (typename std::vector<SmallSSTable*>::iterator file_it = files_to_compaction.begin();
+         file_it != files_to_compaction.end();
+         ++file_it)
     {
-        merge_length += table_package->size();
+        const KEY &tmp_max_ele_key = (*file_it)->header_.max_ele_key_;
+        const KEY &tmp_min_ele_key = (*file_it)->header_.min_ele_key_;
+        max_ele_key = (tmp_max_ele_key > max_ele_key)? tmp_max_ele_key : max_ele_key;
+        min_ele_key = (tmp_min_ele_key < min_ele_key)? tmp_min_ele_key : min_ele_key;
+        merge_length += (*file_it)->header_.length_;
     }
 
-    std::vector<std::pair<KEY, item_index_t>> merge_tapes[2];
+    // a compaction inside a level only merges the files it was given
+    std::vector<SmallSSTable*> next_level_files_to_compaction;
+    if (output_level != level)
+    {
+        merge_length += GetCompactionFilesRange(output_level, min_ele_key, max_ele_key, next_level_files_to_compaction);
+    }
+    // the outputs cover the keys of every input, a file of the output level may stick out of those above
+    KEY output_min_key = min_ele_key;
+    KEY output_max_key = max_ele_key;
+    for (typename std::vector<SmallSSTable*>::const_iterator file_it = next_level_files_to_compaction.begin();
+         file_it != next_level_files_to_compaction.end();
+         ++file_it)
+    {
+        output_max_key = ((*file_it)->header_.max_ele_key_ > output_max_key)? (*file_it)->header_.max_ele_key_ : output_max_key;
+        output_min_key = ((*file_it)->header_.min_ele_key_ < output_min_key)? (*file_it)->header_.min_ele_key_ : output_min_key;
+    }
+
+    // outputs get a timestamp of their own, so they never take the name of an input
+    ++SSTable<KEY, VALUE>::timestamp_;
+    LevelStats &stats = Stats(output_level);
+    uint64_t input_bytes_before = stats.bytes_read_ + stats.bytes_read_next_;
+    ++(stats.compactions_);
+    for (typename std::vector<SmallSSTable*>::const_iterator file_it = files_to_compaction.begin();
+         file_it != files_to_compaction.end();
+         ++file_it)
+    {
+        ((level == output_level)? stats.bytes_read_next_ : stats.bytes_read_) += (*file_it)->file_size_;
+    }
+    for (typename std::vector<SmallSSTable*>::const_iterator file_it = next_level_files_to_compaction.begin();
+         file_it != next_level_files_to_compaction.end();
+         ++file_it)
+    {
+        stats.bytes_read_next_ += (*file_it)->file_size_;
+    }
+
+    // files of a level other than 0 do not overlap, appending them in key order gives a sorted tape
+    auto cmp_min_key = [] (const SmallSSTable* file1, const SmallSSTable* file2)
+    {
+        return file1->header_.min_ele_key_ < file2->header_.min_ele_key_;
+    };
+    if (level != 0)
+    {
+        std::sort(files_to_compaction.begin(), files_to_compaction.end(), cmp_min_key);
+    }
+    std::sort(next_level_files_to_compaction.begin(), next_level_files_to_compaction.end(), cmp_min_key);
+    std::vector<file_index_t> input_files;
+    std::vector<std::pair<int, SmallSSTable*>> input_tables;
+
+    // an input lying entirely under a range tombstone of a newer input is dropped without being read
+    std::vector<range_index_t> range_tombstones;
+    CollectRangeTombstones(files_to_compaction, level, range_tombstones);
+    CollectRangeTombstones(next_level_files_to_compaction, output_level, range_tombstones);
+    std::set<const SmallSSTable*> covered_files;
+    MarkCoveredFiles(files_to_compaction, level, range_tombstones, covered_files);
+    MarkCoveredFiles(next_level_files_to_compaction, output_level, range_tombstones, covered_files);
+    if (!covered_files.empty())
+    {
+        range_tombstones.clear();
+        CollectRangeTombstones(files_to_compaction, level, range_tombstones, &covered_files);
+        CollectRangeTombstones(next_level_files_to_compaction, output_level, range_tombstones, &covered_files);
+    }
+
+    std::vector<std::pair<KEY, item_index_t>> merge_tapes[3];
     merge_tapes[0].reserve(merge_length);
     merge_tapes[1].reserve(merge_length);
+    merge_tapes[2].reserve(merge_length);
 
     int circle_index = 0;
 
-    for (typename std::vector<std::vector<std::pair<KEY, item_index_t>>>::const_iterator table_package = tables_package.begin();
-         table_package != tables_package.end();
-         ++table_package)
+    if (level == 0)
     {
-        MergeSort(table_package->begin(), table_package->end(),
-                  merge_tapes[circle_index % 2].begin(), merge_tapes[circle_index % 2].end(),
-                merge_tapes[(circle_index + 1) % 2]);
-        merge_tapes[circle_index % 2].clear();
-        circle_index = (circle_index + 1) % 2;
+        for (typename std::vector<SmallSSTable*>::iterator file_it = files_to_compaction.begin();
+             file_it != files_to_compaction.end();
+             ++file_it)
+        {
+            input_files.push_back(GetFileIndex(level, *file_it));
+            input_tables.push_back({level, *file_it});
+            if (covered_files.count(*file_it) != 0)
+            {
+                continue;
+            }
+            PackSmallSSTable(*file_it, level, merge_tapes[circle_index]);
+            MergeSort(merge_tapes[(circle_index) % 3].begin(), merge_tapes[(circle_index) % 3].end(),
+                    merge_tapes[(circle_index + 1) % 3].begin(), merge_tapes[(circle_index + 1) % 3].end(),
+                    merge_tapes[(circle_index + 2) % 3]);
+            merge_tapes[circle_index].clear();
+            circle_index = (circle_index + 1) % 3;
+        }
+    }
+    else
+    {
+        for (typename std::vector<SmallSSTable*>::iterator file_it = files_to_compaction.begin();
+             file_it != files_to_compaction.end();
+             ++file_it)
+        {
+            input_files.push_back(GetFileIndex(level, *file_it));
+            input_tables.push_back({level, *file_it});
+            if (covered_files.count(*file_it) != 0)
+            {
+                continue;
+            }
+            PackSmallSSTable(*file_it, level, merge_tapes[circle_index]);
+            merge_tapes[(circle_index + 2) % 3].insert(merge_tapes[(circle_index + 2) % 3].end(),
+                    merge_tapes[circle_index].begin(),
+                    merge_tapes[circle_index].end());
+        }
+        merge_tapes[circle_index].clear();
+        circle_index = (circle_index + 1) % 3;
     }
 
-    merge_result.reserve(merge_tapes[circle_index].size());
+    for (typename std::vector<SmallSSTable*>::iterator file_it = next_level_files_to_compaction.begin();
+         file_it != next_level_files_to_compaction.end();
+         ++file_it)
+    {
+        input_files.push_back(GetFileIndex(output_level, *file_it));
+        input_tables.push_back({output_level, *file_it});
+        if (covered_files.count(*file_it) != 0)
+        {
+            continue;
+        }
+        PackSmallSSTable(*file_it, output_level, merge_tapes[circle_index]);
+        merge_tapes[(circle_index + 2) % 3].insert(merge_tapes[(circle_index + 2) % 3].end(),
+                merge_tapes[circle_index].begin(),
+                merge_tapes[circle_index].end());
+    }
+    merge_tapes[circle_index].clear();
+    circle_index = (circle_index + 1) % 3;
 
-    for (typename std::vector<std::pair<KEY, item_index_t>>::const_iterator result = merge_tapes[circle_index].begin();
-         result != merge_tapes[circle_index].end();
-         ++result)
+    MergeSort(merge_tapes[(circle_index) % 3].begin(), merge_tapes[(circle_index) % 3].end(),
+            merge_tapes[(circle_index + 1) % 3].begin(), merge_tapes[(circle_index + 1) % 3].end(),
+            merge_tapes[(circle_index + 2) % 3]);
+    merge_tapes[circle_index].clear();
+
+    circle_index = (circle_index + 2) % 3;                              // final tape index
+
+    // at the bottom a range tombstone is only kept for the snapshots older than it
+    std::vector<range_index_t> output_candidates;
+    for (typename std::vector<range_index_t>::const_iterator range_it = range_tombstones.begin();
+         range_it != range_tombstones.end();
+         ++range_it)
+    {
+        if (!bottommost || HasSnapshot(0, range_it->second.seq_))
+        {
+            output_candidates.push_back(*range_it);
+        }
+    }
+
+    // split the tape at key boundaries so that each subcompaction gets about a file's worth or more
+    const std::vector<std::pair<KEY, item_index_t>> &tape = merge_tapes[circle_index];
+    uint64_t input_bytes = stats.bytes_read_ + stats.bytes_read_next_ - input_bytes_before;
+    statistics_.Record(COMPACTION_COUNT);
+    statistics_.Record(COMPACTION_BYTES_READ, input_bytes);
+    uint64_t sub_num = input_bytes / options_.target_file_size;
+    sub_num = (sub_num > (uint64_t)options_.max_subcompactions)? options_.max_subcompactions : sub_num;
+    sub_num = (sub_num > tape.size())? tape.size() : sub_num;
+    sub_num = (sub_num == 0)? 1 : sub_num;
+    std::vector<Subcompaction> subcompactions;
+    typename std::vector<std::pair<KEY, item_index_t>>::const_iterator sub_begin = tape.begin();
+    for (uint64_t i = 1; i <= sub_num && sub_begin != tape.end(); ++i)
+    {
+        typename std::vector<std::pair<KEY, item_index_t>>::const_iterator sub_end = tape.begin() + tape.size() * i / sub_num;
+        while (sub_end != tape.begin() && sub_end != tape.end() && std::prev(sub_end)->first == sub_end->first)
+        {
+            ++sub_end;
+        }
+        if (sub_end == sub_begin)
+        {
+            continue;
+        }
+        Subcompaction sub;
+        sub.begin_ = sub_begin;
+        sub.end_ = sub_end;
+        sub.min_key_ = subcompactions.empty()? output_min_key : sub_begin->first;
+        sub.max_key_ = (sub_end == tape.end())? output_max_key : KeyTraits<KEY>::Before(sub_end->first);
+        subcompactions.push_back(sub);
+        sub_begin = sub_end;
+    }
+    if (subcompactions.empty())
+    {
+        Subcompaction sub;
+        sub.begin_ = tape.begin();
+        sub.end_ = tape.end();
+        sub.min_key_ = output_min_key;
+        sub.max_key_ = output_max_key;
+        subcompactions.push_back(sub);
+    }
+
+    // the first range runs here, outputs are installed once every range is written
+    std::vector<file_index_t> output_files;
+    uint64_t output_bytes = 0;
+    uint64_t output_records = 0;
+    MakeLevelDir(output_level);
+    std::vector<std::thread> threads;
+    for (typename std::vector<Subcompaction>::iterator sub_it = subcompactions.begin() + 1;
+         sub_it != subcompactions.end();
+         ++sub_it)
+    {
+        threads.emplace_back(&Memory::RunSubcompaction, this, std::ref(*sub_it), std::cref(range_tombstones),
+                             std::cref(output_candidates), output_level, bottommost, std::cref(blob_victims));
+    }
+    RunSubcompaction(subcompactions.front(), range_tombstones, output_candidates, output_level, bottommost,
+                     blob_victims);
+    for (typename std::vector<std::thread>::iterator thread_it = threads.begin(); thread_it != threads.end(); ++thread_it)
+    {
+        thread_it->join();
+    }
+    bool failed = false;
+    for (typename std::vector<Subcompaction>::const_iterator sub_it = subcompactions.begin();
+         sub_it != subcompactions.end();
+         ++sub_it)
+    {
+        failed = failed || sub_it->failed_;
+        for (typename std::vector<SmallSSTable>::const_iterator output_it = sub_it->outputs_.begin();
+             output_it != sub_it->outputs_.end();
+             ++output_it)
+        {
+            output_files.push_back(GetFileIndex(output_level, &(*output_it)));
+        }
+    }
+
+    // inputs are only removed once the outputs that replace them are durable and logged
+    bool logged = false;
+    if (!failed && InstallFiles(output_files))
+    {
+        logged = LogEdit(output_files, input_files);
+        if (!logged)
+        {
+            AbandonEdit(output_files);
+        }
+    }
+    else
+    {
+        RemoveOutputs(output_files);
+    }
+    if (!logged)
+    {
+        for (typename std::vector<Subcompaction>::const_iterator sub_it = subcompactions.begin();
+             sub_it != subcompactions.end();
+             ++sub_it)
+        {
+            if (sub_it->blob_file_ != 0)
+            {
+                utils::rmfile(BlobFilePath(sub_it->blob_file_).c_str());
+            }
+        }
+        std::cerr << "Failed to compact level " << level << " into level " << output_level << ", its inputs are kept\n";
+        statistics_.Record(BACKGROUND_ERRORS);
+        stats.micros_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        JSONWriter event;
+        event.Add("job", job).Add("event", "compaction_failed").Add("input_level", level).Add("output_level", output_level)
+             .Add("duration_micros", event_logger_->NowMicros() - start_micros);
+        event_logger_->LogEvent(event);
+        return false;
+    }
+
+    for (typename std::vector<std::pair<int, SmallSSTable*>>::const_iterator table_it = input_tables.begin();
+         table_it != input_tables.end();
+         ++table_it)
+    {
+        DeleteSmallSSTable(table_it->first, table_it->second);
+    }
+    for (typename std::vector<Subcompaction>::iterator sub_it = subcompactions.begin();
+         sub_it != subcompactions.end();
+         ++sub_it)
+    {
+        if (sub_it->blob_file_ != 0)
+        {
+            AddBlobFile(sub_it->blob_file_);
+            stats.bytes_written_ += sub_it->blob_bytes_written_;
+            statistics_.Record(BLOB_GC_BYTES_RELOCATED, sub_it->blob_bytes_relocated_);
+        }
+        for (typename std::vector<SmallSSTable>::iterator output_it = sub_it->outputs_.begin();
+             output_it != sub_it->outputs_.end();
+             ++output_it)
+        {
+            stats.bytes_written_ += output_it->file_size_;
+            ++(stats.files_written_);
+            output_bytes += output_it->file_size_;
+            output_records += output_it->header_.length_;
+            statistics_.Record(COMPACTION_BYTES_WRITTEN, output_it->file_size_);
+            buffer_.emplace_back(output_level, std::move(*output_it));
+        }
+    }
+    for (typename std::vector<file_index_t>::const_iterator file_it = input_files.begin();
+         file_it != input_files.end();
+         ++file_it)
+    {
+        RemoveFile(*file_it);
+    }
+    // the outputs are the tables at the end of the buffer
+    for (typename std::list<std::pair<int, SmallSSTable>>::iterator buffer_it = std::prev(buffer_.end(), output_files.size());
+         buffer_it != buffer_.end();
+         ++buffer_it)
+    {
+        LoadBlobBytes(buffer_it->first, &(buffer_it->second));
+    }
+    DeleteObsoleteBlobFiles();
+    stats.micros_ += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<std::string> input_names;
+    std::vector<std::string> output_names;
+    for (typename std::vector<file_index_t>::const_iterator file_it = input_files.begin();
+         file_it != input_files.end();
+         ++file_it)
+    {
+        input_names.push_back(GetManifestName(*file_it));
+    }
+    for (typename std::vector<file_index_t>::const_iterator file_it = output_files.begin();
+         file_it != output_files.end();
+         ++file_it)
+    {
+        output_names.push_back(GetManifestName(*file_it));
+    }
+    uint64_t records_dropped = 0;
+    uint64_t tombstones_dropped = 0;
+    uint64_t blob_bytes_relocated = 0;
+    for (typename std::vector<Subcompaction>::const_iterator sub_it = subcompactions.begin();
+         sub_it != subcompactions.end();
+         ++sub_it)
+    {
+        records_dropped += sub_it->records_dropped_;
+        tombstones_dropped += sub_it->tombstones_dropped_;
+        blob_bytes_relocated += sub_it->blob_bytes_relocated_;
+        event_logger_->TraceComplete("subcompaction", sub_it->tid_, sub_it->start_micros_, sub_it->end_micros_,
+                                     JSONWriter().Add("job", job).Add("min_key", KeyTraits<KEY>::Display(sub_it->min_key_))
+                                                 .Add("max_key", KeyTraits<KEY>::Display(sub_it->max_key_)));
+    }
+    uint64_t end_micros = event_logger_->NowMicros();
+    JSONWriter event;
+    event.Add("job", job).Add("event", "compaction").Add("input_level", level).Add("output_level", output_level)
+         .Add("bottommost", bottommost).Add("input_files", input_names).Add("output_files", output_names)
+         .Add("input_files_dropped", (uint64_t)covered_files.size()).Add("bytes_read", input_bytes)
+         .Add("bytes_written", output_bytes).Add("num_input_records", (uint64_t)tape.size())
+         .Add("num_output_records", output_records).Add("records_dropped", records_dropped)
+         .Add("tombstones_dropped", tombstones_dropped)
+         .Add("range_tombstones_dropped", (uint64_t)(range_tombstones.size() - output_candidates.size()))
+         .Add("blob_bytes_relocated", blob_bytes_relocated)
+         .Add("subcompactions", (uint64_t)subcompactions.size()).Add("duration_micros", end_micros - start_micros);
+    event_logger_->LogEvent(event);
+    event_logger_->TraceComplete("compaction", EventLogger::ThreadId(), start_micros, end_micros, event);
+    return true;
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::Put(KEY key, const VALUE &value)
+{
+    Put(key, VALUE(value));
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::Put(KEY key, VALUE &&value)
+{
+    Write(key, std::move(value), TYPE_VALUE);
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::Write(KEY key, VALUE &&value, ValueType type)
+{
+    StageTimer timer(&statistics_, DB_WRITE_NANOS, nullptr);
+    int value_size = ValueTraits<VALUE>::Size(value);       // value is moved into the memtable below
+    statistics_.Record((type == TYPE_DELETION)? DELETE_COUNT : PUT_COUNT);
+    statistics_.Record(BYTES_WRITTEN, KeyTraits<KEY>::Size(key) + value_size);
+    uint64_t newest_snapshot = snapshots_.empty()? 0 : *snapshots_.rbegin();
+    StageTimer memtable_timer(StageStatistics(), WRITE_MEMTABLE_NANOS, PerfNanos(&PerfContext::write_memtable_nanos));
+    int prev_size = list_->Insert(key, std::move(value), type, ++last_sequence_, newest_snapshot);
+    memtable_timer.Stop();
+    if (prev_size < 0)
+    {
+        current_size_ += SSTable<KEY, VALUE>::IndexEntrySize(key) + value_size;
+        element_num_ += 1;
+    }
+    else
+    {
+        current_size_ += value_size - prev_size;
+    }
+    if (current_size_ >= MAX_SIZE_ - BLOOM_FILTER_SIZE_)
     {
-        merge_result.push_back(*result);
+        Flush();
     }
 }
 
+// a memtable whose table could not be written is kept, the next write finding it full flushes it again
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::ReorganizeScanResult(std::vector<std::pair<KEY, item_index_t>> &files_data,
-                          std::list<std::pair<KEY, VALUE>> &list) const
+bool Memory<KEY, VALUE>::Flush()
 {
-    typename std::vector<std::pair<KEY, item_index_t>>::const_iterator data_it = files_data.begin();
-    typename std::list<std::pair<KEY, VALUE>>::const_iterator list_it = list.begin();
-    std::map<file_index_t, std::vector<VALUE>> file_to_value;
-    while (data_it != files_data.end() && list_it != list.end())
+    uint64_t job = ++next_job_id_;
+    uint64_t start_micros = event_logger_->NowMicros();
+    uint64_t blob_bytes = 0;
+    bool success = false;
+    ++SSTable<KEY, VALUE>::timestamp_;
     {
-        if (data_it->first < list_it->first)
+        StageTimer timer(&statistics_, FLUSH_NANOS, PerfNanos(&PerfContext::flush_nanos));
+        if (options_.min_blob_size == 0)
         {
-            VALUE value;
-            if (file_to_value.count(data_it->second.first) == 0)
-            {
-                std::vector<VALUE> values;
-                ReadFile(data_it->second.first, values, false);
-                file_to_value.insert({data_it->second.first, values});
-                value = values.at(data_it->second.second);
-            }
-            else
-            {
-                std::vector<VALUE> &values = file_to_value.at(data_it->second.first);
-                value = values.at(data_it->second.second);
-            }
-            if (value != "~DELETED~")
-            {
-                list.insert(list_it, {data_it->first, value});
-            }
-            ++data_it;
+            SSTable<KEY, VALUE> sstable(*list_, range_list_, BLOOM_FILTER_SIZE_);
+            success = WriteToDisk(0, sstable);
         }
-        else if (data_it->first == list_it->first)
+        else
         {
-            ++data_it;
+            // the table borrows the values from entries, which copies the small ones out of the memtable
+            std::vector<typename SSTable<KEY, VALUE>::entry_t> entries;
+            success = SeparateValues(entries, blob_bytes);
+            if (success)
+            {
+                SSTable<KEY, VALUE> sstable(entries, range_list_, BLOOM_FILTER_SIZE_);
+                success = WriteToDisk(0, sstable);
+            }
         }
-        else
+        if (success)
         {
-            ++list_it;
+            Stats(0).bytes_read_ += buffer_.back().second.file_size_ + blob_bytes;     // the memtable is the level above level 0
+            Stats(0).bytes_written_ += blob_bytes;
         }
     }
-    while (data_it != files_data.end())
+    if (!success)
     {
-        VALUE value;
-        if (file_to_value.count(data_it->second.first) == 0)
-        {
-            std::vector<VALUE> values;
-            ReadFile(data_it->second.first, values, false);
-            file_to_value.insert({data_it->second.first, values});
-            value = values.at(data_it->second.second);
-        }
-        else
-        {
-            std::vector<VALUE> &values = file_to_value.at(data_it->second.first);
-            value = values.at(data_it->second.second);
-        }
-        if (value != "~DELETED~")
-        {
-            list.insert(list_it, {data_it->first, value});
-        }
-        ++data_it;
+        DeleteObsoleteBlobFiles();          // the value log file of the table, if it got that far
+        statistics_.Record(BACKGROUND_ERRORS);
+        JSONWriter event;
+        event.Add("job", job).Add("event", "flush_failed").Add("num_entries", (uint64_t)element_num_)
+             .Add("duration_micros", event_logger_->NowMicros() - start_micros);
+        event_logger_->LogEvent(event);
+        return false;
     }
+    // the table is looked at before compactions add tables of their own
+    const SmallSSTable &table = buffer_.back().second;
+    JSONWriter event;
+    event.Add("job", job).Add("event", "flush").Add("output_level", 0)
+         .Add("output_file", GetManifestName(GetFileIndex(0, &table))).Add("num_entries", table.header_.length_)
+         .Add("num_range_deletions", (uint64_t)table.range_tombstones_.size()).Add("bytes_written", table.file_size_)
+         .Add("blob_bytes_written", blob_bytes);
+    uint64_t flush_end_micros = event_logger_->NowMicros();
+    MaybeCompact();
+    current_size_ = 0;
+    element_num_ = 0;
+    list_->Reset();
+    range_list_.clear();
+    // compactions run in the write that fills the memtable, which waits for the flush and all of them
+    uint64_t end_micros = event_logger_->NowMicros();
+    event.Add("duration_micros", flush_end_micros - start_micros).Add("stall_micros", end_micros - start_micros);
+    event_logger_->LogEvent(event);
+    event_logger_->TraceComplete("flush", EventLogger::ThreadId(), start_micros, flush_end_micros, event);
+    event_logger_->TraceComplete("write_stall", EventLogger::ThreadId(), start_micros, end_micros, JSONWriter().Add("job", job));
+    return true;
 }
 
 template <class KEY, class VALUE>
-bool Memory<KEY, VALUE>::Exist(const KEY &key) const
+const Snapshot* Memory<KEY, VALUE>::GetSnapshot()
+{
+    snapshots_.insert(last_sequence_);
+    return new Snapshot(last_sequence_);
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::ReleaseSnapshot(const Snapshot* snapshot)
 {
-    if (list_->Exist(key))
+    typename std::multiset<uint64_t>::iterator snapshot_it = snapshots_.find(snapshot->sequence());
+    if (snapshot_it != snapshots_.end())
     {
-        if (list_->Search(key) == "~DELETED~")
-        {
-            return false;
-        }
-        return true;
+        snapshots_.erase(snapshot_it);
     }
+    delete snapshot;
+}
 
-    uint64_t timestamp = 0;
-    const SmallSSTable* tmp = nullptr;
-    uint32_t offset = 0;
-    int level = 0;
-    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
-         buffer_it != buffer_.end();
-         ++buffer_it)
+template <class KEY, class VALUE>
+VALUE Memory<KEY, VALUE>::Get(const KEY &key, const Snapshot* snapshot) const
+{
+    VALUE value;
+    if (!Get(key, &value, snapshot))
     {
-        if (buffer_it->second.header_.timestamp_ > timestamp && buffer_it->second.filter_.Exist(key))
-        {
-            if (FindKey(key, &(buffer_it->second), offset))
-            {
-                timestamp = buffer_it->second.header_.timestamp_;
-                tmp = &(buffer_it->second);
-                level = buffer_it->first;
-            }
-        }
+        return VALUE();
+    }
+    return value;
+}
+
+// found or not, for a value type whose empty value is also a value a key can hold; a memtable hit
+// is copied once, straight from the node
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::Get(const KEY &key, VALUE *value, const Snapshot* snapshot) const
+{
+    PinnableValue pinned;
+    const VALUE* mem_value = nullptr;
+    if (!TimedLookup(key, &pinned, mem_value, snapshot))
+    {
+        return false;
     }
-    if (tmp != nullptr)
+    if (mem_value != nullptr)
     {
-        VALUE value = FindValue(level, tmp, offset);
-        if (value != "~DELETED~")
-        {
-            return true;
-        }
+        *value = *mem_value;
     }
-    return false;
+    else
+    {
+        *value = ValueTraits<VALUE>::FromBytes(pinned.view());
+    }
+    return true;
 }
 
+// memtable hits are copied into the handle, sstable hits point into the mapped file
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::Compaction(std::vector<SmallSSTable*> &files_to_compaction, int next_level)
+bool Memory<KEY, VALUE>::Get(const KEY &key, PinnableValue *value, const Snapshot* snapshot) const
 {
-    uint64_t min_ele_key = UINT64_MAX;
-    uint64_t max_ele_key = 0;
-    uint64_t merge_length = 0;
-
-    for (typename std::vector<SmallSSTable*>::iterator file_it = files_to_compaction.begin();
-         file_it != files_to_compaction.end();
-         ++file_it)
+    const VALUE* mem_value = nullptr;
+    if (!TimedLookup(key, value, mem_value, snapshot))
     {
-        uint64_t tmp_max_ele_key = (*file_it)->header_.max_ele_key_;
-        uint64_t tmp_min_ele_key = (*file_it)->header_.min_ele_key_;
-        max_ele_key = (tmp_max_ele_key > max_ele_key)? tmp_max_ele_key : max_ele_key;
-        min_ele_key = (tmp_min_ele_key < min_ele_key)? tmp_min_ele_key : min_ele_key;
-        merge_length += (*file_it)->header_.length_;
+        return false;
     }
+    if (mem_value != nullptr)
+    {
+        value->PinSelf(std::string(ValueTraits<VALUE>::Bytes(*mem_value)));
+    }
+    return true;
+}
 
-    std::vector<SmallSSTable*> next_level_files_to_compaction;
-    merge_length += GetCompactionFilesRange(next_level, min_ele_key, max_ele_key, next_level_files_to_compaction);
-
-    std::vector<std::pair<KEY, item_index_t>> merge_tapes[3];
-    merge_tapes[0].reserve(merge_length);
-    merge_tapes[1].reserve(merge_length);
-    merge_tapes[2].reserve(merge_length);
-
-    int circle_index = 0;
+// an auto-tuned rate limiter is told how long gets take, reads themselves are never throttled
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::TimedLookup(const KEY &key, PinnableValue *value, const VALUE* &mem_value,
+                                     const Snapshot* snapshot) const
+{
+    StageTimer timer(&statistics_, DB_GET_NANOS, nullptr);
+    if (limiter_ == nullptr || !options_.rate_limit_auto_tune)
+    {
+        return Lookup(key, value, mem_value, snapshot);
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool found = Lookup(key, value, mem_value, snapshot);
+    limiter_->RecordForegroundLatency(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    return found;
+}
 
-    if (next_level - 1 == 0)
+// a memtable hit is left in mem_value, pointing at the node until the next write; an sstable hit
+// points the handle into the mapped file
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::Lookup(const KEY &key, PinnableValue *value, const VALUE* &mem_value,
+                                const Snapshot* snapshot) const
+{
+    value->Reset();
+    mem_value = nullptr;
+    statistics_.Record(GET_COUNT);
+    uint64_t sequence = ReadSequence(snapshot);
+    StageTimer memtable_timer(StageStatistics(), GET_MEMTABLE_NANOS, PerfNanos(&PerfContext::get_memtable_nanos));
+    DelResult result = FindInMemTable(key, sequence, mem_value);
+    memtable_timer.Stop();
+    if (result != DEL_UNKNOWN)
     {
-        for (typename std::vector<SmallSSTable*>::iterator file_it = files_to_compaction.begin();
-             file_it != files_to_compaction.end();
-             ++file_it)
+        statistics_.Record(GET_MEMTABLE_HIT);
+        if (result == DEL_FOUND)
         {
-            PackSmallSSTable(*file_it, next_level - 1, merge_tapes[circle_index]);
-            MergeSort(merge_tapes[(circle_index) % 3].begin(), merge_tapes[(circle_index) % 3].end(),
-                    merge_tapes[(circle_index + 1) % 3].begin(), merge_tapes[(circle_index + 1) % 3].end(),
-                    merge_tapes[(circle_index + 2) % 3]);
-            merge_tapes[circle_index].clear();
-            circle_index = (circle_index + 1) % 3;
-            DeleteSmallSSTable(next_level - 1, *file_it);
+            statistics_.Record(GET_FOUND);
         }
+        return result == DEL_FOUND;
     }
-    else
+    uint32_t offset = 0;
+    int level = 0;
+    const SmallSSTable* tmp = FindNewestEntry(key, sequence, level, offset);
+    if (tmp == nullptr || tmp->index_[offset].type_ == TYPE_DELETION)
     {
-        for (typename std::vector<SmallSSTable*>::iterator file_it = files_to_compaction.begin();
-             file_it != files_to_compaction.end();
-             ++file_it)
-        {
-            PackSmallSSTable(*file_it, next_level - 1, merge_tapes[circle_index]);
-            merge_tapes[(circle_index + 2) % 3].insert(merge_tapes[(circle_index + 2) % 3].end(),
-                    merge_tapes[circle_index].begin(),
-                    merge_tapes[circle_index].end());
-            DeleteSmallSSTable(next_level - 1, *file_it);
-        }
-        merge_tapes[circle_index].clear();
-        circle_index = (circle_index + 1) % 3;
+        return false;
     }
-
-    for (typename std::vector<SmallSSTable*>::iterator file_it = next_level_files_to_compaction.begin();
-         file_it != next_level_files_to_compaction.end();
-         ++file_it)
+    StageTimer read_timer(StageStatistics(), GET_READ_NANOS, PerfNanos(&PerfContext::get_read_nanos));
+    if (!PinValue(level, tmp, offset, value) ||
+            (tmp->index_[offset].type_ == TYPE_BLOB_INDEX && !ReadBlob(value->view(), value)))
     {
-        PackSmallSSTable(*file_it, next_level, merge_tapes[circle_index]);
-        merge_tapes[(circle_index + 2) % 3].insert(merge_tapes[(circle_index + 2) % 3].end(),
-                merge_tapes[circle_index].begin(),
-                merge_tapes[circle_index].end());
-        DeleteSmallSSTable(next_level, *file_it);
+        return false;
     }
-    merge_tapes[circle_index].clear();
-    circle_index = (circle_index + 1) % 3;
-
-    MergeSort(merge_tapes[(circle_index) % 3].begin(), merge_tapes[(circle_index) % 3].end(),
-            merge_tapes[(circle_index + 1) % 3].begin(), merge_tapes[(circle_index + 1) % 3].end(),
-            merge_tapes[(circle_index + 2) % 3]);
-    merge_tapes[circle_index].clear();
+    read_timer.Stop();
+    statistics_.Record(GET_FOUND);
+    statistics_.Record(GET_BYTES_READ, value->size());
+    PerfCount(&PerfContext::get_read_bytes, value->size());
+    return true;
+}
 
-    circle_index = (circle_index + 2) % 3;                              // final tape index
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::Del(const KEY &key)
+{
+    return Del(key, DEL_EXACT) == DEL_FOUND;
+}
 
-    std::map<file_index_t, std::vector<VALUE>> file_to_value;
-    std::vector<std::pair<KEY, VALUE>> data;
-    int curr_size = 0;
-    for (typename std::vector<std::pair<KEY, item_index_t>>::iterator item_it = merge_tapes[circle_index].begin();
-         item_it != merge_tapes[circle_index].end();
-         ++item_it)
+// a blind delete still answers exactly when the memtable holds the key
+template <class KEY, class VALUE>
+DelResult Memory<KEY, VALUE>::Del(const KEY &key, DelMode mode)
+{
+    DelResult result;
+    if (mode == DEL_BLIND)
     {
-        VALUE value;
-        if (file_to_value.count(item_it->second.first) == 0)
-        {
-            std::vector<VALUE> values;
-            ReadFile(item_it->second.first, values, true);
-            file_to_value.insert({item_it->second.first, values});
-            value = values.at(item_it->second.second);
-        }
-        else
+        const VALUE* value = nullptr;
+        result = FindInMemTable(key, UINT64_MAX, value);
+        if (result == DEL_NOT_FOUND)
         {
-            std::vector<VALUE> &values = file_to_value.at(item_it->second.first);
-            value = values.at(item_it->second.second);
+            return result;
         }
-
-        if (value != "~DELETED~")
-        {
-            curr_size += sizeof(KEY) + sizeof(uint32_t) + sizeof(char) * value.length();
-            data.push_back({item_it->first, value});
-        }
-        if (curr_size >= MAX_SIZE_ - BLOOM_FILTER_SIZE_)
+    }
+    else
+    {
+        result = Exist(key)? DEL_FOUND : DEL_NOT_FOUND;
+        if (result == DEL_NOT_FOUND)
         {
-            WriteToDisk(next_level, data);
-            curr_size = 0;
-            data.clear();
+            return result;
         }
     }
+    Write(key, VALUE(), TYPE_DELETION);
+    return result;
+}
 
-    for (typename std::vector<std::pair<KEY, VALUE>>::iterator data_it = data.begin(); data_it != data.end();)
+// memtable entries in the range are older than the new tombstone, unless a snapshot may
+// still read them they are dropped here
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::DelRange(const KEY &key1, const KEY &key2)
+{
+    if (key1 > key2)
     {
-        if (data_it->second == "~DELETED~")
-        {
-            data_it = data.erase(data_it);
-        }
-        else
+        return;
+    }
+    StageTimer timer(&statistics_, DB_WRITE_NANOS, nullptr);
+    std::vector<std::pair<KEY, int>> covered;
+    for (typename SkipList<KEY, VALUE>::Iterator it = list_->Seek(key1);
+         snapshots_.empty() && it.Valid() && it.Key() <= key2;
+         it.Next())
+    {
+        int size = SSTable<KEY, VALUE>::IndexEntrySize(it.Key()) + ValueTraits<VALUE>::Size(it.Value());
+        const std::vector<typename SkipList<KEY, VALUE>::Version> &older = it.Older();
+        for (typename std::vector<typename SkipList<KEY, VALUE>::Version>::const_iterator version_it = older.begin();
+             version_it != older.end();
+             ++version_it)
         {
-            ++data_it;
+            size += SSTable<KEY, VALUE>::IndexEntrySize(it.Key()) + ValueTraits<VALUE>::Size(version_it->val);
         }
+        covered.push_back({it.Key(), size});
     }
-
-    if (!data.empty())
+    for (typename std::vector<std::pair<KEY, int>>::const_iterator covered_it = covered.begin();
+         covered_it != covered.end();
+         ++covered_it)
     {
-        WriteToDisk(next_level, data);
-        curr_size = 0;
-        data.clear();
+        list_->Delete(covered_it->first);
+        current_size_ -= covered_it->second;
+        element_num_ -= 1;
     }
-
-    if (NeedCompaction(next_level))
+    range_list_.push_back(range_tombstone_t{key1, key2, ++last_sequence_});
+    statistics_.Record(RANGE_DELETE_COUNT);
+    current_size_ += SSTable<KEY, VALUE>::RangeTombstoneSize(range_list_.back());
+    if (current_size_ >= MAX_SIZE_ - BLOOM_FILTER_SIZE_)
     {
-        std::vector<SmallSSTable*> compaction_files;
-        GetCompactionFiles(next_level, compaction_files);
-        Compaction(compaction_files, next_level + 1);
+        Flush();
     }
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::Put(KEY key, VALUE value)
+void Memory<KEY, VALUE>::Reset()
 {
-    int prev_size = list_->Insert(key, value);
-    if (prev_size == 0)
+    delete list_;
+    list_ = new SkipList<KEY, VALUE>();
+    range_list_.clear();
+    current_size_ = 0;
+    element_num_ = 0;
+    std::vector<file_index_t> files;
+    for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
+         buffer_it != buffer_.end();
+         ++buffer_it)
     {
-        current_size_ += sizeof(key) + sizeof(char) * value.length() + sizeof(uint32_t);
-        element_num_ += 1;
+        files.push_back(GetFileIndex(buffer_it->first, &(buffer_it->second)));
     }
-    else if (prev_size > 0)
+    buffer_.clear();
+    for (typename std::map<uint64_t, std::shared_ptr<const BlobFileReader>>::const_iterator blob_it = blob_files_.begin();
+         blob_it != blob_files_.end();
+         ++blob_it)
     {
-        current_size_ += sizeof(char) * value.length() - prev_size;
+        utils::rmfile(BlobFilePath(blob_it->first).c_str());
     }
-    if (current_size_ >= MAX_SIZE_ - BLOOM_FILTER_SIZE_)
+    blob_files_.clear();
+    readahead_.clear();
+    compact_pointer_.clear();
+    stats_.clear();
+    statistics_.Reset();
+    WriteManifest();
+    for (typename std::vector<file_index_t>::const_iterator file_it = files.begin(); file_it != files.end(); ++file_it)
     {
-        ++SSTable<KEY, VALUE>::timestamp_;
-        std::vector<std::pair<KEY, VALUE>> data = list_->ScanAll();
-        WriteToDisk(0, data);
-        if (NeedCompaction(0))
-        {
-            std::vector<SmallSSTable*> compaction_files;
-            GetCompactionFiles(0, compaction_files);
-            Compaction(compaction_files, 1);
-        }
-        current_size_ = 0;
-        list_->Reset();
+        RemoveFile(*file_it);
     }
 }
 
+// one row per level; W-Amp of a level is what compactions wrote into it over what they took
+// from the level above, the sum is everything written over what was flushed
 template <class KEY, class VALUE>
-VALUE Memory<KEY, VALUE>::Get(const KEY &key) const
+std::string Memory<KEY, VALUE>::GetCompactionStats() const
 {
-    VALUE value = list_->Search(key);
-    if (value != "")
+    const double MB = 1024.0 * 1024.0;
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    out << "Level  Files  Size(MB)   Score    Rn(MB)  Rnp1(MB) Write(MB)   W-Amp   Comp  Moves Comp(sec)\n";
+    uint64_t total_written = 0;
+    uint64_t total_files = 0;
+    uint64_t total_bytes = 0;
+    uint64_t total_micros = 0;
+    for (int level = 0; level < (int)stats_.size(); ++level)
+    {
+        const LevelStats &stats = stats_[level];
+        double w_amp = (stats.bytes_read_ == 0)? 0 : (double)stats.bytes_written_ / stats.bytes_read_;
+        int files = FileNum(level);
+        uint64_t bytes = LevelBytes(level);
+        out << "  L" << std::left << std::setw(3) << level << std::right
+            << std::setw(6) << files
+            << std::setw(10) << bytes / MB
+            << std::setw(8) << CompactionScore(level)
+            << std::setw(10) << stats.bytes_read_ / MB
+            << std::setw(10) << stats.bytes_read_next_ / MB
+            << std::setw(10) << stats.bytes_written_ / MB
+            << std::setw(8) << w_amp
+            << std::setw(7) << stats.compactions_
+            << std::setw(7) << stats.trivial_moves_
+            << std::setw(10) << stats.micros_ / 1e6 << "\n";
+        total_written += stats.bytes_written_;
+        total_micros += stats.micros_;
+        total_files += files;
+        total_bytes += bytes;
+    }
+    uint64_t flushed = stats_.empty()? 0 : stats_[0].bytes_read_;
+    out << "  Sum " << std::setw(6) << total_files
+        << std::setw(10) << total_bytes / MB
+        << std::setw(38) << total_written / MB
+        << std::setw(8) << ((flushed == 0)? 0 : (double)total_written / flushed)
+        << std::setw(24) << total_micros / 1e6 << "\n";
+    if (!blob_files_.empty())
     {
-        if (value == "~DELETED~")
+        uint64_t blob_bytes = 0;
+        uint64_t live_blob_bytes = 0;
+        for (typename std::map<uint64_t, std::shared_ptr<const BlobFileReader>>::const_iterator blob_it = blob_files_.begin();
+             blob_it != blob_files_.end();
+             ++blob_it)
         {
-            return "";
+            blob_bytes += blob_it->second->value_bytes();
         }
-        return value;
+        std::map<uint64_t, uint64_t> live_bytes = LiveBlobBytes();
+        for (std::map<uint64_t, uint64_t>::const_iterator live_it = live_bytes.begin(); live_it != live_bytes.end(); ++live_it)
+        {
+            live_blob_bytes += live_it->second;
+        }
+        out << "Blob files " << blob_files_.size() << ", values " << blob_bytes / MB << " MB, live "
+            << live_blob_bytes / MB << " MB\n";
     }
-    else
+    if (limiter_ != nullptr)
+    {
+        out << "Rate limit " << limiter_->GetBytesPerSecond() / MB << " MB/s, throttled flush "
+            << limiter_->GetThrottledMicros(RateLimiter::IO_HIGH) / 1e6 << " sec of "
+            << limiter_->GetTotalBytes(RateLimiter::IO_HIGH) / MB << " MB, compaction "
+            << limiter_->GetThrottledMicros(RateLimiter::IO_LOW) / 1e6 << " sec of "
+            << limiter_->GetTotalBytes(RateLimiter::IO_LOW) / MB << " MB\n";
+    }
+    return out.str();
+}
+
+// the statistics and then the compaction report
+template <class KEY, class VALUE>
+std::string Memory<KEY, VALUE>::GetStats() const
+{
+    return statistics_.ToString() + GetCompactionStats();
+}
+
+// the names follow RocksDB where there is a counterpart, every ticker and histogram is a property of its own
+template <class KEY, class VALUE>
+bool Memory<KEY, VALUE>::GetProperty(const std::string &name, std::string *value) const
+{
+    const std::string LEVEL_FILES = "lsmkv.num-files-at-level";
+    if (name == "lsmkv.stats")
+    {
+        *value = GetStats();
+    }
+    else if (name == "lsmkv.compaction-stats")
+    {
+        *value = GetCompactionStats();
+    }
+    else if (name == "lsmkv.statistics")
+    {
+        *value = statistics_.ToString();
+    }
+    else if (name.compare(0, LEVEL_FILES.size(), LEVEL_FILES) == 0 && name.size() > LEVEL_FILES.size() &&
+             name.find_first_not_of("0123456789", LEVEL_FILES.size()) == std::string::npos)
+    {
+        *value = std::to_string(FileNum(std::stoi(name.substr(LEVEL_FILES.size()))));
+    }
+    else if (name == "lsmkv.total-sst-files-size")
     {
-        uint64_t timestamp = 0;
-        const SmallSSTable* tmp = nullptr;
-        uint32_t offset = 0;
-        int level = 0;
+        uint64_t bytes = 0;
         for (typename std::list<std::pair<int, SmallSSTable>>::const_iterator buffer_it = buffer_.begin();
              buffer_it != buffer_.end();
              ++buffer_it)
         {
-            if (buffer_it->second.header_.timestamp_ > timestamp && buffer_it->second.filter_.Exist(key))
-            {
-                if (FindKey(key, &(buffer_it->second), offset))
-                {
-                    timestamp = buffer_it->second.header_.timestamp_;
-                    tmp = &(buffer_it->second);
-                    level = buffer_it->first;
-                }
-            }
+            bytes += buffer_it->second.file_size_;
         }
-        if (tmp == nullptr)
+        *value = std::to_string(bytes);
+    }
+    else if (name == "lsmkv.num-blob-files")
+    {
+        *value = std::to_string(blob_files_.size());
+    }
+    else if (name == "lsmkv.total-blob-file-size")
+    {
+        uint64_t bytes = 0;
+        for (typename std::map<uint64_t, std::shared_ptr<const BlobFileReader>>::const_iterator blob_it = blob_files_.begin();
+             blob_it != blob_files_.end();
+             ++blob_it)
         {
-            return "";
+            bytes += blob_it->second->file_size();
         }
-        VALUE value = FindValue(level, tmp, offset);
-        if (value == "~DELETED~")
+        *value = std::to_string(bytes);
+    }
+    else if (name == "lsmkv.live-blob-file-size")
+    {
+        uint64_t bytes = 0;
+        std::map<uint64_t, uint64_t> live_bytes = LiveBlobBytes();
+        for (std::map<uint64_t, uint64_t>::const_iterator live_it = live_bytes.begin(); live_it != live_bytes.end(); ++live_it)
         {
-            return "";
+            bytes += live_it->second;
         }
-        else
+        *value = std::to_string(bytes);
+    }
+    else if (name == "lsmkv.cur-size-active-mem-table")
+    {
+        *value = std::to_string(current_size_);
+    }
+    else if (name == "lsmkv.num-entries-active-mem-table")
+    {
+        *value = std::to_string(element_num_);
+    }
+    else if (name == "lsmkv.num-snapshots")
+    {
+        *value = std::to_string(snapshots_.size());
+    }
+    else
+    {
+        for (int ticker = 0; ticker < TICKER_TOTAL; ++ticker)
+        {
+            if (name == Statistics::Name((Ticker)ticker))
+            {
+                *value = std::to_string(statistics_.Get((Ticker)ticker));
+                return true;
+            }
+        }
+        for (int type = 0; type < HISTOGRAM_TOTAL; ++type)
         {
-            return value;
+            if (name == Statistics::Name((HistogramType)type))
+            {
+                *value = statistics_.ToString((HistogramType)type);
+                return true;
+            }
         }
+        return false;
     }
+    return true;
 }
 
+// only the statistics are dumped, they are the part safe to read while the store is in use
 template <class KEY, class VALUE>
-bool Memory<KEY, VALUE>::Del(const KEY &key)
+void Memory<KEY, VALUE>::DumpStats() const
+{
+    std::time_t now = std::time(nullptr);
+    char time[32];
+    std::strftime(time, sizeof(time), "%Y/%m/%d-%H:%M:%S", std::localtime(&now));
+    event_logger_->Log(std::string("** DUMPING STATS ") + time + " **\n" + statistics_.ToString());
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::DumpStatsPeriodically()
 {
-    if (Exist(key))
+    std::unique_lock<std::mutex> lock(dump_mutex_);
+    while (!dump_cv_.wait_for(lock, std::chrono::seconds(options_.stats_dump_period_sec), [this] { return stop_dump_; }))
     {
-        Put(key, "~DELETED~");
-        return true;
+        DumpStats();
     }
-    return false;
 }
 
+// the histograms the stage timers record into, null unless every operation is broken down
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::Reset()
+Statistics* Memory<KEY, VALUE>::StageStatistics() const
 {
-    delete list_;
-    list_ = new SkipList<KEY, VALUE>();
+#if defined(LSMKV_PERF_TIMING)
+    return options_.stage_timing_histograms? &statistics_ : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+// the field of the calling thread's perf context a stage timer adds to, null unless it asks for time
+template <class KEY, class VALUE>
+uint64_t* Memory<KEY, VALUE>::PerfNanos(uint64_t PerfContext::*field) const
+{
+#if defined(LSMKV_PERF_TIMING)
+    return (GetPerfLevel() == PERF_ENABLE_TIME)? &(GetPerfContext()->*field) : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+template <class KEY, class VALUE>
+void Memory<KEY, VALUE>::PerfCount(uint64_t PerfContext::*field, uint64_t count) const
+{
+    if (GetPerfLevel() != PERF_DISABLE)
+    {
+        GetPerfContext()->*field += count;
+    }
 }
 
 template <class KEY, class VALUE>
-void Memory<KEY, VALUE>::Scan(const KEY &key1, const KEY &key2, std::list<std::pair<KEY, VALUE>> &list) const
+void Memory<KEY, VALUE>::Scan(const KEY &key1, const KEY &key2, std::list<std::pair<KEY, VALUE>> &list,
+                              const Snapshot* snapshot) const
 {
-    list_->Scan(key1, key2, list);
-    for (typename std::list<std::pair<KEY, VALUE>>::iterator list_it = list.begin(); list_it != list.end();)
+    StageTimer timer(&statistics_, DB_SCAN_NANOS, nullptr);
+    uint64_t sequence = ReadSequence(snapshot);
+    std::vector<range_index_t> range_tombstones;
+    for (typename std::vector<range_tombstone_t>::const_iterator range_it = range_list_.begin();
+         range_it != range_list_.end();
+         ++range_it)
+    {
+        range_tombstones.push_back({file_index_t{-1, 0, 0, KEY(), KEY()}, *range_it});
+    }
+
+    // a memtable version under a memtable range tombstone is deleted like a memtable tombstone
+    std::vector<KEY> deleted_keys;
+    StageTimer memtable_timer(StageStatistics(), SCAN_MEMTABLE_NANOS, PerfNanos(&PerfContext::scan_memtable_nanos));
+    for (typename SkipList<KEY, VALUE>::Iterator it = list_->Seek(key1); it.Valid() && it.Key() <= key2; it.Next())
     {
-        if (list_it->second == "~DELETED~")
+        ValueType type;
+        uint64_t seq = 0;
+        const VALUE* value = it.Find(sequence, type, seq);
+        if (value == nullptr)
         {
-            list_it = list.erase(list_it);
+            continue;
+        }
+        if (type == TYPE_DELETION || CoveringSequence(range_tombstones, it.Key(), seq) <= sequence)
+        {
+            deleted_keys.push_back(it.Key());
         }
         else
         {
-            ++list_it;
+            list.push_back({it.Key(), *value});
         }
     }
+    memtable_timer.Stop();
 
+    StageTimer index_timer(StageStatistics(), SCAN_INDEX_NANOS, PerfNanos(&PerfContext::scan_index_nanos));
     std::vector<std::pair<int, const SmallSSTable*>> files_to_scan;
     ScanBuffer(key1, key2, files_to_scan);
+    statistics_.Record(SCAN_COUNT);
+    statistics_.Record(SCAN_TABLES_READ, files_to_scan.size());
+    PerfCount(&PerfContext::scan_tables_read, files_to_scan.size());
+    std::map<file_index_t, const SmallSSTable*> tables;
+    for (typename std::vector<std::pair<int, const SmallSSTable*>>::const_iterator file_it = files_to_scan.begin();
+         file_it != files_to_scan.end();
+         ++file_it)
+    {
+        tables.emplace(GetFileIndex(file_it->first, file_it->second), file_it->second);
+        for (typename std::vector<range_tombstone_t>::const_iterator range_it = file_it->second->range_tombstones_.begin();
+             range_it != file_it->second->range_tombstones_.end();
+             ++range_it)
+        {
+            range_tombstones.push_back({GetFileIndex(file_it->first, file_it->second), *range_it});
+        }
+    }
     std::vector<std::vector<std::pair<KEY, item_index_t>>> tables_package;
-    PackSmallSSTableRange(files_to_scan, key1, key2, tables_package);
+    PackSmallSSTableRange(files_to_scan, key1, key2, sequence, tables_package);
+    index_timer.Stop();
+    StageTimer merge_timer(StageStatistics(), SCAN_MERGE_NANOS, PerfNanos(&PerfContext::scan_merge_nanos));
     std::vector<std::pair<KEY, item_index_t>> merge_result;
     Merge(tables_package, merge_result);
+    merge_timer.Stop();
 
-    ReorganizeScanResult(merge_result, list);
+    StageTimer read_timer(StageStatistics(), SCAN_READ_NANOS, PerfNanos(&PerfContext::scan_read_nanos));
+    ReorganizeScanResult(merge_result, deleted_keys, range_tombstones, tables, sequence, list);
+    read_timer.Stop();
+    statistics_.Record(SCAN_KEYS_RETURNED, list.size());
 }
 
 template class Memory<uint64_t, std::string>;
+template class Memory<BinaryKey, std::string>;
+template class Memory<uint64_t, uint64_t>;
@@ -0,0 +1,72 @@
+#include "perf.h"
+#include <sstream>
+
+static thread_local PerfLevel perf_level = PERF_DISABLE;
+static thread_local PerfContext perf_context;
+
+static const struct
+{
+    const char* name_;
+    uint64_t PerfContext::*field_;
+} PERF_FIELDS[] = {
+    {"get_tables_probed", &PerfContext::get_tables_probed},
+    {"bloom_filter_useful", &PerfContext::bloom_filter_useful},
+    {"bloom_filter_positive", &PerfContext::bloom_filter_positive},
+    {"bloom_filter_false_positive", &PerfContext::bloom_filter_false_positive},
+    {"get_read_bytes", &PerfContext::get_read_bytes},
+    {"scan_tables_read", &PerfContext::scan_tables_read},
+    {"scan_read_bytes", &PerfContext::scan_read_bytes},
+    {"get_memtable_nanos", &PerfContext::get_memtable_nanos},
+    {"get_bloom_nanos", &PerfContext::get_bloom_nanos},
+    {"get_find_key_nanos", &PerfContext::get_find_key_nanos},
+    {"get_read_nanos", &PerfContext::get_read_nanos},
+    {"write_memtable_nanos", &PerfContext::write_memtable_nanos},
+    {"scan_memtable_nanos", &PerfContext::scan_memtable_nanos},
+    {"scan_index_nanos", &PerfContext::scan_index_nanos},
+    {"scan_merge_nanos", &PerfContext::scan_merge_nanos},
+    {"scan_read_nanos", &PerfContext::scan_read_nanos},
+    {"flush_nanos", &PerfContext::flush_nanos},
+    {"compaction_nanos", &PerfContext::compaction_nanos},
+};
+
+PerfContext::PerfContext()
+{
+    Reset();
+}
+
+void PerfContext::Reset()
+{
+    for (size_t i = 0; i < sizeof(PERF_FIELDS) / sizeof(PERF_FIELDS[0]); ++i)
+    {
+        this->*(PERF_FIELDS[i].field_) = 0;
+    }
+}
+
+std::string PerfContext::ToString() const
+{
+    std::ostringstream out;
+    for (size_t i = 0; i < sizeof(PERF_FIELDS) / sizeof(PERF_FIELDS[0]); ++i)
+    {
+        uint64_t value = this->*(PERF_FIELDS[i].field_);
+        if (value != 0)
+        {
+            out << (out.tellp() == 0? "" : ", ") << PERF_FIELDS[i].name_ << " = " << value;
+        }
+    }
+    return out.str();
+}
+
+void SetPerfLevel(PerfLevel level)
+{
+    perf_level = level;
+}
+
+PerfLevel GetPerfLevel()
+{
+    return perf_level;
+}
+
+PerfContext* GetPerfContext()
+{
+    return &perf_context;
+}
@@ -0,0 +1,62 @@
+#include "pinnable.h"
+
+PinnableValue::PinnableValue():
+    self_(), data_(), pin_(nullptr)
+{
+
+}
+
+PinnableValue::PinnableValue(PinnableValue &&other)
+{
+    *this = std::move(other);
+}
+
+PinnableValue& PinnableValue::operator = (PinnableValue &&other)
+{
+    if (this == &other)
+    {
+        return *this;
+    }
+    pin_ = std::move(other.pin_);
+    if (pin_ != nullptr)
+    {
+        data_ = other.data_;
+        self_.clear();
+    }
+    else
+    {
+        // a moved std::string may keep its characters inline, so the view is rebuilt
+        self_ = std::move(other.self_);
+        data_ = self_;
+    }
+    other.Reset();
+    return *this;
+}
+
+void PinnableValue::Pin(std::string_view data, std::shared_ptr<const void> pin)
+{
+    self_.clear();
+    data_ = data;
+    pin_ = std::move(pin);
+}
+
+void PinnableValue::PinSelf(const std::string &data)
+{
+    pin_.reset();
+    self_ = data;
+    data_ = self_;
+}
+
+void PinnableValue::PinSelf(std::string &&data)
+{
+    pin_.reset();
+    self_ = std::move(data);
+    data_ = self_;
+}
+
+void PinnableValue::Reset()
+{
+    pin_.reset();
+    self_.clear();
+    data_ = std::string_view();
+}
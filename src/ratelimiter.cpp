@@ -0,0 +1,117 @@
+#include "ratelimiter.h"
+#include <algorithm>
+
+// an auto-tuned limiter starts at half the limit and moves between a twentieth of it and the limit
+RateLimiter::RateLimiter(int64_t bytes_per_sec, bool auto_tune, uint64_t latency_target_us, int64_t refill_period_us):
+    max_bytes_per_sec_(bytes_per_sec), refill_period_us_(refill_period_us), auto_tune_(auto_tune),
+    latency_target_us_(latency_target_us), bytes_per_sec_(auto_tune? bytes_per_sec / 2 : bytes_per_sec),
+    available_bytes_(0), next_refill_(clock_t::now()), high_waiting_(0), latency_us_(0)
+{
+    for (int priority = 0; priority < IO_TOTAL; ++priority)
+    {
+        total_bytes_[priority] = 0;
+        total_requests_[priority] = 0;
+        throttled_us_[priority] = 0;
+    }
+}
+
+int64_t RateLimiter::RefillBytes() const
+{
+    return std::max<int64_t>(bytes_per_sec_ * refill_period_us_ / 1000000, 1);
+}
+
+// tokens do not pile up beyond one period, an idle limiter gives no burst
+void RateLimiter::Refill(clock_t::time_point now)
+{
+    if (now < next_refill_)
+    {
+        return;
+    }
+    int64_t periods = std::chrono::duration_cast<std::chrono::microseconds>(now - next_refill_).count() / refill_period_us_ + 1;
+    next_refill_ += std::chrono::microseconds(periods * refill_period_us_);
+    if (auto_tune_)
+    {
+        Tune();
+    }
+    available_bytes_ = std::min(available_bytes_ + periods * RefillBytes(), RefillBytes());
+}
+
+// back off quickly while reads are slow, recover slowly once they are fast again
+void RateLimiter::Tune()
+{
+    if (latency_us_ > latency_target_us_)
+    {
+        bytes_per_sec_ = std::max(bytes_per_sec_ * 4 / 5, max_bytes_per_sec_ / 20);
+    }
+    else if (latency_us_ < latency_target_us_ / 2)
+    {
+        bytes_per_sec_ = std::min(bytes_per_sec_ + bytes_per_sec_ / 20 + 1, max_bytes_per_sec_);
+    }
+}
+
+// a request larger than one period is granted a period at a time
+void RateLimiter::Request(int64_t bytes, Priority priority)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    total_bytes_[priority] += bytes;
+    ++total_requests_[priority];
+    while (bytes > 0)
+    {
+        int64_t grant = 0;
+        bool waiting = false;
+        while (true)
+        {
+            clock_t::time_point now = clock_t::now();
+            Refill(now);
+            grant = std::min(bytes, RefillBytes());         // tuning may have shrunk the period
+            if (available_bytes_ >= grant && (priority == IO_HIGH || high_waiting_ == 0))
+            {
+                break;
+            }
+            if (!waiting && priority == IO_HIGH)
+            {
+                ++high_waiting_;
+            }
+            waiting = true;
+            cv_.wait_until(lock, next_refill_);
+            throttled_us_[priority] += std::chrono::duration_cast<std::chrono::microseconds>(clock_t::now() - now).count();
+        }
+        if (waiting && priority == IO_HIGH)
+        {
+            --high_waiting_;
+        }
+        available_bytes_ -= grant;
+        bytes -= grant;
+    }
+    cv_.notify_all();
+}
+
+void RateLimiter::RecordForegroundLatency(uint64_t micros)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    latency_us_ = latency_us_ * 0.9 + micros * 0.1;
+}
+
+int64_t RateLimiter::GetBytesPerSecond() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return bytes_per_sec_;
+}
+
+uint64_t RateLimiter::GetTotalBytes(Priority priority) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_bytes_[priority];
+}
+
+uint64_t RateLimiter::GetTotalRequests(Priority priority) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_requests_[priority];
+}
+
+uint64_t RateLimiter::GetThrottledMicros(Priority priority) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return throttled_us_[priority];
+}
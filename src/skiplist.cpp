@@ -1,13 +1,15 @@
 #include <iostream>
 #include <stdlib.h>
+#include <new>
 
 #include "skiplist.h"
 
 template <class KEY, class VALUE>
-SkipList<KEY, VALUE>::SkipList()
+SkipList<KEY, VALUE>::SkipList():
+    next_block_(0), next_node_(NODES_PER_BLOCK)
 {
-    head = new SKNode(0, "", HEAD);
-    nil = new SKNode(UINT64_MAX, "", NIL);
+    head = new SKNode(KEY(), VALUE(), HEAD);
+    nil = new SKNode(KEY(), VALUE(), NIL);
     for (int i = 0; i < MAX_LEVEL; ++i)
     {
         head->forwards[i] = nil;
@@ -18,14 +20,33 @@ SkipList<KEY, VALUE>::SkipList()
 template <class KEY, class VALUE>
 SkipList<KEY, VALUE>::~SkipList()
 {
-    SKNode *n1 = head;
-    SKNode *n2;
-    while (n1)
+    Reset();
+    delete head;
+    delete nil;
+    for (std::vector<char*>::iterator block_it = blocks_.begin(); block_it != blocks_.end(); ++block_it)
     {
-        n2 = n1->forwards[0];
-        delete n1;
-        n1 = n2;
+        free(*block_it);
+    }
+}
+
+template <class KEY, class VALUE>
+void* SkipList<KEY, VALUE>::AllocateNode()
+{
+    if (next_node_ == NODES_PER_BLOCK)
+    {
+        if (next_block_ == blocks_.size())
+        {
+            char* block = (char*)malloc(sizeof(SKNode) * NODES_PER_BLOCK);
+            if (block == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            blocks_.push_back(block);
+        }
+        ++next_block_;
+        next_node_ = 0;
     }
+    return blocks_[next_block_ - 1] + sizeof(SKNode) * (next_node_++);
 }
 
 template <class KEY, class VALUE>
@@ -39,7 +60,7 @@ template <class KEY, class VALUE>
 int SkipList<KEY, VALUE>::RandomLevel()
 {
     int result = 1;
-    while (result < MAX_LEVEL && MyRand() < 0.5)
+    while (result < MAX_LEVEL && MyRand() < 1.0 / BRANCHING)
     {
         ++result;
     }
@@ -47,13 +68,13 @@ int SkipList<KEY, VALUE>::RandomLevel()
 }
 
 template <class KEY, class VALUE>
-SkipList<KEY, VALUE>::SKNode::SKNode(KEY _key, VALUE _val,int level,std::vector<SKNode*> &backward,std::vector<SKNode*> &forward):
-    key(_key), val(_val),height(level), type(SKNodeType::NORMAL)
+SkipList<KEY, VALUE>::SKNode::SKNode(KEY _key, VALUE &&_val, ValueType _vtype, uint64_t _seq, int level, SKNode** backward, SKNode** forward):
+    key(_key), val(std::move(_val)), vtype(_vtype), seq(_seq), height(level), type(SKNodeType::NORMAL)
 {
     for (int i = 0; i < level; ++i)
     {
         backward[MAX_LEVEL-i-1]->forwards[i] = this;
-        forwards.push_back(forward[MAX_LEVEL - i - 1]);
+        forwards[i] = forward[MAX_LEVEL - i - 1];
     }
 }
 
@@ -62,74 +83,187 @@ SkipList<KEY, VALUE>::SKNode::SKNode(KEY _key, VALUE _val, SKNodeType _type)
 {
     key = _key;
     val = _val;
+    vtype = TYPE_VALUE;
+    seq = 0;
     type = _type;
     for (int i = 0; i < MAX_LEVEL; ++i)
     {
-        forwards.push_back(NULL);
+        forwards[i] = NULL;
     }
 }
 
+template <class KEY, class VALUE>
+SkipList<KEY, VALUE>::Iterator::Iterator(const SKNode* node):
+    node_(node)
+{
+
+}
+
+template <class KEY, class VALUE>
+bool SkipList<KEY, VALUE>::Iterator::Valid() const
+{
+    return node_ != NULL && node_->type == NORMAL;
+}
+
+template <class KEY, class VALUE>
+void SkipList<KEY, VALUE>::Iterator::Next()
+{
+    node_ = node_->forwards[0];
+}
+
+template <class KEY, class VALUE>
+const KEY& SkipList<KEY, VALUE>::Iterator::Key() const
+{
+    return node_->key;
+}
+
+template <class KEY, class VALUE>
+const VALUE& SkipList<KEY, VALUE>::Iterator::Value() const
+{
+    return node_->val;
+}
+
+template <class KEY, class VALUE>
+ValueType SkipList<KEY, VALUE>::Iterator::Type() const
+{
+    return node_->vtype;
+}
+
+template <class KEY, class VALUE>
+uint64_t SkipList<KEY, VALUE>::Iterator::Sequence() const
+{
+    return node_->seq;
+}
+
+template <class KEY, class VALUE>
+const std::vector<typename SkipList<KEY, VALUE>::Version>& SkipList<KEY, VALUE>::Iterator::Older() const
+{
+    return node_->older;
+}
+
+template <class KEY, class VALUE>
+const VALUE* SkipList<KEY, VALUE>::Iterator::Find(uint64_t snapshot, ValueType &type, uint64_t &seq) const
+{
+    return FindVersion(node_, snapshot, type, seq);
+}
+
+// the newest version of the node written at or before snapshot, nullptr if every version is newer
+template <class KEY, class VALUE>
+const VALUE* SkipList<KEY, VALUE>::FindVersion(const SKNode* node, uint64_t snapshot, ValueType &type, uint64_t &seq)
+{
+    if (node->seq <= snapshot)
+    {
+        type = node->vtype;
+        seq = node->seq;
+        return &(node->val);
+    }
+    for (typename std::vector<Version>::const_reverse_iterator version_it = node->older.rbegin();
+         version_it != node->older.rend();
+         ++version_it)
+    {
+        if (version_it->seq <= snapshot)
+        {
+            type = version_it->vtype;
+            seq = version_it->seq;
+            return &(version_it->val);
+        }
+    }
+    return nullptr;
+}
+
+template <class KEY, class VALUE>
+typename SkipList<KEY, VALUE>::Iterator SkipList<KEY, VALUE>::Begin() const
+{
+    return Iterator(head->forwards[0]);
+}
+
+// position at the first node whose key is not less than key
+template <class KEY, class VALUE>
+typename SkipList<KEY, VALUE>::Iterator SkipList<KEY, VALUE>::Seek(const KEY &key) const
+{
+    SKNode* tmp = head;
+    int level = MAX_LEVEL;
+    while (level)
+    {
+        while (Precedes(tmp->forwards[level-1], key))
+        {
+            tmp = tmp->forwards[level-1];
+        }
+        level -= 1;
+    }
+    return Iterator(tmp->forwards[0]);
+}
+
+template <class KEY, class VALUE>
+int SkipList<KEY, VALUE>::Insert(const KEY &key, const VALUE &value, ValueType type, uint64_t seq, uint64_t snapshot)
+{
+    return Insert(key, VALUE(value), type, seq, snapshot);
+}
+
 /*
- * return 0 if key is not exist
- * return -1 if insert failed
- * return sizeof(value) if key is already exist
+ * snapshot is the newest live snapshot (0 if none), the replaced version is kept if it can still see it
+ * return -1 if key is not exist or the replaced version is kept
+ * return the size of the replaced value if key is already exist, a string tombstone has size 0
  */
 template <class KEY, class VALUE>
-int SkipList<KEY, VALUE>::Insert(const KEY &key, const VALUE &value)
+int SkipList<KEY, VALUE>::Insert(const KEY &key, VALUE &&value, ValueType type, uint64_t seq, uint64_t snapshot)
 {
     SKNode* tmp = head;
     int level = MAX_LEVEL;
-    std::vector<SKNode*> backward;
-    std::vector<SKNode*> forward;
+    SKNode* backward[MAX_LEVEL];
+    SKNode* forward[MAX_LEVEL];
     while (level)
     {
-        backward.push_back(tmp);
-        forward.push_back(tmp->forwards[level - 1]);
-        while (key>tmp->forwards[level - 1]->key)
+        backward[MAX_LEVEL - level] = tmp;
+        forward[MAX_LEVEL - level] = tmp->forwards[level - 1];
+        while (Precedes(tmp->forwards[level - 1], key))
         {
             tmp=tmp->forwards[level - 1];
             backward[MAX_LEVEL - level]=tmp;
             forward[MAX_LEVEL - level]=tmp->forwards[level - 1];
         }
-        if (key==tmp->forwards[level-1]->key)
+        if (Holds(tmp->forwards[level-1], key))
         {
-            int size = sizeof(char) * (tmp->forwards[level - 1]->val).length();
-            tmp->forwards[level-1]->val = value;
+            SKNode* node = tmp->forwards[level - 1];
+            int size = -1;
+            if (snapshot != 0 && node->seq <= snapshot)
+            {
+                node->older.push_back(Version{std::move(node->val), node->vtype, node->seq});
+            }
+            else
+            {
+                size = ValueTraits<VALUE>::Size(node->val);
+            }
+            node->val = std::move(value);
+            node->vtype = type;
+            node->seq = seq;
             return size;
         }
         level -= 1;
     }
-    SKNode* node = new SKNode(key, value, RandomLevel(), backward,forward);
-    if (node == NULL)
-    {
-        return -1;
-    }
-    else
-    {
-        return 0;
-    }
-    // TODO
+    new (AllocateNode()) SKNode(key, std::move(value), type, seq, RandomLevel(), backward, forward);
+    return -1;
 }
 
+// return the value of the newest version visible to snapshot, or nullptr if there is none
 template <class KEY, class VALUE>
-VALUE SkipList<KEY, VALUE>::Search(const KEY &key) const
+const VALUE* SkipList<KEY, VALUE>::Find(const KEY &key, ValueType &type, uint64_t &seq, uint64_t snapshot) const
 {
     SKNode* tmp = head;
     int level = MAX_LEVEL;
     while (level)
     {
-        while (key>tmp->forwards[level-1]->key)
+        while (Precedes(tmp->forwards[level-1], key))
         {
             tmp = tmp->forwards[level-1];
         }
         level -= 1;
     }
-    if (key == tmp->forwards[level]->key)
+    if (Holds(tmp->forwards[level], key))
     {
-        return tmp->forwards[level]->val;
+        return FindVersion(tmp->forwards[level], snapshot, type, seq);
     }
-    return "";
-    // TODO
+    return nullptr;
 }
 
 template <class KEY, class VALUE>
@@ -139,13 +273,13 @@ bool SkipList<KEY, VALUE>::Exist(const KEY &key) const
     int level = MAX_LEVEL;
     while (level)
     {
-        while (key > tmp->forwards[level-1]->key)
+        while (Precedes(tmp->forwards[level-1], key))
         {
             tmp = tmp->forwards[level-1];
         }
         level -= 1;
     }
-    if (key == tmp->forwards[level]->key)
+    if (Holds(tmp->forwards[level], key))
     {
         return true;
     }
@@ -160,19 +294,20 @@ bool SkipList<KEY, VALUE>::SetDelete(const KEY &key)
     int level = MAX_LEVEL;
     while (level)
     {
-        while (key > tmp->forwards[level-1]->key)
+        while (Precedes(tmp->forwards[level-1], key))
         {
             tmp = tmp->forwards[level-1];
         }
         level -= 1;
     }
-    if (key == tmp->forwards[level]->key)
+    if (Holds(tmp->forwards[level], key))
     {
-        if (tmp->forwards[level]->val == "~DELETED~")
+        if (tmp->forwards[level]->vtype == TYPE_DELETION)
         {
             return false;
         }
-        tmp->forwards[level]->val = "~DELETED~";
+        tmp->forwards[level]->vtype = TYPE_DELETION;
+        tmp->forwards[level]->val = VALUE();
         return true;
     }
     return false;
@@ -186,19 +321,19 @@ void SkipList<KEY, VALUE>::Delete(const KEY &key)
     int deleterLevel = 0;
     bool exist = false;
     SKNode* deleter = NULL;
-    std::vector<SKNode*> backward;
-    std::vector<SKNode*> forward;
+    SKNode* backward[MAX_LEVEL];
+    SKNode* forward[MAX_LEVEL];
     while (level)
     {
-        backward.push_back(tmp);
-        forward.push_back(tmp->forwards[level-1]);
-        while (key>tmp->forwards[level-1]->key)
+        backward[MAX_LEVEL-level] = tmp;
+        forward[MAX_LEVEL-level] = tmp->forwards[level-1];
+        while (Precedes(tmp->forwards[level-1], key))
         {
             tmp = tmp->forwards[level-1];
             backward[MAX_LEVEL-level] = tmp;
             forward[MAX_LEVEL-level] = tmp->forwards[level-1];
         }
-        if (key == tmp->forwards[level-1]->key&&!exist)
+        if (Holds(tmp->forwards[level-1], key)&&!exist)
         {
             deleterLevel = level;
             exist = true;
@@ -212,7 +347,7 @@ void SkipList<KEY, VALUE>::Delete(const KEY &key)
         {
             backward[MAX_LEVEL-i-1]->forwards[i] = forward[MAX_LEVEL - i - 1]->forwards[i];
         }
-        delete deleter;
+        deleter->~SKNode();
     }
     // TODO
 }
@@ -225,13 +360,15 @@ void SkipList<KEY, VALUE>::Reset()
     while (n1 != nil)
     {
         n2 = n1->forwards[0];
-        delete n1;
+        n1->~SKNode();
         n1 = n2;
     }
     for (int i = 0; i < MAX_LEVEL; ++i)
     {
         head->forwards[i] = nil;
     }
+    next_block_ = 0;
+    next_node_ = NODES_PER_BLOCK;
 }
 
 template <class KEY, class VALUE>
@@ -241,15 +378,16 @@ void SkipList<KEY, VALUE>::Scan(const KEY &key1, const KEY &key2, std::list<std:
     int level=MAX_LEVEL;
     while (level)
     {
-        while (key1 > tmp->forwards[level-1]->key)
+        while (Precedes(tmp->forwards[level-1], key1))
         {
             tmp = tmp->forwards[level-1];
         }
         level -= 1;
     }
-    while (tmp && key2 >= tmp->key)
+    tmp = tmp->forwards[0];
+    while (tmp && tmp->type == NORMAL && key2 >= tmp->key)
     {
-        if (tmp->type != HEAD)
+        if (tmp->type == NORMAL && tmp->vtype == TYPE_VALUE)
             list.push_back(std::pair<KEY, VALUE>(tmp->key, tmp->val));
         tmp = tmp->forwards[0];
     }
@@ -263,7 +401,10 @@ std::vector<std::pair<KEY, VALUE>> SkipList<KEY, VALUE>::ScanAll() const
     SKNode* tmp = head->forwards[0];
     while (tmp != NULL && tmp != nil)
     {
-        data.push_back(std::pair<KEY, VALUE>(tmp->key, tmp->val));
+        if (tmp->vtype == TYPE_VALUE)
+        {
+            data.push_back(std::pair<KEY, VALUE>(tmp->key, tmp->val));
+        }
         tmp = tmp->forwards[0];
     }
     return data;
@@ -278,7 +419,7 @@ void SkipList<KEY, VALUE>::Display() const
         SKNode* node = head->forwards[i];
         while (node->type != SKNodeType::NIL)
         {
-            std::cout << "-->(" << node->key << "," << node->val << ")";
+            std::cout << "-->(" << node->key << "," << ValueTraits<VALUE>::Display(node->val) << ")";
             node = node->forwards[i];
         }
         std::cout << "-->N" << std::endl;
@@ -286,3 +427,5 @@ void SkipList<KEY, VALUE>::Display() const
 }
 
 template class SkipList<uint64_t, std::string>;
+template class SkipList<BinaryKey, std::string>;
+template class SkipList<uint64_t, uint64_t>;
@@ -1,23 +1,199 @@
 #include "sstable.h"
+#include "mappedfile.h"
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <new>
+#if !defined(_MSC_VER)
+#include <fcntl.h>
+#include <climits>
+#include <sys/uio.h>
+#endif
+
+// grows to the largest table its thread has written and is kept for the next one
+class WriteBuffer
+{
+private:
+    char* data_;
+    size_t capacity_;
+public:
+    static constexpr size_t ALIGNMENT = 4096;      // enough for O_DIRECT on any block size in use
+    WriteBuffer(): data_(nullptr), capacity_(0) {}
+    ~WriteBuffer() { free(data_); }
+    char* Reserve(size_t size)
+    {
+        if (size > capacity_)
+        {
+            size_t capacity = (capacity_ == 0)? ALIGNMENT : capacity_;
+            while (capacity < size)
+            {
+                capacity *= 2;
+            }
+            free(data_);
+            data_ = nullptr;
+            capacity_ = 0;
+#if defined(_MSC_VER)
+            data_ = (char*)malloc(capacity);
+#else
+            void* data = nullptr;
+            data_ = (posix_memalign(&data, ALIGNMENT, capacity) == 0)? (char*)data : nullptr;
+#endif
+            if (data_ == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            capacity_ = capacity;
+        }
+        return data_;
+    }
+};
+
+static thread_local WriteBuffer write_buffer;
+
+#if !defined(_MSC_VER)
+// writev until every buffer is out, IOV_MAX at a time
+static bool WriteVector(int fd, struct iovec* iov, size_t count)
+{
+    while (count > 0)
+    {
+        ssize_t written = writev(fd, iov, (count > IOV_MAX)? IOV_MAX : count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        while (count > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0)
+        {
+            iov->iov_base = (char*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return true;
+}
+#endif
+
+template <class KEY, class VALUE>
+SSTable<KEY, VALUE>::SSTable(int bloom_filter_size):
+    header_(), filter_(bloom_filter_size), data_size_(0), range_size_(0), index_size_(0)
+{
+
+}
+
+template <class KEY, class VALUE>
+SSTable<KEY, VALUE>::SSTable(const std::vector<entry_t> &data, const std::vector<RangeTombstone> &range_tombstones,
+                             int bloom_filter_size):
+    header_(), filter_(bloom_filter_size), data_size_(0), range_size_(0), index_size_(0)
+{
+    header_.timestamp_ = timestamp_;
+    index_.clear();
+    data_.clear();
+    index_.reserve(data.size());
+    data_.reserve(data.size());
+    uint32_t pos = 0;
+    for (typename std::vector<entry_t>::const_iterator it = data.begin(); it != data.end(); ++it)
+    {
+        Append(std::get<0>(*it), std::get<1>(*it), std::get<2>(*it), std::get<3>(*it), pos);
+    }
+    AppendRangeTombstones(range_tombstones);
+}
 
+// serialize straight from the memtable nodes, no value is copied before SSTableOut
 template <class KEY, class VALUE>
-SSTable<KEY, VALUE>::SSTable(const std::vector<std::pair<KEY, VALUE>> &data, int bloom_filter_size):
-    header_(), filter_(bloom_filter_size)
+SSTable<KEY, VALUE>::SSTable(const SkipList<KEY, VALUE> &list, const std::vector<RangeTombstone> &range_tombstones,
+                             int bloom_filter_size):
+    header_(), filter_(bloom_filter_size), data_size_(0), range_size_(0), index_size_(0)
 {
     header_.timestamp_ = timestamp_;
     index_.clear();
     data_.clear();
     uint32_t pos = 0;
-    for (typename std::vector<std::pair<KEY, VALUE>>::const_iterator it = data.begin(); it != data.end(); ++it)
+    for (typename SkipList<KEY, VALUE>::Iterator it = list.Begin(); it.Valid(); it.Next())
+    {
+        Append(it.Key(), it.Value(), it.Type(), it.Sequence(), pos);
+        const std::vector<typename SkipList<KEY, VALUE>::Version> &older = it.Older();
+        for (typename std::vector<typename SkipList<KEY, VALUE>::Version>::const_reverse_iterator version_it = older.rbegin();
+             version_it != older.rend();
+             ++version_it)
+        {
+            Append(it.Key(), version_it->val, version_it->vtype, version_it->seq, pos);
+        }
+    }
+    AppendRangeTombstones(range_tombstones);
+}
+
+// the key range of the table is widened to the tombstones, they are not put in the bloom filter
+template <class KEY, class VALUE>
+void SSTable<KEY, VALUE>::AppendRangeTombstones(const std::vector<RangeTombstone> &range_tombstones)
+{
+    for (typename std::vector<RangeTombstone>::const_iterator it = range_tombstones.begin();
+         it != range_tombstones.end();
+         ++it)
+    {
+        if (header_.length_ == 0 && header_.range_length_ == 0)
+        {
+            header_.max_ele_key_ = it->end_;
+            header_.min_ele_key_ = it->begin_;
+        }
+        ++(header_.range_length_);
+        header_.max_ele_key_ = (it->end_ > header_.max_ele_key_)? it->end_ : header_.max_ele_key_;
+        header_.min_ele_key_ = (it->begin_ < header_.min_ele_key_)? it->begin_ : header_.min_ele_key_;
+        range_size_ += RangeTombstoneSize(*it);
+        range_tombstones_.push_back(*it);
+    }
+}
+
+// file layout: head, bloom filter, range tombstones, index, data
+template <class KEY, class VALUE>
+uint64_t SSTable<KEY, VALUE>::DataOffset() const
+{
+    uint64_t head_size = sizeof(uint64_t) * 3 + KeyTraits<KEY>::EncodedSize(header_.max_ele_key_) +
+            KeyTraits<KEY>::EncodedSize(header_.min_ele_key_);
+    return head_size + sizeof(bool) * filter_.m_ + range_size_ + index_size_;
+}
+
+template <class KEY, class VALUE>
+uint64_t SSTable<KEY, VALUE>::FileSize() const
+{
+    return DataOffset() + data_size_;
+}
+
+template <class KEY, class VALUE>
+std::string SSTable<KEY, VALUE>::FileName(uint64_t timestamp, uint64_t length, const KEY &max_ele_key, const KEY &min_ele_key)
+{
+    return std::to_string(timestamp) + "-" + std::to_string(length) + "-" + KeyTraits<KEY>::FileName(max_ele_key) + "-" +
+            KeyTraits<KEY>::FileName(min_ele_key) + ".sst";
+}
+
+template <class KEY, class VALUE>
+void SSTable<KEY, VALUE>::Append(const KEY &key, const VALUE &value, ValueType type, uint64_t seq, uint32_t &pos)
+{
+    if (header_.length_ == 0 && header_.range_length_ == 0)
     {
-        ++(header_.length_);
-        VALUE value = it->second;
-        pos += sizeof(char) * value.length();
-        header_.max_ele_key_ = (it->first > header_.max_ele_key_)? it->first : header_.max_ele_key_;
-        header_.min_ele_key_ = (it->first < header_.min_ele_key_)? it->first : header_.min_ele_key_;
-        filter_.Insert(it->first);
-        index_.push_back(std::pair<KEY, uint32_t>(it->first, pos - sizeof(char) * value.length()));
-        data_.push_back(it->second);
+        header_.max_ele_key_ = key;
+        header_.min_ele_key_ = key;
+    }
+    ++(header_.length_);
+    header_.max_ele_key_ = (key > header_.max_ele_key_)? key : header_.max_ele_key_;
+    header_.min_ele_key_ = (key < header_.min_ele_key_)? key : header_.min_ele_key_;
+    filter_.Insert(key);
+    index_size_ += (index_.empty()? KeyTraits<KEY>::IndexKeySize(KEY(), key) : KeyTraits<KEY>::IndexKeySize(index_.back().key_, key)) +
+            OFFSET_SIZE + sizeof(uint8_t) + sizeof(uint64_t);
+    index_.push_back(IndexEntry{key, pos, type, seq});
+    // a fixed-width tombstone keeps its place in the stride
+    if (type != TYPE_DELETION || ValueTraits<VALUE>::FIXED_WIDTH)
+    {
+        data_.push_back(&value);
+        pos += ValueTraits<VALUE>::Size(value);
+        data_size_ += ValueTraits<VALUE>::Size(value);
     }
 }
 
@@ -28,7 +204,7 @@ SSTable<KEY, VALUE>::~SSTable()
 }
 
 template <class KEY, class VALUE>
-int SSTable<KEY, VALUE>::makedir(std::string dir_name)
+int SSTable<KEY, VALUE>::makedir(std::string dir_name) const
 {
 #if defined(_MSC_VER)
     return mkdir(dir_name.c_str());
@@ -37,10 +213,11 @@ int SSTable<KEY, VALUE>::makedir(std::string dir_name)
 #endif
 }
 
+// the head, filter, tombstones and index go into one buffer, values are written from where they
+// live; with O_DIRECT the values are copied in as well and the padded tail is truncated away
 template <class KEY, class VALUE>
-bool SSTable<KEY, VALUE>::SSTableOut(std::string output_path)
+bool SSTable<KEY, VALUE>::SSTableOut(std::string output_path, const std::string &suffix, bool direct) const
 {
-    std::ofstream out;
     if (output_path[output_path.length() - 1] != '/')
     {
         output_path.append("/");
@@ -52,31 +229,209 @@ bool SSTable<KEY, VALUE>::SSTableOut(std::string output_path)
             return false;
         }
     }
-    std::string filename = std::to_string(header_.timestamp_) + "-" + std::to_string(header_.length_) + "-" +
-            std::to_string(header_.max_ele_key_) + "-" + std::to_string(header_.min_ele_key_) + ".sst";
-    out.open(output_path + filename, std::ios::out | std::ios::binary);
+    std::string filename = FileName(header_.timestamp_, header_.length_, header_.max_ele_key_, header_.min_ele_key_) + suffix;
+    uint64_t meta_size = DataOffset();
+    uint64_t file_size = meta_size + data_size_;
+#if defined(_MSC_VER)
+    std::ofstream out(output_path + filename, std::ios::out | std::ios::binary);
     if (!out.is_open())
     {
         return false;
     }
-    out.write((char*)&(header_.timestamp_), sizeof(uint64_t));
-    out.write((char*)&(header_.length_), sizeof(uint64_t));
-    out.write((char*)&(header_.max_ele_key_), sizeof(KEY));
-    out.write((char*)&(header_.min_ele_key_), sizeof(KEY));
-    out.write((char*)&(filter_.table_), sizeof(bool) * filter_.m_);
-    for (typename std::vector<std::pair<KEY, uint32_t>>::iterator index_it = index_.begin(); index_it != index_.end(); ++index_it)
+    char* buffer = write_buffer.Reserve(meta_size);
+    Serialize(buffer);
+    out.write(buffer, meta_size);
+    for (typename std::vector<const VALUE*>::const_iterator data_it = data_.begin(); data_it != data_.end(); ++data_it)
+    {
+        out.write(ValueTraits<VALUE>::Data(**data_it), ValueTraits<VALUE>::Size(**data_it));
+    }
+    out.close();
+    return !out.fail();
+#else
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int fd = -1;
+#ifdef O_DIRECT
+    if (direct)
+    {
+        fd = open((output_path + filename).c_str(), flags | O_DIRECT, 0644);      // not every file system takes it
+    }
+#endif
+    bool is_direct = (fd != -1);
+    if (fd == -1)
     {
-        out.write((char*)&(index_it->first), sizeof(KEY));
-        out.write((char*)&(index_it->second), sizeof(uint32_t));
+        fd = open((output_path + filename).c_str(), flags, 0644);
     }
-    for (typename std::vector<VALUE>::iterator data_it = data_.begin(); data_it != data_.end(); ++data_it)
+    if (fd == -1)
     {
-        const char* ch = (*data_it).c_str();
-        VALUE value = *data_it;
-        out.write(ch, sizeof(char) * value.length());
+        return false;
     }
-    out.close();
+    bool success = false;
+    if (is_direct)
+    {
+        uint64_t padded_size = (file_size + WriteBuffer::ALIGNMENT - 1) / WriteBuffer::ALIGNMENT * WriteBuffer::ALIGNMENT;
+        char* buffer = write_buffer.Reserve(padded_size);
+        char* pos = Serialize(buffer);
+        for (typename std::vector<const VALUE*>::const_iterator data_it = data_.begin(); data_it != data_.end(); ++data_it)
+        {
+            memcpy(pos, ValueTraits<VALUE>::Data(**data_it), ValueTraits<VALUE>::Size(**data_it));
+            pos += ValueTraits<VALUE>::Size(**data_it);
+        }
+        memset(pos, 0, padded_size - file_size);
+        struct iovec iov = {buffer, padded_size};
+        success = WriteVector(fd, &iov, 1) && ftruncate(fd, file_size) == 0;
+    }
+    else
+    {
+        char* buffer = write_buffer.Reserve(meta_size);
+        Serialize(buffer);
+        std::vector<struct iovec> iovs;
+        iovs.reserve(data_.size() + 1);
+        iovs.push_back({buffer, meta_size});
+        for (typename std::vector<const VALUE*>::const_iterator data_it = data_.begin(); data_it != data_.end(); ++data_it)
+        {
+            if (ValueTraits<VALUE>::Size(**data_it) != 0)
+            {
+                iovs.push_back({const_cast<char*>(ValueTraits<VALUE>::Data(**data_it)), ValueTraits<VALUE>::Size(**data_it)});
+            }
+        }
+        success = WriteVector(fd, iovs.data(), iovs.size());
+    }
+    return close(fd) == 0 && success;
+#endif
+}
+
+// head, filter, range tombstones and index as laid out in the file, returns the end of what was written
+template <class KEY, class VALUE>
+char* SSTable<KEY, VALUE>::Serialize(char* pos) const
+{
+    auto put = [&pos] (const void* src, size_t size)
+    {
+        memcpy(pos, src, size);
+        pos += size;
+    };
+    put(&(header_.timestamp_), sizeof(uint64_t));
+    put(&(header_.length_), sizeof(uint64_t));
+    pos = KeyTraits<KEY>::Encode(header_.max_ele_key_, pos);
+    pos = KeyTraits<KEY>::Encode(header_.min_ele_key_, pos);
+    put(&(header_.range_length_), sizeof(uint64_t));
+    put(filter_.table_, sizeof(bool) * filter_.m_);
+    for (typename std::vector<RangeTombstone>::const_iterator range_it = range_tombstones_.begin();
+         range_it != range_tombstones_.end();
+         ++range_it)
+    {
+        pos = KeyTraits<KEY>::Encode(range_it->begin_, pos);
+        pos = KeyTraits<KEY>::Encode(range_it->end_, pos);
+        put(&(range_it->seq_), sizeof(uint64_t));
+    }
+    const KEY no_key = KEY();
+    const KEY* last_key = &no_key;          // each index key is stored against the one before it
+    for (typename std::vector<IndexEntry>::const_iterator index_it = index_.begin(); index_it != index_.end(); ++index_it)
+    {
+        uint8_t type = index_it->type_;
+        pos = KeyTraits<KEY>::EncodeIndexKey(*last_key, index_it->key_, pos);
+        put(&(index_it->offset_), OFFSET_SIZE);
+        put(&type, sizeof(uint8_t));
+        put(&(index_it->seq_), sizeof(uint64_t));
+        last_key = &(index_it->key_);
+    }
+    return pos;
+}
+
+// the head, filter, range tombstones and index of the table in the size bytes at data, filter is left pointing
+// into data; returns where the values start, or 0 if what is there is not a table written by SSTableOut
+template <class KEY, class VALUE>
+uint64_t SSTable<KEY, VALUE>::Deserialize(const char* data, uint64_t size, int bloom_filter_size, Head &header,
+                                          const char* &filter, std::vector<RangeTombstone> &range_tombstones,
+                                          std::vector<IndexEntry> &index)
+{
+    const char* pos = data;
+    const char* end = data + size;
+    auto get = [&pos, end] (void* dst, size_t size)
+    {
+        if (pos != nullptr && (size_t)(end - pos) >= size)
+        {
+            memcpy(dst, pos, size);
+            pos += size;
+        }
+        else
+        {
+            pos = nullptr;
+        }
+    };
+    auto get_key = [&pos, end] (KEY &key)
+    {
+        pos = (pos != nullptr)? KeyTraits<KEY>::Decode(pos, end, key) : nullptr;
+    };
+    get(&(header.timestamp_), sizeof(uint64_t));
+    get(&(header.length_), sizeof(uint64_t));
+    get_key(header.max_ele_key_);
+    get_key(header.min_ele_key_);
+    get(&(header.range_length_), sizeof(uint64_t));
+    if (pos == nullptr || header.length_ > size || header.range_length_ > size || (uint64_t)(end - pos) < (uint64_t)bloom_filter_size)
+    {
+        return 0;
+    }
+    filter = pos;
+    pos += bloom_filter_size;
+    range_tombstones.resize(header.range_length_);
+    for (typename std::vector<RangeTombstone>::iterator range_it = range_tombstones.begin();
+         range_it != range_tombstones.end();
+         ++range_it)
+    {
+        get_key(range_it->begin_);
+        get_key(range_it->end_);
+        get(&(range_it->seq_), sizeof(uint64_t));
+    }
+    const KEY no_key = KEY();
+    const KEY* last_key = &no_key;
+    index.resize(header.length_);
+    for (typename std::vector<IndexEntry>::iterator index_it = index.begin(); index_it != index.end(); ++index_it)
+    {
+        uint8_t type = 0;
+        pos = (pos != nullptr)? KeyTraits<KEY>::DecodeIndexKey(pos, end, *last_key, index_it->key_) : nullptr;
+        if (ValueTraits<VALUE>::FIXED_WIDTH)
+        {
+            index_it->offset_ = (index_it - index.begin()) * sizeof(VALUE);
+        }
+        get(&(index_it->offset_), OFFSET_SIZE);
+        get(&type, sizeof(uint8_t));
+        get(&(index_it->seq_), sizeof(uint64_t));
+        index_it->type_ = (ValueType)type;
+        last_key = &(index_it->key_);
+    }
+    return (pos == nullptr)? 0 : pos - data;
+}
+
+// the layout written by SSTableOut, through a mapping so that the values are never read
+template <class KEY, class VALUE>
+bool SSTable<KEY, VALUE>::SSTableIn(const std::string &filename)
+{
+    std::shared_ptr<const MappedFile> file = MappedFile::Open(filename);
+    if (file == nullptr)
+    {
+        return false;
+    }
+    const char* filter = nullptr;
+    uint64_t data_offset = Deserialize(file->data(), file->size(), sizeof(bool) * filter_.m_, header_, filter,
+                                       range_tombstones_, index_);
+    if (data_offset == 0)
+    {
+        return false;
+    }
+    memcpy(filter_.table_, filter, sizeof(bool) * filter_.m_);
+    range_size_ = 0;
+    for (typename std::vector<RangeTombstone>::const_iterator range_it = range_tombstones_.begin();
+         range_it != range_tombstones_.end();
+         ++range_it)
+    {
+        range_size_ += RangeTombstoneSize(*range_it);
+    }
+    index_size_ = 0;
+    index_size_ = data_offset - DataOffset();
+    data_size_ = file->size() - data_offset;
     return true;
 }
 
 template class SSTable<uint64_t, std::string>;
+template class SSTable<BinaryKey, std::string>;
+template class SSTable<uint64_t, uint64_t>;
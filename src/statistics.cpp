@@ -0,0 +1,134 @@
+#include "statistics.h"
+#include <sstream>
+
+static const char* const TICKER_NAMES[TICKER_TOTAL] = {
+    "lsmkv.get.count",
+    "lsmkv.get.found",
+    "lsmkv.get.memtable.hit",
+    "lsmkv.get.tables.probed",
+    "lsmkv.get.bytes.read",
+    "lsmkv.bloom.filter.useful",
+    "lsmkv.bloom.filter.positive",
+    "lsmkv.bloom.filter.false.positive",
+    "lsmkv.scan.count",
+    "lsmkv.scan.tables.read",
+    "lsmkv.scan.keys.returned",
+    "lsmkv.scan.bytes.read",
+    "lsmkv.put.count",
+    "lsmkv.delete.count",
+    "lsmkv.range.delete.count",
+    "lsmkv.bytes.written",
+    "lsmkv.flush.count",
+    "lsmkv.flush.bytes.written",
+    "lsmkv.compaction.count",
+    "lsmkv.compaction.trivial.moves",
+    "lsmkv.compaction.bytes.read",
+    "lsmkv.compaction.bytes.written",
+    "lsmkv.blob.bytes.written",
+    "lsmkv.blob.bytes.read",
+    "lsmkv.blob.gc.bytes.relocated",
+    "lsmkv.blob.files.deleted",
+    "lsmkv.background.errors",
+};
+
+static const char* const HISTOGRAM_NAMES[HISTOGRAM_TOTAL] = {
+    "lsmkv.db.get.nanos",
+    "lsmkv.db.write.nanos",
+    "lsmkv.db.scan.nanos",
+    "lsmkv.flush.nanos",
+    "lsmkv.compaction.nanos",
+    "lsmkv.get.memtable.nanos",
+    "lsmkv.get.bloom.nanos",
+    "lsmkv.get.find.key.nanos",
+    "lsmkv.get.read.nanos",
+    "lsmkv.write.memtable.nanos",
+    "lsmkv.scan.memtable.nanos",
+    "lsmkv.scan.index.nanos",
+    "lsmkv.scan.merge.nanos",
+    "lsmkv.scan.read.nanos",
+};
+
+Statistics::Statistics()
+{
+    Reset();
+}
+
+// threads are spread over the stripes in the order they first record
+int Statistics::StripeIndex()
+{
+    static std::atomic<int> next_index(0);
+    thread_local int index = next_index.fetch_add(1, std::memory_order_relaxed) % STRIPES_;
+    return index;
+}
+
+void Statistics::RecordTime(HistogramType type, uint64_t nanos)
+{
+    std::lock_guard<std::mutex> lock(histograms_[type].mutex_);
+    histograms_[type].histogram_.Record(nanos);
+}
+
+uint64_t Statistics::Get(Ticker ticker) const
+{
+    uint64_t sum = 0;
+    for (int i = 0; i < STRIPES_; ++i)
+    {
+        sum += stripes_[i].tickers_[ticker].load(std::memory_order_relaxed);
+    }
+    return sum;
+}
+
+Histogram Statistics::GetHistogram(HistogramType type) const
+{
+    std::lock_guard<std::mutex> lock(histograms_[type].mutex_);
+    return histograms_[type].histogram_;
+}
+
+void Statistics::Reset()
+{
+    for (int i = 0; i < STRIPES_; ++i)
+    {
+        for (int ticker = 0; ticker < TICKER_TOTAL; ++ticker)
+        {
+            stripes_[i].tickers_[ticker].store(0, std::memory_order_relaxed);
+        }
+    }
+    for (int type = 0; type < HISTOGRAM_TOTAL; ++type)
+    {
+        std::lock_guard<std::mutex> lock(histograms_[type].mutex_);
+        histograms_[type].histogram_.Clear();
+    }
+}
+
+std::string Statistics::ToString() const
+{
+    std::ostringstream out;
+    for (int ticker = 0; ticker < TICKER_TOTAL; ++ticker)
+    {
+        out << TICKER_NAMES[ticker] << " COUNT : " << Get((Ticker)ticker) << "\n";
+    }
+    for (int type = 0; type < HISTOGRAM_TOTAL; ++type)
+    {
+        out << ToString((HistogramType)type) << "\n";
+    }
+    return out.str();
+}
+
+std::string Statistics::ToString(HistogramType type) const
+{
+    Histogram histogram = GetHistogram(type);
+    std::ostringstream out;
+    out << HISTOGRAM_NAMES[type] << " P50 : " << histogram.Percentile(50) << " P95 : " << histogram.Percentile(95)
+        << " P99 : " << histogram.Percentile(99) << " P100 : " << histogram.Max()
+        << " COUNT : " << histogram.Count() << " SUM : " << histogram.Sum();
+    return out.str();
+}
+
+const char* Statistics::Name(Ticker ticker)
+{
+    return TICKER_NAMES[ticker];
+}
+
+const char* Statistics::Name(HistogramType type)
+{
+    return HISTOGRAM_NAMES[type];
+}
@@ -0,0 +1,122 @@
+#include "trace.h"
+#include <iostream>
+
+static const char TRACE_MAGIC[8] = {'L', 'S', 'M', 'K', 'V', 'T', 'R', 'C'};
+static const char TRACE_VERSION = 1;
+static const char* const TRACE_NAMES[] = {"UNKNOWN", "PUT", "GET", "DELETE", "DELETE_RANGE", "SCAN"};
+
+static void PutVarint(std::string &buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((char)value);
+}
+
+TraceWriter::TraceWriter():
+    start_(std::chrono::steady_clock::now()), last_micros_(0)
+{
+
+}
+
+std::unique_ptr<TraceWriter> TraceWriter::Open(const std::string &filename)
+{
+    std::unique_ptr<TraceWriter> writer(new TraceWriter());
+    writer->out_.open(filename, std::ios::binary | std::ios::trunc);
+    if (!writer->out_.is_open())
+    {
+        std::cerr << "Failed to open trace " << filename << "\n";
+        return nullptr;
+    }
+    std::string header(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+    header.push_back(TRACE_VERSION);
+    PutVarint(header, std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count());
+    writer->out_.write(header.data(), header.size());
+    return writer;
+}
+
+void TraceWriter::Record(TraceType type, uint64_t key, uint64_t arg)
+{
+    uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+    std::string record(1, (char)type);
+    std::lock_guard<std::mutex> lock(mutex_);
+    micros = (micros < last_micros_)? last_micros_ : micros;
+    PutVarint(record, micros - last_micros_);
+    PutVarint(record, key);
+    PutVarint(record, arg);
+    last_micros_ = micros;
+    out_.write(record.data(), record.size());
+}
+
+bool TraceWriter::Close()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    out_.close();
+    return !out_.fail();
+}
+
+TraceReader::TraceReader():
+    start_time_micros_(0), micros_(0)
+{
+
+}
+
+std::unique_ptr<TraceReader> TraceReader::Open(const std::string &filename)
+{
+    std::unique_ptr<TraceReader> reader(new TraceReader());
+    reader->in_.open(filename, std::ios::binary);
+    char magic[sizeof(TRACE_MAGIC)];
+    char version = 0;
+    if (!reader->in_.read(magic, sizeof(magic)) || !reader->in_.get(version) ||
+            std::string(magic, sizeof(magic)) != std::string(TRACE_MAGIC, sizeof(TRACE_MAGIC)) ||
+            version != TRACE_VERSION || !reader->ReadVarint(reader->start_time_micros_))
+    {
+        std::cerr << "Not a trace file " << filename << "\n";
+        return nullptr;
+    }
+    return reader;
+}
+
+bool TraceReader::ReadVarint(uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        char byte = 0;
+        if (!in_.get(byte))
+        {
+            return false;
+        }
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// a record cut short by a crash of the traced process ends the trace
+bool TraceReader::Next(TraceRecord &record)
+{
+    char type = 0;
+    uint64_t delta = 0;
+    if (!in_.get(type) || type < TRACE_PUT || type > TRACE_SCAN ||
+            !ReadVarint(delta) || !ReadVarint(record.key_) || !ReadVarint(record.arg_))
+    {
+        return false;
+    }
+    micros_ += delta;
+    record.type_ = (TraceType)type;
+    record.micros_ = micros_;
+    return true;
+}
+
+const char* TraceReader::Name(TraceType type)
+{
+    return (type >= TRACE_PUT && type <= TRACE_SCAN)? TRACE_NAMES[type] : "UNKNOWN";
+}